@@ -0,0 +1,253 @@
+import os
+import subprocess
+import struct
+import sys
+
+# Ahead-of-time translator: LC-3 .obj image -> C++ (one function per basic
+# block) -> shared library that lc3-alt-win.cpp loads with --aot.
+
+BLOCK_MAX_LEN = 64
+MR_KBSR = 0xFE00
+R_PC, R_COND = 8, 9
+
+def sext(x, bits):
+    x &= (1 << bits) - 1
+    return x - (1 << bits) if x >> (bits - 1) else x
+
+def read_obj(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+    origin = struct.unpack('>H', data[:2])[0]
+    words = list(struct.unpack(f'>{(len(data) - 2) // 2}H', data[2:2 + (len(data) - 2) // 2 * 2]))
+    return origin, words[:0x10000 - origin]
+
+def decode(pc, instr):
+    """Same split as decode() in the VM: (kind, r0, r1, r2, imm)."""
+    op = instr >> 12
+    r0, r1, r2 = (instr >> 9) & 7, (instr >> 6) & 7, instr & 7
+    pc_off9 = (pc + 1 + sext(instr, 9)) & 0xFFFF
+    if op == 0x0:
+        if r0 == 0:
+            return ('NOP', 0, 0, 0, 0)
+        return ('BRA' if r0 == 7 else 'BR', r0, 0, 0, pc_off9)
+    if op in (0x1, 0x5):
+        name = 'ADD' if op == 0x1 else 'AND'
+        if instr & 0x20:
+            return (name + '_I', r0, r1, 0, sext(instr, 5) & 0xFFFF)
+        return (name + '_R', r0, r1, r2, 0)
+    if op == 0x9:
+        return ('NOT', r0, r1, 0, 0)
+    if op in (0x2, 0xA, 0xE, 0x3, 0xB):
+        name = {0x2: 'LD', 0xA: 'LDI', 0xE: 'LEA', 0x3: 'ST', 0xB: 'STI'}[op]
+        return (name, r0, 0, 0, pc_off9)
+    if op in (0x6, 0x7):
+        return ('LDR' if op == 0x6 else 'STR', r0, r1, 0, sext(instr, 6) & 0xFFFF)
+    if op == 0xC:
+        return ('JMP', 0, r1, 0, 0)
+    if op == 0x4:
+        if instr & 0x800:
+            return ('JSR', 0, 0, 0, (pc + 1 + sext(instr, 11)) & 0xFFFF)
+        return ('JSRR', 0, r1, 0, 0)
+    if op == 0xF:
+        return ('TRAP', 0, 0, 0, instr & 0xFF)
+    return ('BAD', 0, 0, 0, 0)
+
+TERMINATORS = ('BR', 'BRA', 'JMP', 'JSR', 'JSRR', 'TRAP', 'BAD')
+FLAG_SETTERS = ('ADD_R', 'ADD_I', 'AND_R', 'AND_I', 'NOT', 'LD', 'LDI', 'LDR', 'LEA')
+
+def find_blocks(origin, words):
+    """Blocks are found by following control flow from the origin: branch
+    and call targets, fall-through paths and the return point after every
+    call or trap (except HALT). Data words are never reached this way. Code reached any
+    other way (computed jumps, code written at runtime) runs in the
+    interpreter."""
+    end = origin + len(words)
+    decoded = [decode(origin + i, w) for i, w in enumerate(words)]
+    leaders = {origin}
+    reached = set()
+    work = [origin]
+    while work:
+        pc = work.pop()
+        while origin <= pc < end and pc not in reached:
+            reached.add(pc)
+            kind, target = decoded[pc - origin][0], decoded[pc - origin][4]
+            if kind == 'BAD':
+                break
+            if kind in ('BR', 'BRA', 'JSR'):
+                leaders.add(target)
+                work.append(target)
+            if kind in TERMINATORS:
+                if kind not in ('BRA', 'JMP') and not (kind == 'TRAP' and target == 0x25):
+                    leaders.add(pc + 1)
+                    work.append(pc + 1)
+                break
+            pc += 1
+
+    blocks = []
+    for pc in sorted(leaders & reached):
+        body = []
+        while pc + len(body) in reached and len(body) < BLOCK_MAX_LEN:
+            d = decoded[pc + len(body) - origin]
+            if body and pc + len(body) in leaders:
+                break
+            if d[0] == 'BAD':
+                break
+            body.append(d)
+            if d[0] in TERMINATORS:
+                break
+        if body:
+            blocks.append((pc, body))
+    return blocks
+
+def emit_block(pc, body, entries):
+    out = [f'static uint16_t b_{pc:04x}(uint64_t* n, uint64_t budget)', '{']
+    out.append('    uint16_t* R = E.reg;')
+    if any(d[0] == 'LD' for d in body):
+        out.append('    uint16_t* M = E.memory;')
+    out.append('    uint16_t ' + ', '.join(f'r{i} = R[{i}]' for i in range(8)) + ';')
+    flag = None  # register that last set N/Z/P inside this block
+    s = '    '
+
+    def sync(count):
+        lines = [s + ' '.join(f'R[{i}] = r{i};' for i in range(8))]
+        if flag is not None:
+            lines.append(f'{s}R[{R_COND}] = cc(r{flag});')
+        lines.append(f'{s}*n += {count};')
+        return lines
+
+    def goto(target, indent=s):
+        # successors translated in this module are entered directly
+        # (a sibling call) until the budget runs out
+        target &= 0xFFFF
+        if target in entries:
+            return [f'{indent}CHAIN(0x{target:04x}, b_{target:04x});']
+        return [f'{indent}return 0x{target:04x};']
+
+    def cond():
+        return f'cc(r{flag})' if flag is not None else f'R[{R_COND}]'
+
+    ended = False
+    for i, (kind, r0, r1, r2, imm) in enumerate(body):
+        nxt = (pc + i + 1) & 0xFFFF
+        if kind == 'NOP':
+            pass
+        elif kind == 'ADD_R': out.append(f'{s}r{r0} = (uint16_t)(r{r1} + r{r2});')
+        elif kind == 'ADD_I': out.append(f'{s}r{r0} = (uint16_t)(r{r1} + 0x{imm:04x});')
+        elif kind == 'AND_R': out.append(f'{s}r{r0} = r{r1} & r{r2};')
+        elif kind == 'AND_I': out.append(f'{s}r{r0} = r{r1} & 0x{imm:04x};')
+        elif kind == 'NOT':   out.append(f'{s}r{r0} = (uint16_t)~r{r1};')
+        elif kind == 'LEA':   out.append(f'{s}r{r0} = 0x{imm:04x};')
+        elif kind == 'LD':
+            src = f'M[0x{imm:04x}]' if imm < MR_KBSR else f'E.mem_read(0x{imm:04x})'
+            out.append(f'{s}r{r0} = {src};')
+        elif kind == 'LDI':   out.append(f'{s}r{r0} = rd(rd(0x{imm:04x}));')
+        elif kind == 'LDR':   out.append(f'{s}r{r0} = rd((uint16_t)(r{r1} + 0x{imm:04x}));')
+        elif kind in ('ST', 'STI', 'STR'):
+            addr = {'ST': f'0x{imm:04x}', 'STI': f'rd(0x{imm:04x})',
+                    'STR': f'(uint16_t)(r{r1} + 0x{imm:04x})'}[kind]
+            out.append(f'{s}E.mem_write({addr}, r{r0});')
+            out.append(f'{s}if (*E.invalidated)')
+            out.append(f'{s}{{')
+            out += [s + l for l in sync(i + 1)]
+            out.append(f'{s}    return 0x{nxt:04x};')
+            out.append(f'{s}}}')
+        elif kind == 'BR':
+            out.append(f'{s}bool taken = ({cond()} & {r0}) != 0;')
+            out += sync(i + 1)
+            out.append(f'{s}if (taken)')
+            out.append(f'{s}{{')
+            out += goto(imm, s + s)
+            out.append(f'{s}}}')
+            out += goto(nxt)
+            ended = True
+        elif kind == 'BRA':
+            out += sync(i + 1)
+            out += goto(imm)
+            ended = True
+        elif kind in ('JMP', 'JSRR'):
+            out.append(f'{s}uint16_t next = r{r1};')
+            out += sync(i + 1)  # flags first: R7 may be the register that set them
+            if kind == 'JSRR':
+                out.append(f'{s}R[7] = 0x{nxt:04x};')
+            out.append(f'{s}return next;')
+            ended = True
+        elif kind == 'JSR':
+            out += sync(i + 1)
+            out.append(f'{s}R[7] = 0x{nxt:04x};')
+            out += goto(imm)
+            ended = True
+        elif kind == 'TRAP':
+            out += sync(i + 1)
+            out.append(f'{s}R[{R_PC}] = 0x{nxt:04x};')
+            out.append(f'{s}E.trap(0x{imm:02x});')
+            out.append(f'{s}return R[{R_PC}];')
+            ended = True
+        if kind in FLAG_SETTERS:
+            flag = r0
+    if not ended:
+        out += sync(len(body))
+        out += goto(pc + len(body))
+    out.append('}')
+    return out
+
+def translate(filename, source):
+    origin, words = read_obj(filename)
+    blocks = find_blocks(origin, words)
+    out = [f'/* generated by aot.py from {os.path.basename(filename)}, do not edit */',
+           '#include "lc3_aot.hpp"',
+           '',
+           'static Lc3AotEnv E;',
+           '',
+           'static inline uint16_t cc(uint16_t v) { return v == 0 ? 2 : (v >> 15) ? 4 : 1; }',
+           f'static inline uint16_t rd(uint16_t a) {{ return a >= 0x{MR_KBSR:04x} ? E.mem_read(a) : E.memory[a]; }}',
+           '',
+           '/* enter a translated successor directly unless it was dropped or the budget is spent */',
+           '#define CHAIN(pc, fn) do { if (*n < budget && E.entry[pc]) { return fn(n, budget); } return pc; } while (0)',
+           '']
+    for pc, body in blocks:
+        out.append(f'static uint16_t b_{pc:04x}(uint64_t* n, uint64_t budget);')
+    out.append('')
+    entries = {pc for pc, body in blocks}
+    for pc, body in blocks:
+        out += emit_block(pc, body, entries)
+        out.append('')
+    out.append('static const uint16_t image[] = {')
+    for i in range(0, len(words), 12):
+        out.append('    ' + ' '.join(f'0x{w:04x},' for w in words[i:i + 12]))
+    out.append('};')
+    out.append('')
+    out.append('static const Lc3AotBlock blocks[] = {')
+    for pc, body in blocks:
+        out.append(f'    {{ 0x{pc:04x}, {len(body)}, b_{pc:04x} }},')
+    out.append('};')
+    out.append('')
+    out.append('static void init(const Lc3AotEnv* env) { E = *env; }')
+    out.append('')
+    out.append('LC3_AOT_EXPORT const Lc3AotModule* lc3_aot_module(void)')
+    out.append('{')
+    out.append(f'    static const Lc3AotModule m = {{ LC3_AOT_VERSION, 0x{origin:04x}, {len(words)}, image,')
+    out.append(f'                                    {len(blocks)}, blocks, init }};')
+    out.append('    return &m;')
+    out.append('}')
+    with open(source, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+    print(f'Wrote {source}: {len(blocks)} blocks from {len(words)} words at x{origin:04X}')
+
+if __name__ == '__main__':
+    args = [a for a in sys.argv[1:] if a != '--emit-only']
+    if len(args) != 1:
+        print('Usage: python aot.py [--emit-only] file.obj')
+        sys.exit(1)
+    obj = args[0]
+    stem = obj[:-4] if obj.endswith('.obj') else obj
+    source = stem + '.aot.cpp'
+    translate(obj, source)
+    if '--emit-only' in sys.argv:
+        sys.exit(0)
+
+    lib = stem + ('.aot.dll' if os.name == 'nt' else '.aot.so')
+    here = os.path.dirname(os.path.abspath(__file__))
+    cmd = [os.environ.get('CXX', 'g++'), '-std=c++17', '-O2', '-shared', '-fPIC',
+           '-I', here, source, '-o', lib]
+    print(' '.join(cmd))
+    sys.exit(subprocess.call(cmd))
@@ -1,3 +1,4 @@
+import re
 import sys
 import struct
 
@@ -10,18 +11,36 @@ OPCODES = {
     'ADD': 0x1, 'AND': 0x5, 'NOT': 0x9,
     'BR':  0x0, 'BRN': 0x0, 'BRZ': 0x0, 'BRP': 0x0,
     'BRNZ': 0x0, 'BRNP': 0x0, 'BRZP': 0x0, 'BRNZP': 0x0,
-    'JMP': 0xC, 'JSR': 0x4,
-    'LD':  0x2, 'ST':  0x3,
-    'TRAP': 0xF, 'LEA': 0xE,
+    'JMP': 0xC, 'JSR': 0x4, 'JSRR': 0x4,
+    'LD':  0x2, 'ST':  0x3, 'LDI': 0xA, 'STI': 0xB,
+    'LDR': 0x6, 'STR': 0x7,
+    'TRAP': 0xF, 'LEA': 0xE, 'RTI': 0x8,
     'RET': 0xC
 }
 
+STRINGZ = re.compile(r'\s*(?:(\S+)\s+)??\.STRINGZ\s+"((?:[^"\\]|\\.)*)"', re.IGNORECASE)
+
 def parse_line(line):
+    m = STRINGZ.match(line)  # the string may hold spaces and ';'
+    if m:
+        text = m.group(2).encode('utf-8').decode('unicode_escape')
+        return ([m.group(1)] if m.group(1) else []) + ['.STRINGZ', text]
     line = line.split(';')[0].strip()
     if not line:
         return None
     return [token.strip(',') for token in line.split()]
 
+def size_of(tokens):
+    """Words a directive or instruction takes."""
+    op = tokens[0].upper()
+    if op == '.STRINGZ':
+        return len(tokens[1]) + 1
+    if op == '.BLKW':
+        return to_signed_imm(tokens[1], 16)
+    if op == '.END':
+        return 0
+    return 1
+
 def emit(pc, tokens, instr, output):
     print(f"[ASM] {pc:04X}: {tokens} → {instr:04X}")
     output.append(instr)
@@ -70,7 +89,7 @@ def assemble(filename):
 
         if tokens:
             program.append((pc, tokens))
-            pc += 1
+            pc += size_of(tokens)
 
     print(f"[DEBUG] Labels: {labels}")
 
@@ -100,9 +119,11 @@ def assemble(filename):
                 emit(pc, tokens, instr, output)
             elif op.startswith('BR'):
                 cond = 0
-                if 'n' in op: cond |= 0x4
-                if 'z' in op: cond |= 0x2
-                if 'p' in op: cond |= 0x1
+                flags = op[2:]  # op is upper-cased
+                if 'N' in flags: cond |= 0x4
+                if 'Z' in flags: cond |= 0x2
+                if 'P' in flags: cond |= 0x1
+                if not flags: cond = 0x7  # plain BR is BRnzp; nzp=000 never branches
                 label = tokens[1]
                 raw_offset = labels[label] - (pc + 1)
                 print(f"[DEBUG] BR target {label} at {labels[label]:04X}, offset = {raw_offset}")
@@ -115,10 +136,26 @@ def assemble(filename):
                 offset = to_signed_imm(str(labels[label] - (pc + 1)), 9)
                 instr = (opcode << 12) | (dr << 9) | offset
                 emit(pc, tokens, instr, output)
+            elif op in ('LD', 'ST', 'LDI', 'STI'):
+                r = REG[tokens[1]]
+                label = tokens[2]
+                offset = to_signed_imm(str(labels[label] - (pc + 1)), 9)
+                instr = (opcode << 12) | (r << 9) | offset
+                emit(pc, tokens, instr, output)
+            elif op == 'LDR' or op == 'STR':
+                r = REG[tokens[1]]
+                base = REG[tokens[2]]
+                offset = to_signed_imm(tokens[3], 6)
+                instr = (opcode << 12) | (r << 9) | (base << 6) | offset
+                emit(pc, tokens, instr, output)
             elif op == 'JMP':
                 base = REG[tokens[1]]
                 instr = (opcode << 12) | (base << 6)
                 emit(pc, tokens, instr, output)
+            elif op == 'JSRR':
+                base = REG[tokens[1]]
+                instr = (opcode << 12) | (base << 6)
+                emit(pc, tokens, instr, output)
             elif op == 'JSR':
                 label = tokens[1]
                 offset = to_signed_imm(str(labels[label] - (pc + 1)), 11)
@@ -131,9 +168,16 @@ def assemble(filename):
             elif op == 'RET':
                 instr = (opcode << 12) | (7 << 6)
                 emit(pc, tokens, instr, output)
+            elif op == 'RTI':
+                emit(pc, tokens, opcode << 12, output)
         elif op == '.FILL':
-            val = to_signed_imm(tokens[1], 16)
+            val = labels[tokens[1]] if tokens[1] in labels else to_signed_imm(tokens[1], 16)
             output.append(val)
+        elif op == '.STRINGZ':
+            output.extend(ord(c) for c in tokens[1])
+            output.append(0)
+        elif op == '.BLKW':
+            output.extend([0] * size_of(tokens))
         elif op == '.END':
             continue
 
@@ -145,6 +189,12 @@ def assemble(filename):
 
     print(f"Wrote {objname} with origin x{orig:04X} and {len(output)} words")
 
+    # labels from the first pass, for the VM's sampling profiler
+    symname = filename.replace('.asm', '.sym')
+    with open(symname, 'w') as out:
+        for label, addr in sorted(labels.items(), key=lambda kv: kv[1]):
+            out.write(f"x{addr:04X} {label}\n")
+
 if __name__ == '__main__':
     if len(sys.argv) != 2:
         print("Usage: python asm.py file.asm")
@@ -0,0 +1,24 @@
+; Lane kernel for --batch: lane i (R0) computes fib(10 + (i & 15)) REPS
+; times. Lanes with different i leave INNER after different trip counts
+; and regroup at its exit.
+        .ORIG x3000
+        LD R5, REPS
+        LEA R6, RESULT
+OUTER   AND R1, R0, #15
+        ADD R1, R1, #10     ; n = 10..25
+        AND R2, R2, #0      ; a = 0
+        AND R3, R3, #0
+        ADD R3, R3, #1      ; b = 1
+INNER   ADD R4, R2, R3
+        ADD R2, R3, #0
+        ADD R3, R4, #0
+        ADD R1, R1, #-1
+        BRp INNER
+        STR R2, R6, #0      ; RESULT = fib(n)
+        ADD R5, R5, #-1
+        BRp OUTER
+        LDR R2, R6, #0
+        TRAP x25
+REPS    .FILL #2000
+RESULT  .FILL #0
+        .END
@@ -0,0 +1,158 @@
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+# Headless benchmark runner: runs every corpus workload on every dispatch
+# engine --repeat times through `lc3-vm --json`, reports mean and
+# percentile ns/instr per (workload, engine), and exits 1 when a mean
+# falls more than --tolerance below the throughput in a stored baseline.
+#
+#   python bench.py                                   # corpus/*.obj + corpus/pair.topo
+#   python bench.py --engine jit --repeat 10 --json corpus/recurse.obj
+#   python bench.py --save-baseline bench_baseline.json
+#   python bench.py --baseline bench_baseline.json --tolerance 0.15
+#
+# .topo workloads run under multi-vm (engine "multi-vm"): instructions are
+# summed over the VMs and timed by the slowest one. The aot engine first
+# translates the workload with aot.py (.obj only). Run to the end, every
+# engine must retire the same number of instructions on a workload; a
+# mismatch also exits 1.
+
+USAGE = """python bench.py [--vm PATH] [--multi-vm PATH] [--engine LIST|all] [--max-instr N]
+    [--repeat R] [--json] [--baseline FILE] [--save-baseline FILE] [--tolerance FRAC]
+    [workload.obj|.lc3i|.topo ...]"""
+
+ENGINES = ['table', 'threaded', 'block', 'jit', 'aot']
+EXE = '.exe' if os.name == 'nt' else ''
+
+def percentile(values, p):
+    """Nearest-rank percentile of a non-empty list."""
+    s = sorted(values)
+    rank = max(1, -(-len(s) * p // 100))
+    return s[int(rank) - 1]
+
+AOT_BUILT = set()
+
+def aot_module(image):
+    """Translate and compile image with aot.py, once per run."""
+    stem = image[:-4] if image.endswith('.obj') else image
+    lib = stem + ('.aot.dll' if os.name == 'nt' else '.aot.so')
+    if lib not in AOT_BUILT:
+        subprocess.run([sys.executable, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'aot.py'), image],
+                       stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, check=True)
+        AOT_BUILT.add(lib)
+    return os.path.abspath(lib)
+
+def run_image(vm, engine, image, max_instr):
+    if engine == 'aot':
+        cmd = [vm, '--aot', aot_module(image), '--json']
+    else:
+        cmd = [vm, '--engine', engine, '--json']
+    if max_instr:
+        cmd += ['--max-instr', str(max_instr)]
+    out = subprocess.run(cmd + [image], stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, check=True).stdout
+    last = out.decode('utf-8', 'replace').rstrip().rsplit('\n', 1)[-1]
+    r = json.loads(last)
+    return r['instructions'], r['ns']
+
+def run_topology(multi_vm, topo):
+    out = subprocess.run([multi_vm, topo], stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, check=True).stdout
+    text = out.decode('utf-8', 'replace')
+    instr = sum(int(n) for n in re.findall(r'^Instructions: (\d+)', text, re.M))
+    ms = max(float(t) for t in re.findall(r'^Elapsed time\s*: ([\d.]+) ms', text, re.M))
+    return instr, int(ms * 1e6)
+
+def summarize(workload, engine, runs):
+    ns = [t / n for n, t in runs if n] or [0.0]  # nothing retired: report zeros
+    mean = sum(ns) / len(ns)
+    return {
+        'workload': workload, 'engine': engine, 'runs': len(ns),
+        'instructions': runs[0][0],
+        'mean_ns_per_instr': round(mean, 3),
+        'p50_ns_per_instr': round(percentile(ns, 50), 3),
+        'p90_ns_per_instr': round(percentile(ns, 90), 3),
+        'p99_ns_per_instr': round(percentile(ns, 99), 3),
+        'min_ns_per_instr': round(min(ns), 3),
+        'mips': round(1e3 / mean, 2) if mean else 0.0,
+    }
+
+def main():
+    vm, multi_vm = './lc3-vm' + EXE, './multi-vm' + EXE
+    engines, max_instr, repeat = ENGINES, 0, 5
+    as_json, baseline, save_baseline, tolerance = False, None, None, 0.10
+    workloads = []
+    args = sys.argv[1:]
+    while args:
+        a = args.pop(0)
+        if a in ('--vm', '--multi-vm', '--engine', '--max-instr', '--repeat',
+                 '--baseline', '--save-baseline', '--tolerance') and not args:
+            sys.exit(USAGE)
+        if a == '--vm': vm = args.pop(0)
+        elif a == '--multi-vm': multi_vm = args.pop(0)
+        elif a == '--engine':
+            e = args.pop(0)
+            engines = ENGINES if e == 'all' else e.split(',')
+        elif a == '--max-instr': max_instr = int(args.pop(0))
+        elif a == '--repeat': repeat = int(args.pop(0))
+        elif a == '--json': as_json = True
+        elif a == '--baseline': baseline = args.pop(0)
+        elif a == '--save-baseline': save_baseline = args.pop(0)
+        elif a == '--tolerance': tolerance = float(args.pop(0))
+        elif a.startswith('-'): sys.exit(USAGE)
+        else: workloads.append(a)
+    if repeat < 1:
+        sys.exit(USAGE)
+    if not workloads:
+        workloads = [w for w in sorted(glob.glob('corpus/*.obj')) if not os.path.basename(w).startswith('pair_')]
+        workloads += sorted(glob.glob('corpus/*.topo'))
+
+    results = []
+    for w in workloads:
+        if w.endswith('.topo'):
+            results.append(summarize(w, 'multi-vm', [run_topology(multi_vm, w) for _ in range(repeat)]))
+            continue
+        for e in engines:
+            if e == 'aot' and not w.endswith('.obj'):
+                continue
+            results.append(summarize(w, e, [run_image(vm, e, w, max_instr) for _ in range(repeat)]))
+
+    if as_json:
+        print(json.dumps({'repeat': repeat, 'max_instr': max_instr, 'results': results}, indent=2))
+    else:
+        print(f"{'workload':<28} {'engine':<9} {'instructions':>12} {'mean':>8} {'p50':>8} {'p90':>8} "
+              f"{'p99':>8} {'MIPS':>9}   (ns/instr over {repeat} runs)")
+        for r in results:
+            print(f"{r['workload']:<28} {r['engine']:<9} {r['instructions']:>12} {r['mean_ns_per_instr']:>8.2f} "
+                  f"{r['p50_ns_per_instr']:>8.2f} {r['p90_ns_per_instr']:>8.2f} {r['p99_ns_per_instr']:>8.2f} "
+                  f"{r['mips']:>9.2f}")
+
+    if save_baseline:
+        with open(save_baseline, 'w') as f:
+            json.dump({f"{r['workload']}|{r['engine']}": r['mips'] for r in results}, f, indent=2, sort_keys=True)
+            f.write('\n')
+
+    failed = 0
+    counts = {}
+    for r in results:
+        counts.setdefault(r['workload'], {})[r['engine']] = r['instructions']
+    for w, by_engine in counts.items():
+        # block engines stop --max-instr at a block boundary
+        if not max_instr and len(set(by_engine.values())) > 1:
+            print(f"MISMATCH {w}: " + ', '.join(f'{e} {n}' for e, n in by_engine.items()), file=sys.stderr)
+            failed += 1
+    if baseline:
+        with open(baseline) as f:
+            base = json.load(f)
+        for r in results:
+            want = base.get(f"{r['workload']}|{r['engine']}")
+            if want and r['mips'] < want * (1 - tolerance):
+                print(f"REGRESSION {r['workload']} {r['engine']}: {r['mips']:.2f} MIPS, "
+                      f"baseline {want:.2f} (-{100 * (1 - r['mips'] / want):.1f}%)", file=sys.stderr)
+                failed += 1
+    sys.exit(1 if failed else 0)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Single-writer broadcast ring: every reader sees every message, through
+// its own cursor. The writer never waits for readers; a reader that falls
+// more than Size messages behind has been lapped, which it detects from the
+// slot's sequence number, counts in Reader::lagged and skips forward to the
+// oldest message still in the ring. Slots are seqlocked (odd while being
+// written), so a reader that races the writer retries instead of returning
+// a torn value.
+template<typename T, size_t Size>
+class BroadcastRing {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+    struct Slot {
+        std::atomic<size_t> seq{0}; // 2*pos+1 while writing pos, 2*pos+2 once written
+        T data;
+    };
+
+    Slot slots[Size];
+    alignas(64) std::atomic<size_t> head{0}; // next position to write
+
+public:
+    struct Reader {
+        size_t   pos = 0;    // next position to read
+        uint64_t lagged = 0; // times this reader was lapped by the writer
+    };
+
+    // A reader that starts with the next message published.
+    Reader subscribe() const {
+        Reader r;
+        r.pos = head.load(std::memory_order_acquire);
+        return r;
+    }
+
+    void publish(const T& item) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Slot& s = slots[pos & (Size - 1)];
+        s.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.data = item;
+        s.seq.store(2 * pos + 2, std::memory_order_release);
+        head.store(pos + 1, std::memory_order_release);
+    }
+
+    bool read(Reader& r, T& item) {
+        for (;;) {
+            const Slot& s = slots[r.pos & (Size - 1)];
+            size_t want = 2 * r.pos + 2;
+            size_t s1 = s.seq.load(std::memory_order_acquire);
+            if (s1 < want) return false; // not published yet (or being written)
+            if (s1 == want) {
+                T v = s.data;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (s.seq.load(std::memory_order_relaxed) == s1) {
+                    item = v;
+                    ++r.pos;
+                    return true;
+                }
+            }
+            // lapped: resume at the oldest slot the writer is not about to reuse
+            size_t h = head.load(std::memory_order_acquire);
+            r.pos = h > Size - 1 ? h - (Size - 1) : 0;
+            ++r.lagged;
+        }
+    }
+};
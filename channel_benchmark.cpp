@@ -0,0 +1,99 @@
+#include "mpmc_queue.hpp"
+#include "broadcast_ring.hpp"
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+
+// g++ -std=c++17 -O2 channel_benchmark.cpp -o channel_benchmark -pthread
+// Scaling from 2 to 32 threads:
+//   mpmc      - T/2 producers feed T/2 consumers through one MpmcQueue
+//   broadcast - one writer, T-1 readers each following the whole stream
+
+constexpr uint32_t N = 1 << 20; // messages per run
+
+void bench_mpmc(int threads) {
+    static MpmcQueue<uint16_t, 1024> q;
+    int producers = threads / 2, consumers = threads - producers;
+    std::atomic<uint64_t> total{0};
+    std::atomic<int> producing{producers};
+    std::vector<std::thread> pool;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < producers; ++p) {
+        pool.emplace_back([p, producers, &producing] {
+            for (uint32_t i = p; i < N; i += producers) {
+                while (!q.push((uint16_t)i)); // spin until push succeeds
+            }
+            producing.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        // counts stay in the thread; nothing shared is written per message
+        pool.emplace_back([&total, &producing] {
+            uint64_t sum = 0;
+            uint16_t x;
+            for (;;) {
+                bool last = producing.load(std::memory_order_acquire) == 0;
+                if (q.pop(x)) sum += x;
+                else if (last) break; // every push was in before this pop found it empty
+            }
+            total += sum;
+        });
+    }
+    for (auto& t : pool) t.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    std::cout << "mpmc      threads=" << threads << " (" << producers << "P/" << consumers << "C): "
+              << "Sum = " << total << ", Time = " << elapsed << " us, "
+              << (elapsed ? (double)N / elapsed : 0.0) << " M msgs/s\n";
+}
+
+void bench_broadcast(int threads) {
+    static BroadcastRing<uint16_t, 1024> ring;
+    int readers = threads - 1;
+    std::atomic<int> ready{0};
+    std::atomic<bool> done{false};
+    std::vector<uint64_t> got(readers), lagged(readers);
+    std::vector<std::thread> pool;
+
+    for (int r = 0; r < readers; ++r) {
+        pool.emplace_back([r, &ready, &done, &got, &lagged] {
+            auto rd = ring.subscribe();
+            ready.fetch_add(1);
+            uint16_t x;
+            uint64_t n = 0;
+            while (!done.load(std::memory_order_acquire)) {
+                while (ring.read(rd, x)) ++n;
+            }
+            while (ring.read(rd, x)) ++n;
+            got[r] = n;
+            lagged[r] = rd.lagged;
+        });
+    }
+    while (ready.load() < readers) {}
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < N; ++i) ring.publish((uint16_t)i);
+    done.store(true, std::memory_order_release);
+    for (auto& t : pool) t.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    uint64_t min_got = N, lapped = 0;
+    for (int r = 0; r < readers; ++r) {
+        if (got[r] < min_got) min_got = got[r];
+        lapped += lagged[r];
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    std::cout << "broadcast threads=" << threads << " (1W/" << readers << "R): "
+              << "Time = " << elapsed << " us, " << (elapsed ? (double)N / elapsed : 0.0)
+              << " M msgs/s published, slowest reader got " << min_got << "/" << N
+              << ", lapped " << lapped << " times\n";
+}
+
+int main() {
+    for (int threads = 2; threads <= 32; threads *= 2) bench_mpmc(threads);
+    for (int threads = 2; threads <= 32; threads *= 2) bench_broadcast(threads);
+}
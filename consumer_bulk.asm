@@ -0,0 +1,27 @@
+        .ORIG x4000
+        LEA R0, BUF         ; R0 = receive buffer
+        AND R1, R1, #0
+        ADD R1, R1, #15
+        ADD R1, R1, #1      ; R1 = 16 words per message
+
+LOOP    TRAP x33            ; block lands in BUF..BUF+15
+        ADD R2, R2, #1      ; messages received
+        BRnzp LOOP
+
+BUF     .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .FILL x0
+        .END
@@ -0,0 +1,27 @@
+; Arithmetic loop: a ^ b built from AND/NOT, a shift and two adds per
+; step, INNER steps per pass, OUTER passes. Checksum left in R0.
+        .ORIG x3000
+        LD R6, OUTER
+        AND R0, R0, #0
+PASS    LD R5, INNER
+STEP    ADD R1, R5, #0      ; a = i
+        ADD R2, R5, #13     ; b = i + 13
+        NOT R3, R2
+        AND R3, R1, R3      ; a & ~b
+        NOT R4, R1
+        AND R4, R4, R2      ; ~a & b
+        NOT R3, R3
+        NOT R4, R4
+        AND R3, R3, R4
+        NOT R3, R3          ; a ^ b
+        ADD R0, R0, R3
+        ADD R3, R3, R3      ; << 1
+        ADD R0, R0, R3
+        ADD R5, R5, #-1
+        BRp STEP
+        ADD R6, R6, #-1
+        BRp PASS
+        TRAP x25
+OUTER   .FILL #64
+INNER   .FILL #20000
+        .END
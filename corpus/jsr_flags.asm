@@ -0,0 +1,26 @@
+; Condition codes across a call: the caller's last flag-setting
+; instruction writes R7, then JSR/JSRR overwrite R7 with the return
+; address; the callee branches on the flags from the ALU result, not from
+; the return address. REPS calls of each kind; R0 counts the taken
+; branches (2 * REPS).
+        .ORIG x3000
+        LD R5, REPS
+        AND R0, R0, #0
+        LEA R4, SUB
+AGAIN   AND R7, R7, #0
+        ADD R7, R7, #-1     ; N set by R7
+        JSR SUB
+        AND R7, R7, #0
+        ADD R7, R7, #-1
+        JSRR R4
+        ADD R5, R5, #-1
+        BRp AGAIN
+        TRAP x25
+
+SUB     BRn OK
+        RET
+OK      ADD R0, R0, #1
+        RET
+
+REPS    .FILL #200
+        .END
@@ -0,0 +1,28 @@
+; Memory streaming: fill a 4096-word buffer with STR, then sum it back
+; with LDR, PASSES times. Sum of the last pass left in R0.
+        .ORIG x3000
+        LD R5, PASSES
+PASS    LEA R1, BUF
+        LD R2, LEN
+FILL    STR R2, R1, #0
+        STR R2, R1, #1
+        ADD R1, R1, #2
+        ADD R2, R2, #-2
+        BRp FILL
+        LEA R1, BUF
+        LD R2, LEN
+        AND R0, R0, #0
+SUM     LDR R3, R1, #0
+        ADD R0, R0, R3
+        LDR R3, R1, #1
+        ADD R0, R0, R3
+        ADD R1, R1, #2
+        ADD R2, R2, #-2
+        BRp SUM
+        ADD R5, R5, #-1
+        BRp PASS
+        TRAP x25
+PASSES  .FILL #800
+LEN     .FILL #4096
+BUF     .BLKW #4096
+        .END
@@ -0,0 +1,8 @@
+; Consumer half of corpus/pair.topo: sums what arrives on channel 0 into
+; R2; TRAP x31 halts the VM once the channel is closed and drained.
+        .ORIG x3000
+        AND R2, R2, #0
+RECV    TRAP x31
+        ADD R2, R2, R0
+        BRnzp RECV
+        .END
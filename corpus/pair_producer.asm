@@ -0,0 +1,16 @@
+; Producer half of corpus/pair.topo: sends 1, 2, 3, ... on channel 0,
+; OUTER * INNER words in all, then halts (which closes the channel).
+        .ORIG x3000
+        LD R2, OUTER
+        AND R0, R0, #0
+PASS    LD R1, INNER
+SEND    ADD R0, R0, #1
+        TRAP x30
+        ADD R1, R1, #-1
+        BRp SEND
+        ADD R2, R2, #-1
+        BRp PASS
+        TRAP x25
+OUTER   .FILL #50
+INNER   .FILL #10000
+        .END
@@ -0,0 +1,33 @@
+; Call-heavy recursion: naive fib(N) with a stack frame per call, REPS
+; times. fib(N) left in R0.
+        .ORIG x3000
+        LD R6, STACK
+        LD R5, REPS
+AGAIN   LD R0, N
+        JSR FIB
+        ADD R5, R5, #-1
+        BRp AGAIN
+        TRAP x25
+
+; R0 <- fib(R0); uses R1, frame on R6: [R7, n, fib(n-1)]
+FIB     ADD R6, R6, #-3
+        STR R7, R6, #0
+        STR R0, R6, #1
+        ADD R1, R0, #-2
+        BRn DONE            ; fib(0) = 0, fib(1) = 1
+        ADD R0, R0, #-1
+        JSR FIB
+        STR R0, R6, #2
+        LDR R0, R6, #1
+        ADD R0, R0, #-2
+        JSR FIB
+        LDR R1, R6, #2
+        ADD R0, R0, R1
+DONE    LDR R7, R6, #0
+        ADD R6, R6, #3
+        RET
+
+STACK   .FILL xF000
+REPS    .FILL #10
+N       .FILL #24
+        .END
@@ -0,0 +1,18 @@
+; String traps: PUTS a line, then OUT it again one character at a time,
+; REPS times.
+        .ORIG x3000
+        LD R5, REPS
+LINE    LEA R0, MSG
+        TRAP x22
+        LEA R1, MSG
+CHAR    LDR R0, R1, #0
+        BRz NEXT
+        TRAP x21
+        ADD R1, R1, #1
+        BRnzp CHAR
+NEXT    ADD R5, R5, #-1
+        BRp LINE
+        TRAP x25
+REPS    .FILL #20000
+MSG     .STRINGZ "The quick brown fox jumps over the lazy dog; 0123456789\n"
+        .END
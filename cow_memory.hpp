@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// LC-3 guest memory as 256 pages of 256 words (512 bytes) that are shared
+// copy-on-write between copies. Copying a CowMemory only bumps page
+// reference counts; the first write to a shared page gives the writer its
+// own copy. A page can also point at words nobody owns - the shared zero
+// page, or a mapped image (map()) - which are never written or counted,
+// so copying mostly-empty or freshly loaded memory is cheap.
+//
+// Pages are only ever written by the single owner that holds the last
+// reference, so copies may run on different threads. Copying and
+// destroying a given CowMemory must not race with its own reads/writes.
+
+class CowMemory {
+public:
+    enum { PAGE_SHIFT = 8, PAGE_WORDS = 1 << PAGE_SHIFT, PAGE_COUNT = (1 << 16) >> PAGE_SHIFT };
+
+    CowMemory() {
+        for (int i = 0; i < PAGE_COUNT; ++i) {
+            data[i] = const_cast<uint16_t*>(zero_words());
+            owner[i] = nullptr;
+        }
+    }
+    CowMemory(const CowMemory& other) {
+        for (int i = 0; i < PAGE_COUNT; ++i) {
+            data[i] = other.data[i];
+            owner[i] = share(other.owner[i]);
+        }
+    }
+    CowMemory& operator=(const CowMemory& other) {
+        for (int i = 0; i < PAGE_COUNT; ++i) {
+            Page* p = share(other.owner[i]);
+            release(owner[i]);
+            owner[i] = p;
+            data[i] = other.data[i];
+        }
+        return *this;
+    }
+    ~CowMemory() {
+        for (Page* p : owner) release(p);
+    }
+
+    uint16_t read(uint16_t addr) const { return data[addr >> PAGE_SHIFT][addr & (PAGE_WORDS - 1)]; }
+    void write(uint16_t addr, uint16_t val) { writable(addr >> PAGE_SHIFT)[addr & (PAGE_WORDS - 1)] = val; }
+
+    // direct access to one page, for bulk copies that stay inside it
+    const uint16_t* page(unsigned index) const { return data[index]; }
+    uint16_t* writable(unsigned index) {
+        Page* p = owner[index];
+        if (!p || p->refs.load(std::memory_order_acquire) != 1) { // shared: copy on first write
+            Page* own = new Page();
+            memcpy(own->w, data[index], sizeof(own->w));
+            release(p);
+            owner[index] = own;
+            data[index] = own->w;
+        }
+        return data[index];
+    }
+
+    // point a page at PAGE_WORDS read-only words that outlive every copy
+    void map(unsigned index, const uint16_t* words) {
+        release(owner[index]);
+        owner[index] = nullptr;
+        data[index] = const_cast<uint16_t*>(words); // only read; writable() copies first
+    }
+
+    // pages this copy does not share with anyone (what it costs on its own)
+    int private_pages() const {
+        int n = 0;
+        for (Page* p : owner) n += p && p->refs.load(std::memory_order_relaxed) == 1;
+        return n;
+    }
+
+private:
+    struct Page {
+        std::atomic<uint32_t> refs{1};
+        uint16_t w[PAGE_WORDS];
+    };
+    uint16_t* data[PAGE_COUNT]; // page contents
+    Page* owner[PAGE_COUNT];    // nullptr: zero page or mapped words
+
+    static const uint16_t* zero_words() {
+        static const uint16_t zero[PAGE_WORDS] = {};
+        return zero;
+    }
+    static Page* share(Page* p) {
+        if (p) p->refs.fetch_add(1, std::memory_order_relaxed);
+        return p;
+    }
+    static void release(Page* p) {
+        if (p && p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
+    }
+};
@@ -0,0 +1,8 @@
+        .ORIG x4000
+        AND R1, R1, #0
+        ADD R1, R1, #1      ; channel 1: MPMC fan-in
+
+LOOP    TRAP x35            ; R0 <- next value on channel R1
+        ADD R2, R2, #1      ; messages received
+        BRnzp LOOP
+        .END
@@ -0,0 +1,8 @@
+.ORIG x3000
+AND R0, R0, #0
+AND R1, R1, #0
+ADD R1, R1, #1      ; channel 1: MPMC fan-in
+LOOP: ADD R0, R0, #1
+      TRAP x34        ; send R0 on channel R1
+      BRnzp LOOP
+.END
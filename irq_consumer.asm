@@ -0,0 +1,53 @@
+; Interrupt-driven consumer for irq.topo: sleeps in TRAP x26 (WAIT) while
+; the bus interrupt handler sums what arrives on channel 0 into R2, and a
+; 1 ms timer counts ticks in R3. The handler's RECV halts the VM once the
+; channel is closed and drained. Handlers run on the supervisor stack (R6)
+; and save what they use; TRAP overwrites R7.
+        .ORIG x3000
+        AND R2, R2, #0
+        AND R3, R3, #0
+        LEA R0, RXISR
+        STI R0, VBUS        ; vector x82
+        LEA R0, TMRISR
+        STI R0, VTMR        ; vector x81
+        LD R0, PERIOD
+        STI R0, TMRUS
+        LD R0, IE
+        STI R0, TMR
+        AND R0, R0, #0
+        ADD R0, R0, #1
+        STI R0, BUSMASK     ; channel 0
+        LD R0, IE
+        STI R0, BUSIR
+IDLE    TRAP x26
+        BRnzp IDLE
+
+RXISR   ADD R6, R6, #-2
+        STR R0, R6, #0
+        STR R7, R6, #1
+DRAIN   TRAP x31            ; RECV
+        ADD R2, R2, R0
+        LDI R0, BUSIR
+        BRn DRAIN           ; bit 15: another word is waiting
+        LDR R0, R6, #0
+        LDR R7, R6, #1
+        ADD R6, R6, #2
+        RTI
+
+TMRISR  ADD R6, R6, #-1
+        STR R0, R6, #0
+        LDI R0, TMR         ; acknowledge
+        ADD R3, R3, #1
+        LDR R0, R6, #0
+        ADD R6, R6, #1
+        RTI
+
+PERIOD  .FILL #1000
+IE      .FILL x4000
+VTMR    .FILL x0181
+VBUS    .FILL x0182
+TMR     .FILL xFE50
+TMRUS   .FILL xFE51
+BUSIR   .FILL xFE52
+BUSMASK .FILL xFE53
+        .END
@@ -0,0 +1,29 @@
+; Paced producer for irq.topo: a 100 us timer interrupt sends 1, 2, 3, ...
+; on channel 0, one word per tick, and halts after COUNT words. In between
+; the VM sleeps in TRAP x26 (WAIT); the idle loop keeps nothing in
+; registers, so the handler saves none.
+        .ORIG x3000
+        AND R0, R0, #0
+        LD R2, COUNT
+        LEA R1, TICK
+        STI R1, VTMR        ; vector x81
+        LD R1, PERIOD
+        STI R1, TMRUS       ; starts the timer
+        LD R1, IE
+        STI R1, TMR         ; timer interrupt enable
+IDLE    TRAP x26
+        BRnzp IDLE
+TICK    LDI R1, TMR         ; acknowledge: the load clears bit 15
+        ADD R0, R0, #1
+        TRAP x30
+        ADD R2, R2, #-1
+        BRz STOP
+        RTI
+STOP    TRAP x25
+COUNT   .FILL #5000
+PERIOD  .FILL #100
+IE      .FILL x4000
+VTMR    .FILL x0181
+TMR     .FILL xFE50
+TMRUS   .FILL xFE51
+        .END
@@ -0,0 +1,135 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Lane vectors for the batch engine: LANE_W 16-bit lanes per operation.
+// AVX-512BW keeps masks in k-registers (one bit per lane); AVX2 keeps them
+// as all-ones/all-zeros 16-bit lanes; without either, plain arrays that the
+// compiler may still vectorise. lv_bits() returns one bit per lane in every
+// variant, so callers can walk the lanes of a mask the same way.
+
+#if defined(__AVX512BW__)
+#include <immintrin.h>
+#define LANE_W    32
+#define LANE_ISA  "AVX-512BW"
+typedef __m512i   LVec;
+typedef __mmask32 LMask;
+
+static inline LVec  lv_load(const uint16_t* p)        { return _mm512_loadu_si512(p); }
+static inline void  lv_store(uint16_t* p, LVec v)     { _mm512_storeu_si512(p, v); }
+static inline LVec  lv_splat(uint16_t x)              { return _mm512_set1_epi16((short)x); }
+static inline LVec  lv_add(LVec a, LVec b)            { return _mm512_add_epi16(a, b); }
+static inline LVec  lv_and(LVec a, LVec b)            { return _mm512_and_si512(a, b); }
+static inline LVec  lv_not(LVec a)                    { return _mm512_ternarylogic_epi32(a, a, a, 0x55); }
+static inline LVec  lv_min(LVec a, LVec b)            { return _mm512_min_epu16(a, b); }
+static inline LVec  lv_select(LMask m, LVec a, LVec b) { return _mm512_mask_blend_epi16(m, b, a); } // m ? a : b
+static inline LMask lv_eq(LVec a, LVec b)             { return _mm512_cmpeq_epi16_mask(a, b); }
+static inline LMask lv_neg(LVec a)                    { return _mm512_movepi16_mask(a); }
+static inline LMask lv_test(LVec a, LVec b)           { return _mm512_test_epi16_mask(a, b); } // (a & b) != 0
+static inline LMask lv_mand(LMask a, LMask b)         { return a & b; }
+static inline uint32_t lv_bits(LMask m)               { return (uint32_t)m; }
+
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define LANE_W    16
+#define LANE_ISA  "AVX2"
+typedef __m256i LVec;
+typedef __m256i LMask;
+
+static inline LVec  lv_load(const uint16_t* p)        { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void  lv_store(uint16_t* p, LVec v)     { _mm256_storeu_si256((__m256i*)p, v); }
+static inline LVec  lv_splat(uint16_t x)              { return _mm256_set1_epi16((short)x); }
+static inline LVec  lv_add(LVec a, LVec b)            { return _mm256_add_epi16(a, b); }
+static inline LVec  lv_and(LVec a, LVec b)            { return _mm256_and_si256(a, b); }
+static inline LVec  lv_not(LVec a)                    { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+static inline LVec  lv_min(LVec a, LVec b)            { return _mm256_min_epu16(a, b); }
+static inline LVec  lv_select(LMask m, LVec a, LVec b) { return _mm256_blendv_epi8(b, a, m); }
+static inline LMask lv_eq(LVec a, LVec b)             { return _mm256_cmpeq_epi16(a, b); }
+static inline LMask lv_neg(LVec a)                    { return _mm256_srai_epi16(a, 15); }
+static inline LMask lv_test(LVec a, LVec b)
+{
+    return _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_and_si256(a, b), _mm256_setzero_si256()),
+                            _mm256_set1_epi32(-1));
+}
+static inline LMask lv_mand(LMask a, LMask b)         { return _mm256_and_si256(a, b); }
+static inline uint32_t lv_bits(LMask m)
+{
+    // movemask gives two bits per 16-bit lane; keep one
+    __m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+    return (uint32_t)_mm_movemask_epi8(packed);
+}
+
+#else
+#define LANE_W    8
+#define LANE_ISA  "scalar"
+struct LVec { uint16_t v[LANE_W]; };
+typedef uint32_t LMask;
+
+static inline LVec lv_load(const uint16_t* p)    { LVec r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void lv_store(uint16_t* p, LVec a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline LVec lv_splat(uint16_t x)          { LVec r; for (int i = 0; i < LANE_W; ++i) r.v[i] = x; return r; }
+static inline LVec lv_add(LVec a, LVec b)        { for (int i = 0; i < LANE_W; ++i) a.v[i] += b.v[i]; return a; }
+static inline LVec lv_and(LVec a, LVec b)        { for (int i = 0; i < LANE_W; ++i) a.v[i] &= b.v[i]; return a; }
+static inline LVec lv_not(LVec a)                { for (int i = 0; i < LANE_W; ++i) a.v[i] = ~a.v[i]; return a; }
+static inline LVec lv_min(LVec a, LVec b)
+{
+    for (int i = 0; i < LANE_W; ++i) if (b.v[i] < a.v[i]) a.v[i] = b.v[i];
+    return a;
+}
+static inline LVec lv_select(LMask m, LVec a, LVec b)
+{
+    for (int i = 0; i < LANE_W; ++i) if (!(m >> i & 1)) a.v[i] = b.v[i];
+    return a;
+}
+static inline LMask lv_eq(LVec a, LVec b)
+{
+    LMask m = 0;
+    for (int i = 0; i < LANE_W; ++i) m |= (LMask)(a.v[i] == b.v[i]) << i;
+    return m;
+}
+static inline LMask lv_neg(LVec a)
+{
+    LMask m = 0;
+    for (int i = 0; i < LANE_W; ++i) m |= (LMask)(a.v[i] >> 15) << i;
+    return m;
+}
+static inline LMask lv_test(LVec a, LVec b)
+{
+    LMask m = 0;
+    for (int i = 0; i < LANE_W; ++i) m |= (LMask)((a.v[i] & b.v[i]) != 0) << i;
+    return m;
+}
+static inline LMask lv_mand(LMask a, LMask b) { return a & b; }
+static inline uint32_t lv_bits(LMask m)       { return m; }
+#endif
+
+static inline uint16_t lv_hmin(LVec a)
+{
+    uint16_t v[LANE_W];
+    lv_store(v, a);
+    uint16_t m = v[0];
+    for (int i = 1; i < LANE_W; ++i) if (v[i] < m) m = v[i];
+    return m;
+}
+
+// index of the lowest set bit; bits != 0
+static inline int lv_ctz(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, bits);
+    return (int)i;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+static inline int lv_popcount(uint32_t bits)
+{
+    int n = 0;
+    for (; bits; bits &= bits - 1) ++n;
+    return n;
+}
@@ -0,0 +1,368 @@
+#include "ring_buffer.hpp"
+#include "lc3_telemetry.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// g++ -std=c++17 -O2 latency_benchmark.cpp -o latency_benchmark -pthread
+// ./latency_benchmark > latency.csv
+// ./latency_benchmark --quick --wait yield --placement none
+//
+// Latency through the SPSC bus ring (RingBuffer, as used by the VM
+// channels). Every message carries the TSC of its send:
+//   oneway   - the producer pushes as fast as the ring takes it and the
+//              consumer records receive TSC - send TSC (queueing included)
+//   pingpong - a batch goes out on one ring and an echo thread sends it
+//              back on another; the sender records the round trip
+// swept over ring size, payload bytes, messages per push_bulk/pop_bulk,
+// core placement and how a thread waits on a full or empty ring. One CSV
+// row per case goes to stdout; anything that is not data goes to stderr.
+// One-way times assume the TSC is synchronised across cores (invariant
+// TSC); round trips are read on one core and do not.
+//
+// placement: none (unpinned), same (both on cpu 0), siblings (SMT sibling
+// of cpu 0, else cpu 1), spread (cpu 0 and the last cpu). "same" only runs
+// with wait=yield: a spinning thread would hold the core its peer needs.
+
+enum Mode { MODE_ONEWAY, MODE_PINGPONG };
+enum Placement { PLACE_NONE, PLACE_SAME, PLACE_SIBLINGS, PLACE_SPREAD };
+enum Wait { WAIT_SPIN, WAIT_PAUSE, WAIT_YIELD };
+
+static const char* mode_names[] = { "oneway", "pingpong" };
+static const char* placement_names[] = { "none", "same", "siblings", "spread" };
+static const char* wait_names[] = { "spin", "pause", "yield" };
+
+struct Case {
+    Mode mode;
+    size_t ring, payload, batch;
+    Placement placement;
+    Wait wait;
+    uint32_t msgs;
+};
+
+// payload bytes, the send TSC in the first word
+template<size_t Bytes>
+struct Msg {
+    static_assert(Bytes >= 8 && Bytes % 8 == 0, "payload is whole 64-bit words");
+    uint64_t words[Bytes / 8];
+};
+
+static double ticks_per_ns = 1.0;
+
+// the first tenth on top of the measured messages is not recorded
+static uint32_t with_warmup(uint32_t msgs) { return msgs + msgs / 10; }
+
+static void calibrate() {
+    auto w0 = std::chrono::steady_clock::now();
+    uint64_t t0 = tsc_now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t t1 = tsc_now();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - w0).count();
+    ticks_per_ns = ns > 0 ? (double)(t1 - t0) / ns : 1.0;
+}
+
+static inline void wait_once(Wait w) {
+    if (w == WAIT_PAUSE) {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    } else if (w == WAIT_YIELD) {
+        std::this_thread::yield();
+    }
+}
+
+// SMT sibling of cpu, or -1 when there is none (or it cannot be read)
+static int smt_sibling(int cpu) {
+#if defined(_WIN32)
+    (void)cpu;
+    return -1;
+#else
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char buf[64] = {};
+    fgets(buf, sizeof(buf), f);
+    fclose(f);
+    int a = -1, b = -1;
+    if (sscanf(buf, "%d%*[,-]%d", &a, &b) != 2) return -1;
+    return a == cpu ? b : a;
+#endif
+}
+
+// core < 0: any cpu
+static void pin_self(int core) {
+    int ncpu = (int)std::thread::hardware_concurrency();
+#if defined(_WIN32)
+    DWORD_PTR all = ncpu >= 64 ? ~(DWORD_PTR)0 : ((DWORD_PTR)1 << ncpu) - 1;
+    SetThreadAffinityMask(GetCurrentThread(), core < 0 ? all : (DWORD_PTR)1 << core);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < ncpu; ++c) {
+        if (core < 0 || c == core) CPU_SET(c, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// cores for the two threads, false when the machine cannot do the placement
+static bool cores_for(Placement p, int cores[2]) {
+    int ncpu = (int)std::thread::hardware_concurrency();
+    cores[0] = cores[1] = -1;
+    switch (p) {
+        case PLACE_NONE: return true;
+        case PLACE_SAME: cores[0] = cores[1] = 0; return true;
+        case PLACE_SIBLINGS: {
+            int sib = smt_sibling(0);
+            cores[0] = 0;
+            cores[1] = sib > 0 ? sib : 1;
+            return cores[1] < ncpu;
+        }
+        case PLACE_SPREAD: cores[0] = 0; cores[1] = ncpu - 1; return ncpu > 1;
+    }
+    return false;
+}
+
+template<typename Q, typename M>
+static void send_all(Q& q, const M* msgs, size_t n, Wait w) {
+    while (n) {
+        size_t done = q.push_bulk(msgs, n);
+        if (!done) wait_once(w);
+        msgs += done;
+        n -= done;
+    }
+}
+
+// both threads pinned and released together; returns the first one's time
+template<typename A, typename B>
+static double run_pair(const int cores[2], A first, B second) {
+    std::atomic<int> ready{ 0 };
+    double secs = 0;
+    std::thread peer([&] {
+        pin_self(cores[1]);
+        ready.fetch_add(1);
+        while (ready.load() < 2) std::this_thread::yield();
+        second();
+    });
+    pin_self(cores[0]);
+    ready.fetch_add(1);
+    while (ready.load() < 2) std::this_thread::yield();
+    auto t0 = std::chrono::steady_clock::now();
+    first();
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    peer.join();
+    pin_self(-1);
+    return secs;
+}
+
+template<size_t Bytes, size_t Size>
+static double one_way(const Case& c, const int cores[2], HdrHistogram& h) {
+    typedef Msg<Bytes> M;
+    std::unique_ptr<RingBuffer<M, Size>> q(new RingBuffer<M, Size>());
+    uint32_t total = with_warmup(c.msgs);
+    uint32_t warmup = total - c.msgs;
+    return run_pair(cores,
+        [&] {
+            std::vector<M> in(c.batch);
+            for (uint32_t got = 0; got < total; ) {
+                size_t k = q->pop_bulk(in.data(), c.batch);
+                if (!k) {
+                    wait_once(c.wait);
+                    continue;
+                }
+                uint64_t now = tsc_now();
+                for (size_t i = 0; i < k; ++i, ++got) {
+                    if (got >= warmup) h.record(now - in[i].words[0]);
+                }
+            }
+        },
+        [&] {
+            std::vector<M> out(c.batch);
+            for (uint32_t sent = 0; sent < total; ) {
+                size_t k = total - sent < c.batch ? total - sent : c.batch;
+                uint64_t now = tsc_now();
+                for (size_t i = 0; i < k; ++i) out[i].words[0] = now;
+                send_all(*q, out.data(), k, c.wait);
+                sent += (uint32_t)k;
+            }
+        });
+}
+
+template<size_t Bytes, size_t Size>
+static double ping_pong(const Case& c, const int cores[2], HdrHistogram& h) {
+    typedef Msg<Bytes> M;
+    std::unique_ptr<RingBuffer<M, Size>> to(new RingBuffer<M, Size>());
+    std::unique_ptr<RingBuffer<M, Size>> back(new RingBuffer<M, Size>());
+    uint32_t total = with_warmup(c.msgs);
+    uint32_t warmup = total - c.msgs;
+    return run_pair(cores,
+        [&] {
+            std::vector<M> buf(c.batch);
+            for (uint32_t done = 0; done < total; ) {
+                size_t k = total - done < c.batch ? total - done : c.batch;
+                uint64_t now = tsc_now();
+                for (size_t i = 0; i < k; ++i) buf[i].words[0] = now;
+                send_all(*to, buf.data(), k, c.wait);
+                for (size_t got = 0; got < k; ) {
+                    size_t n = back->pop_bulk(buf.data() + got, k - got);
+                    if (!n) wait_once(c.wait);
+                    got += n;
+                }
+                now = tsc_now();
+                for (size_t i = 0; i < k; ++i, ++done) {
+                    if (done >= warmup) h.record(now - buf[i].words[0]);
+                }
+            }
+        },
+        [&] {
+            std::vector<M> buf(c.batch);
+            for (uint32_t echoed = 0; echoed < total; ) {
+                size_t k = to->pop_bulk(buf.data(), c.batch);
+                if (!k) {
+                    wait_once(c.wait);
+                    continue;
+                }
+                send_all(*back, buf.data(), k, c.wait);
+                echoed += (uint32_t)k;
+            }
+        });
+}
+
+template<size_t Bytes, size_t Size>
+static double run_sized(const Case& c, const int cores[2], HdrHistogram& h) {
+    return c.mode == MODE_ONEWAY ? one_way<Bytes, Size>(c, cores, h) : ping_pong<Bytes, Size>(c, cores, h);
+}
+
+template<size_t Bytes>
+static double run_payload(const Case& c, const int cores[2], HdrHistogram& h) {
+    switch (c.ring) {
+        case 64:    return run_sized<Bytes, 64>(c, cores, h);
+        case 1024:  return run_sized<Bytes, 1024>(c, cores, h);
+        case 16384: return run_sized<Bytes, 16384>(c, cores, h);
+    }
+    return -1;
+}
+
+// seconds for all messages including warmup, or -1 for an unsupported ring/payload
+static double run_case(const Case& c, const int cores[2], HdrHistogram& h) {
+    switch (c.payload) {
+        case 8:   return run_payload<8>(c, cores, h);
+        case 16:  return run_payload<16>(c, cores, h);
+        case 64:  return run_payload<64>(c, cores, h);
+        case 256: return run_payload<256>(c, cores, h);
+    }
+    return -1;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "latency_benchmark [--quick] [--msgs N] [--mode oneway,pingpong] [--ring 64,1024,16384]\n"
+            "    [--payload 8,16,64,256] [--batch 1,8,32] [--placement none,same,siblings,spread]\n"
+            "    [--wait spin,pause,yield]\n");
+    exit(2);
+}
+
+static std::vector<size_t> parse_sizes(const char* arg) {
+    std::vector<size_t> out;
+    for (const char* p = arg; *p; ) {
+        char* end;
+        out.push_back(strtoull(p, &end, 10));
+        if (end == p) usage();
+        p = *end == ',' ? end + 1 : end;
+    }
+    return out;
+}
+
+static std::vector<int> parse_names(const char* arg, const char* const* names, int count) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t comma = s.find(',', start);
+        std::string name = s.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        int i = 0;
+        while (i < count && name != names[i]) ++i;
+        if (i == count) usage();
+        out.push_back(i);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return out;
+}
+
+int main(int argc, const char* argv[]) {
+    uint32_t msgs = 200000;
+    std::vector<int> modes = { MODE_ONEWAY, MODE_PINGPONG };
+    std::vector<size_t> rings = { 64, 1024, 16384 };
+    std::vector<size_t> payloads = { 8, 16, 64, 256 };
+    std::vector<size_t> batches = { 1, 8, 32 };
+    std::vector<int> placements = { PLACE_NONE, PLACE_SAME, PLACE_SIBLINGS, PLACE_SPREAD };
+    std::vector<int> waits = { WAIT_SPIN, WAIT_PAUSE, WAIT_YIELD };
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--quick")) {
+            msgs = 20000;
+            rings = { 1024 };
+            payloads = { 8, 64 };
+            batches = { 1, 32 };
+        }
+        else if (!strcmp(argv[i], "--msgs") && has_arg) msgs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--mode") && has_arg) modes = parse_names(argv[++i], mode_names, 2);
+        else if (!strcmp(argv[i], "--ring") && has_arg) rings = parse_sizes(argv[++i]);
+        else if (!strcmp(argv[i], "--payload") && has_arg) payloads = parse_sizes(argv[++i]);
+        else if (!strcmp(argv[i], "--batch") && has_arg) batches = parse_sizes(argv[++i]);
+        else if (!strcmp(argv[i], "--placement") && has_arg) placements = parse_names(argv[++i], placement_names, 4);
+        else if (!strcmp(argv[i], "--wait") && has_arg) waits = parse_names(argv[++i], wait_names, 3);
+        else usage();
+    }
+    if (!msgs) usage();
+    std::vector<int> usable;
+    for (int placement : placements) {
+        int cores[2];
+        if (cores_for((Placement)placement, cores)) usable.push_back(placement);
+        else fprintf(stderr, "skipping placement %s: not enough cpus\n", placement_names[placement]);
+    }
+
+    calibrate();
+    fprintf(stderr, "tsc: %.3f ticks/ns, %u cpus, %u messages per case\n", ticks_per_ns,
+            std::thread::hardware_concurrency(), msgs);
+    printf("mode,ring,payload,batch,placement,wait,msgs,p50_ns,p99_ns,p999_ns,max_ns,msgs_per_s\n");
+
+    for (int mode : modes)
+    for (size_t ring : rings)
+    for (size_t payload : payloads)
+    for (size_t batch : batches)
+    for (int placement : usable)
+    for (int wait : waits) {
+        Case c = { (Mode)mode, ring, payload, batch, (Placement)placement, (Wait)wait, msgs };
+        int cores[2];
+        if (!batch || batch >= ring) continue;
+        if (placement == PLACE_SAME && wait != WAIT_YIELD) continue;
+        cores_for(c.placement, cores);
+        HdrHistogram h;
+        double secs = run_case(c, cores, h);
+        if (secs < 0) {
+            fprintf(stderr, "unsupported ring %zu or payload %zu (rings 64, 1024, 16384; payloads 8, 16, 64, 256)\n",
+                    ring, payload);
+            exit(2);
+        }
+        auto ns = [](uint64_t ticks) { return ticks / ticks_per_ns; };
+        printf("%s,%zu,%zu,%zu,%s,%s,%llu,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+               mode_names[mode], ring, payload, batch, placement_names[placement], wait_names[wait],
+               (unsigned long long)h.count(), ns(h.percentile(50)), ns(h.percentile(99)),
+               ns(h.percentile(99.9)), ns(h.max()), secs > 0 ? with_warmup(msgs) / secs : 0.0);
+        fflush(stdout);
+    }
+}
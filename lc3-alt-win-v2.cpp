@@ -2,15 +2,19 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <chrono>
 #include <Windows.h>
-#include <conio.h>
 #include <thread>
 #include <atomic>
-#include "ring_buffer.hpp"
+#include <vector>
+#include <memory>
+#include "lc3_vm.hpp"
 
-RingBuffer<uint16_t, 1024> ring_bus; 
+// Channel IDs seen by TRAP x34/x35 (R1); x30-x33 always use CH_RING.
+enum { CH_RING = 0, CH_FANIN = 1, CH_BCAST = 2, CH_COUNT };
 HANDLE hStdin;
 DWORD fdwOldMode;
 
@@ -25,209 +29,112 @@ void disable_input_buffering() {
 void restore_input_buffering() {
     SetConsoleMode(hStdin, fdwOldMode);
 }
-class LC3VM {
-public:
-    uint16_t memory[1 << 16]{};
-    uint16_t reg[10]{};  // R0–R7, PC, COND
-    bool running = true;
-    uint64_t instr_count = 0;
-    uint64_t msg_send = 0;
-    uint64_t msg_recv = 0;
-    uint64_t recv_spin_total = 0;
-    const char* image_name;
 
-    void load_image(const char* path) {
-        image_name = path;
-        FILE* file = fopen(path, "rb");
-        if (!file) {
-            printf("failed to load image: %s\n", path);
-            exit(1);
-        }
-        uint16_t origin;
-        fread(&origin, sizeof(origin), 1, file);
-        origin = swap16(origin);
-        size_t max_read = (1 << 16) - origin;
-        fread(memory + origin, sizeof(uint16_t), max_read, file);
-        for (size_t i = 0; i < max_read; ++i) memory[origin + i] = swap16(memory[origin + i]);
-        fclose(file);
-        reg[8] = origin;  // R_PC
-    }
-
-    void run() {
-        disable_input_buffering();
-        signal(SIGINT, [](int) { restore_input_buffering(); exit(-2); });
-
-        auto start = std::chrono::high_resolution_clock::now();
-
-        while (running && instr_count < 50000) {
-            uint16_t instr = mem_read(reg[8]++);  // PC
-            uint16_t op = instr >> 12;
-            
-            // Debug output for TRAP x30
-            //if (op == 0xF && (instr & 0xFF) == 0x30) {
-            //    printf("[PROD R0=%d] PC=0x%04X\n", reg[0], reg[8]-1);
-            //}
-            
-            execute(op, instr);
-            ++instr_count;
-        }
-
-        auto end = std::chrono::high_resolution_clock::now();
-        double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
-
-        uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-        double ns_per_instr = static_cast<double>(elapsed_ns) / instr_count;
-        double mips = 1e3 * 1e6 / ns_per_instr; // or: 1e9 / ns_per_instr
-
-
-        printf("\n==== VM (%s) Metrics ====" "\n", image_name);
-        printf("Instructions: %llu\n", instr_count);
-        printf("ns/op              : %.2f ns\n", ns_per_instr);
-        printf("Throughput         : %.2f instr/s\n", mips);
-        printf("Messages Sent: %llu, Recv: %llu\n", msg_send, msg_recv);
-        printf("Recv spin iters: %llu\n", recv_spin_total);
-        printf("Msgs/sec: %.2f\n", 1000.0 * msg_recv / elapsed_ms);
-        double avg_spins_per_msg = msg_recv ? static_cast<double>(recv_spin_total) / msg_recv : 0;
-        double us_per_msg = msg_recv ? (elapsed_ms * 1000.0) / msg_recv : 0;
-
-        printf("Avg spins/msg      : %.2f\n", avg_spins_per_msg);
-        printf("Avg us/msg         : %.2f\n", us_per_msg);
-        printf("Elapsed time       : %.2f ms\n", elapsed_ms);
-
-        printf("=========================\n");
-
-        restore_input_buffering();
+// Re-runs one recorded VM alone: no channels, no other threads, no
+// waiting, so it runs as fast as the interpreter goes. The image defaults
+// to the one named in the trace.
+int replay_main(const char* trace_path, const char* image) {
+    TraceReader trace;
+    if (!trace.open(trace_path)) {
+        printf("failed to read trace: %s\n", trace_path);
+        return 1;
     }
+    LC3VM vm;
+    vm.trace_in = &trace;
+    vm.max_instr = trace.end_instr();
+    vm.load_image(image ? image : trace.image());
+    vm.run();
+    vm.report();
+
+    bool exact = !vm.diverged && vm.instr_count == trace.end_instr() && trace.taken() == trace.events()
+              && vm.state_hash() == trace.end_hash();
+    printf("Replay %s: %llu of %llu events, %llu of %llu instructions%s\n", trace_path,
+           (unsigned long long)trace.taken(), (unsigned long long)trace.events(),
+           (unsigned long long)vm.instr_count, (unsigned long long)trace.end_instr(),
+           exact ? ", state matches" : vm.diverged ? ", DIVERGED" : ", state differs");
+    return exact ? 0 : 1;
+}
 
-private:
-    uint16_t mem_read(uint16_t addr) {
-        if (addr == 0xFE00) memory[0xFE00] = (_kbhit() ? (1 << 15) : 0);
-        return memory[addr];
+// Main multi-threaded test harness
+// dual-vm [producer.obj consumer.obj], e.g. producer_bulk.obj consumer_bulk.obj
+// dual-vm --fan-in N  fanin_producer.obj  fanin_consumer.obj    (N producers, 1 consumer)
+// dual-vm --fan-out N fanout_producer.obj fanout_consumer.obj   (1 producer, N consumers)
+// dual-vm --record PREFIX ...   also writes PREFIX.<vm>.lc3r for every VM
+// dual-vm --replay PREFIX.<vm>.lc3r [image.obj]
+int main(int argc, const char* argv[]) {
+    int producers = 1, consumers = 1, channel = CH_RING;
+    int a = 1;
+    const char* record = nullptr;
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) return replay_main(argv[2], argc > 3 ? argv[3] : nullptr);
+    if (argc > 2 && strcmp(argv[1], "--record") == 0) {
+        record = argv[2];
+        a = 3;
     }
-
-    void mem_write(uint16_t addr, uint16_t val) {
-        memory[addr] = val;
+    if (argc > a + 2 && strcmp(argv[a], "--fan-in") == 0) {
+        producers = atoi(argv[a + 1]);
+        channel = CH_FANIN;
+        a += 2;
+    } else if (argc > a + 2 && strcmp(argv[a], "--fan-out") == 0) {
+        consumers = atoi(argv[a + 1]);
+        channel = CH_BCAST;
+        a += 2;
     }
-
-    void update_flags(uint16_t r) {
-        if (reg[r] == 0) reg[9] = 0x2;
-        else if (reg[r] >> 15) reg[9] = 0x4;
-        else reg[9] = 0x1;
+    const char* producer = argc > a + 1 ? argv[a] : "producer.obj";
+    const char* consumer = argc > a + 1 ? argv[a + 1] : "consumer.obj";
+    bool fanned = channel != CH_RING;
+
+    Channel* channels[CH_COUNT] = {
+        make_channel(CH_SPSC, 1024),      // ring_bus
+        make_channel(CH_MPMC, 1024),      // many producer VMs -> any consumer VM
+        make_channel(CH_BROADCAST, 1024), // one producer VM -> every consumer VM
+    };
+    channels[channel]->senders = producers;
+
+    disable_input_buffering();
+    signal(SIGINT, [](int) { restore_input_buffering(); exit(-2); });
+
+    std::vector<std::unique_ptr<LC3VM>> vms;
+    for (int i = 0; i < producers + consumers; ++i) {
+        bool is_producer = i < producers;
+        vms.emplace_back(new LC3VM());
+        LC3VM& vm = *vms.back();
+        for (int id = 0; id < CH_COUNT; ++id) vm.attach(id, channels[id]);
+        // the sample producers never halt: they (and a single consumer) stop after
+        // 50000 instructions; fanned consumers run until their channel is closed and drained
+        if (is_producer || !fanned) vm.max_instr = 50000;
+        vm.load_image(is_producer ? producer : consumer);
     }
 
-    void execute(uint16_t op, uint16_t instr) {
-        switch (op) {
-            case 0x0: { // BR
-                uint16_t cond = (instr >> 9) & 0x7;
-                uint16_t offset = sign_extend(instr & 0x1FF, 9);
-                bool should_branch = false;
-                
-                if (cond == 0) should_branch = true;  // BR
-                else if (cond == 1) should_branch = (reg[9] & 0x1);  // BRP
-                else if (cond == 2) should_branch = (reg[9] & 0x2);  // BRZ
-                else if (cond == 3) should_branch = (reg[9] & 0x1) || (reg[9] & 0x2);  // BRZP
-                else if (cond == 4) should_branch = (reg[9] & 0x4);  // BRN
-                else if (cond == 5) should_branch = (reg[9] & 0x4) || (reg[9] & 0x1);  // BRNP
-                else if (cond == 6) should_branch = (reg[9] & 0x4) || (reg[9] & 0x2);  // BRNZ
-                else if (cond == 7) should_branch = true;  // BRNZP
-                
-                if (should_branch) {
-                    reg[8] += offset;
-                }
-                break;
-            }
-            case 0x1: { // ADD
-                uint16_t dr = (instr >> 9) & 0x7;
-                uint16_t sr1 = (instr >> 6) & 0x7;
-                if ((instr >> 5) & 1) reg[dr] = reg[sr1] + sign_extend(instr & 0x1F, 5);
-                else reg[dr] = reg[sr1] + reg[instr & 0x7];
-                update_flags(dr);
-                break;
-            }
-            case 0x2: { // LD
-                uint16_t dr = (instr >> 9) & 0x7;
-                reg[dr] = mem_read(reg[8] + sign_extend(instr & 0x1FF, 9));
-                update_flags(dr);
-                break;
-            }
-            case 0x3: { // ST
-                uint16_t sr = (instr >> 9) & 0x7;
-                mem_write(reg[8] + sign_extend(instr & 0x1FF, 9), reg[sr]);
-                break;
-            }
-            case 0x4: { // JSR
-                reg[7] = reg[8];
-                reg[8] += sign_extend(instr & 0x7FF, 11);
-                break;
-            }
-            case 0x5: { // AND
-                uint16_t dr = (instr >> 9) & 0x7;
-                uint16_t sr1 = (instr >> 6) & 0x7;
-                if ((instr >> 5) & 1) reg[dr] = reg[sr1] & sign_extend(instr & 0x1F, 5);
-                else reg[dr] = reg[sr1] & reg[instr & 0x7];
-                update_flags(dr);
-                break;
-            }
-            case 0x9: { // NOT
-                uint16_t dr = (instr >> 9) & 0x7;
-                reg[dr] = ~reg[(instr >> 6) & 0x7];
-                update_flags(dr);
-                break;
-            }
-            case 0xC: { // JMP
-                reg[8] = reg[(instr >> 6) & 0x7];
-                break;
-            }
-            case 0xF: { // TRAP
-                uint8_t trap = instr & 0xFF;
-                switch (trap) {
-                    case 0x21: putchar(reg[0]); fflush(stdout); break;
-                    case 0x22: putchar('\n'); fflush(stdout); break;
-                    case 0x25: running = false; break;
-                    case 0x30:  // SEND
-                        //printf("[producer] SEND: %d\n", reg[0]);  // 🔍 DEBUG LINE
-                        while (!ring_bus.push(reg[0])) {};
-                        ++msg_send;
-                        break;
-                    case 0x31: { // RECV
-                        uint16_t val;
-                        while (!ring_bus.pop(val)) ++recv_spin_total;
-                        reg[0] = val;
-                        //printf("[consumer] RECV: %d\n", val);  // 🔍 DEBUG LINE
-                        ++msg_recv;
-                        update_flags(0);
-                        break;
-                    }
-                }
-                break;
-            }
+    std::vector<std::unique_ptr<TraceWriter>> traces;
+    for (int i = 0; record && i < producers + consumers; ++i) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s.%d.lc3r", record, i);
+        traces.emplace_back(new TraceWriter());
+        if (!traces.back()->open(path, vms[i]->image_name)) {
+            printf("failed to open trace: %s\n", path);
+            return 1;
         }
+        vms[i]->trace_out = traces.back().get();
     }
 
-    static uint16_t swap16(uint16_t x) { return (x << 8) | (x >> 8); }
-    static uint16_t sign_extend(uint16_t x, int bit_count) {
-        if ((x >> (bit_count - 1)) & 1) x |= (0xFFFF << bit_count);
-        return x;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers + consumers; ++i) {
+        bool is_producer = i < producers;
+        LC3VM* vm = vms[i].get();
+        Channel* ch = channels[channel];
+        threads.emplace_back([vm, ch, is_producer] {
+            vm->run();
+            if (is_producer) ch->sender_done();
+        });
     }
-};
-
-// Windows-specific input buffering controls
-
-
-// Main multi-threaded test harness
-int main() {
-    std::thread vm1([] {
-        LC3VM vm;
-        vm.load_image("producer.obj");
-        vm.run();
-    });
-
-    std::thread vm2([] {
-        LC3VM vm;
-        vm.load_image("consumer.obj");
-        vm.run();
-    });
-
-    vm1.join();
-    vm2.join();
+    for (auto& t : threads) t.join();
+
+    for (auto& vm : vms) vm->report();
+    for (size_t i = 0; i < traces.size(); ++i) {
+        bool ok = traces[i]->finish(vms[i]->instr_count, vms[i]->state_hash());
+        printf("Trace %s.%zu.lc3r: %llu events, %llu bytes%s\n", record, i,
+               (unsigned long long)traces[i]->events(), (unsigned long long)traces[i]->size(),
+               ok ? "" : " (write failed)");
+    }
+    restore_input_buffering();
 }
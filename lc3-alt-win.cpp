@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <signal.h>
 #include <chrono>
 /* windows only */
 #include <Windows.h>
 #include <conio.h>  // _kbhit
+#include "lc3_devices.hpp"
+#include "lc3_console.hpp"
+#include "lc3_telemetry.hpp"
 
 enum
 {
@@ -46,11 +50,6 @@ enum
     OP_TRAP    /* execute trap */
 };
 
-enum
-{
-    MR_KBSR = 0xFE00, /* keyboard status */
-    MR_KBDR = 0xFE02  /* keyboard data */
-};
 enum
 {
     TRAP_GETC = 0x20,  /* get character from keyboard, not echoed onto the terminal */
@@ -85,16 +84,40 @@ void restore_input_buffering()
     SetConsoleMode(hStdin, fdwOldMode);
 }
 
-uint16_t check_key()
-{
-    return WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit();
-}
 void handle_interrupt(int signal)
 {
     restore_input_buffering();
     printf("\n");
     exit(-2);
 }
+
+/* console I/O goes through rings serviced by the I/O thread
+   (lc3_console.hpp); the traps and the keyboard/display registers only
+   touch the rings */
+static Console console;
+
+static void console_puts(const char* s)
+{
+    console.write(s, strlen(s));
+}
+
+/* memory-mapped devices (lc3_devices.hpp): keyboard and display on page
+   xFE; every other page is plain RAM and never reaches the bus */
+static DeviceBus       devices;
+static ConsoleKeyboard keyboard(console);
+static ConsoleDisplay  display(console);
+
+static void devices_init()
+{
+    keyboard.map_on(devices);
+    display.map_on(devices);
+}
+
+static uint16_t device_read(uint16_t address)
+{
+    Lc3Device* dev = devices.at(address);
+    return dev ? dev->read(address) : memory[address];
+}
 uint16_t sign_extend(uint16_t x, int bit_count)
 {
     if ((x >> (bit_count - 1)) & 1) {
@@ -121,6 +144,21 @@ void update_flags(uint16_t r)
         reg[R_COND] = FL_POS;
     }
 }
+/* .lc3i images (lc3_image.hpp): the file stays mapped and its words are
+   copied into memory; its pre-decoded records and block entries are used
+   for every word that still holds its original value */
+#include "lc3_image.hpp"
+enum { DECODE_VERSION = 2 };              /* bump when the K_* numbering changes */
+static const Lc3Image* loaded_image = NULL;
+static uint32_t image_lo = MEMORY_MAX;    /* extent of everything loaded, for --convert */
+static uint32_t image_hi = 0;
+
+static void note_extent(uint16_t origin, size_t words)
+{
+    if (origin < image_lo) { image_lo = origin; }
+    if (origin + words > image_hi) { image_hi = (uint32_t)(origin + words); }
+}
+
 void read_image_file(FILE* file)
 {
     /* the origin tells us where in memory to place the image */
@@ -132,6 +170,7 @@ void read_image_file(FILE* file)
     uint16_t max_read = MEMORY_MAX - origin;
     uint16_t* p = memory + origin;
     size_t read = fread(p, sizeof(uint16_t), max_read, file);
+    note_extent(origin, read);
 
     /* swap to little endian */
     while (read-- > 0)
@@ -142,268 +181,2256 @@ void read_image_file(FILE* file)
 }
 int read_image(const char* image_path)
 {
+    size_t len = strlen(image_path);
+    if (len > 5 && strcmp(image_path + len - 5, ".lc3i") == 0)
+    {
+        const Lc3Image* img = lc3_image_open(image_path);
+        if (!img) { return 0; }
+        memcpy(memory + img->origin, img->memory + img->origin, img->words * sizeof(uint16_t));
+        note_extent(img->origin, img->words);
+        if (img->decode_version == DECODE_VERSION) { loaded_image = img; }
+        return 1;
+    }
     FILE* file = fopen(image_path, "rb");
     if (!file) { return 0; };
     read_image_file(file);
     fclose(file);
     return 1;
 }
-void mem_write(uint16_t address, uint16_t val)
+/* pre-decoded instruction stream (threaded engine)
+   one entry per memory word; operands are extracted and offsets are
+   sign-extended / resolved to absolute addresses once, at decode time */
+enum
+{
+    K_STALE = 0, /* not decoded yet, or overwritten since */
+    K_NOP,       /* BR with no condition bits */
+    K_BR,
+    K_BRA,       /* BRnzp: unconditional */
+    K_ADD_R,
+    K_ADD_I,
+    K_AND_R,
+    K_AND_I,
+    K_NOT,
+    K_LD,        /* LD from plain RAM */
+    K_LD_IO,     /* LD from a device page, must go through mem_read */
+    K_LDI,
+    K_LDR,
+    K_LEA,
+    K_ST,        /* ST to plain RAM */
+    K_ST_IO,     /* ST to a device page, must go through mem_write */
+    K_STI,
+    K_STR,
+    K_JMP,
+    K_JSR,
+    K_JSRR,
+    K_TRAP,
+    K_BAD,       /* RTI / reserved */
+    K_WRAP,      /* sentinel past the last word: PC wraps to 0 */
+
+    /* superinstructions (threaded engine, --superinstr): the entry of the
+       first instruction runs the whole group; the following entries keep
+       their own decode so jumps into the middle still work */
+    K_ADD_BR,     /* ADD ; BR */
+    K_ADD_ADD_BR, /* ADD ; ADD ; BR */
+    K_ADD_ADD,    /* ADD ; ADD */
+    K_LD_ADD,     /* LD ; ADD */
+    K_AND_ADD,    /* AND ; ADD */
+    K_COUNT,
+    K_FUSED_FIRST = K_ADD_BR
+};
+
+static const char* kind_names[K_COUNT] = {
+    "STALE", "NOP", "BR", "BRnzp", "ADD", "ADDi", "AND", "ANDi", "NOT",
+    "LD", "LD(io)", "LDI", "LDR", "LEA", "ST", "ST(io)", "STI", "STR", "JMP", "JSR",
+    "JSRR", "TRAP", "BAD", "WRAP",
+    "ADD+BR", "ADD+ADD+BR", "ADD+ADD", "LD+ADD", "AND+ADD"
+};
+
+struct Decoded
+{
+    const void* handler; /* label of the kind's handler (computed goto) */
+    uint16_t imm;        /* imm5, absolute pc+offset, trap vector or BR mask */
+    uint8_t  r0;         /* DR / SR */
+    uint8_t  r1;         /* SR1 / BaseR */
+    uint8_t  r2;         /* SR2 */
+    uint8_t  kind;       /* what the handler executes (may be a superinstruction) */
+    uint8_t  base;       /* this word's own kind, never fused */
+};
+
+static Decoded decoded[MEMORY_MAX + 1];   /* +1 for the K_WRAP sentinel */
+static const void* threaded_handlers[K_COUNT];
+static int fuse_enabled = 0;              /* --superinstr */
+
+Decoded decode(uint16_t pc, uint16_t instr)
+{
+    Decoded d = {};
+    uint16_t next = pc + 1;
+    d.r0 = (instr >> 9) & 0x7;
+    d.r1 = (instr >> 6) & 0x7;
+    d.r2 = instr & 0x7;
+
+    switch (instr >> 12)
+    {
+        case OP_BR:
+            /* r0 holds the n/z/p mask, same bit layout as R_COND */
+            d.imm  = next + sign_extend(instr & 0x1FF, 9);
+            d.kind = d.r0 == 0 ? K_NOP : d.r0 == 0x7 ? K_BRA : K_BR;
+            break;
+        case OP_ADD:
+        case OP_AND:
+            if ((instr >> 5) & 0x1)
+            {
+                d.imm  = sign_extend(instr & 0x1F, 5);
+                d.kind = (instr >> 12) == OP_ADD ? K_ADD_I : K_AND_I;
+            }
+            else
+            {
+                d.kind = (instr >> 12) == OP_ADD ? K_ADD_R : K_AND_R;
+            }
+            break;
+        case OP_NOT: d.kind = K_NOT; break;
+        case OP_LD:
+            d.imm  = next + sign_extend(instr & 0x1FF, 9);
+            d.kind = devices.io_page(d.imm) ? K_LD_IO : K_LD;
+            break;
+        case OP_LDI: d.imm = next + sign_extend(instr & 0x1FF, 9); d.kind = K_LDI; break;
+        case OP_LEA: d.imm = next + sign_extend(instr & 0x1FF, 9); d.kind = K_LEA; break;
+        case OP_ST:
+            d.imm  = next + sign_extend(instr & 0x1FF, 9);
+            d.kind = devices.io_page(d.imm) ? K_ST_IO : K_ST;
+            break;
+        case OP_STI: d.imm = next + sign_extend(instr & 0x1FF, 9); d.kind = K_STI; break;
+        case OP_LDR: d.imm = sign_extend(instr & 0x3F, 6); d.kind = K_LDR; break;
+        case OP_STR: d.imm = sign_extend(instr & 0x3F, 6); d.kind = K_STR; break;
+        case OP_JMP: d.kind = K_JMP; break;
+        case OP_JSR:
+            if ((instr >> 11) & 1)
+            {
+                d.imm  = next + sign_extend(instr & 0x7FF, 11);
+                d.kind = K_JSR;
+            }
+            else
+            {
+                d.kind = K_JSRR;
+            }
+            break;
+        case OP_TRAP: d.imm = instr & 0xFF; d.kind = K_TRAP; break;
+        default:      d.kind = K_BAD; break;
+    }
+    d.base    = d.kind;
+    d.handler = threaded_handlers[d.kind];
+    return d;
+}
+
+/* decode(), or the image's pre-decoded record while the word is unchanged */
+Decoded decode_at(uint16_t pc)
+{
+    const Lc3ImageOp* op = loaded_image ? loaded_image->op(pc) : NULL;
+    if (!op || memory[pc] != loaded_image->memory[pc]) { return decode(pc, memory[pc]); }
+    Decoded d = {};
+    d.imm     = op->imm;
+    d.r0      = op->r0;
+    d.r1      = op->r1;
+    d.r2      = op->r2;
+    d.kind    = op->kind;
+    d.base    = op->kind;
+    d.handler = threaded_handlers[d.kind];
+    return d;
+}
+
+static int is_add(const Decoded& d) { return d.base == K_ADD_R || d.base == K_ADD_I; }
+static int is_and(const Decoded& d) { return d.base == K_AND_R || d.base == K_AND_I; }
+static int is_br(const Decoded& d)  { return d.base == K_BR || d.base == K_BRA; }
+
+/* pick the longest superinstruction starting at pc; the pattern set comes
+   from the --profile opcode-pair/triple counts of our workloads */
+void fuse_at(uint16_t pc)
+{
+    Decoded* d = &decoded[pc];
+    if (!fuse_enabled || pc > MEMORY_MAX - 3) { return; }
+    for (int i = 1; i <= 2; ++i)
+    {
+        if (d[i].kind == K_STALE) { d[i] = decode_at(pc + i); }
+    }
+
+    uint8_t kind = d->base;
+    if (is_add(*d) && is_add(d[1]) && is_br(d[2])) { kind = K_ADD_ADD_BR; }
+    else if (is_add(*d) && is_br(d[1]))            { kind = K_ADD_BR; }
+    else if (is_add(*d) && is_add(d[1]))           { kind = K_ADD_ADD; }
+    else if (d->base == K_LD && is_add(d[1]))      { kind = K_LD_ADD; }
+    else if (is_and(*d) && is_add(d[1]))           { kind = K_AND_ADD; }
+    d->kind    = kind;
+    d->handler = threaded_handlers[kind];
+}
+
+void predecode_all()
+{
+    for (uint32_t a = 0; a < MEMORY_MAX; ++a)
+    {
+        decoded[a] = decode_at((uint16_t)a);
+    }
+    decoded[MEMORY_MAX].kind    = K_WRAP;
+    decoded[MEMORY_MAX].base    = K_WRAP;
+    decoded[MEMORY_MAX].handler = threaded_handlers[K_WRAP];
+    for (uint32_t a = 0; a < MEMORY_MAX; ++a)
+    {
+        fuse_at((uint16_t)a);
+    }
+}
+
+/* basic-block cache bookkeeping: a bit per word that some cached block
+   covers, and a generation per 256-word page that is bumped when one of
+   those words is overwritten (stale blocks are rebuilt on next entry) */
+#define BLOCK_PAGE_SHIFT 8
+static uint8_t  code_bits[MEMORY_MAX / 8];
+static uint32_t page_gen[MEMORY_MAX >> BLOCK_PAGE_SHIFT];
+static int      block_invalidated = 0;
+static uint32_t code_gen_total    = 0; /* sum of all page_gen bumps and block cache flushes */
+
+/* words covered by ahead-of-time translated blocks (--aot) */
+static uint8_t aot_bits[MEMORY_MAX / 8];
+static int     aot_invalidated = 0;
+static void    aot_drop(uint16_t address);
+
+/* store to RAM: K_ST, whose page was checked at decode time */
+void ram_write(uint16_t address, uint16_t val)
 {
     memory[address] = val;
+    /* self-modifying code: re-decode lazily the next time it is executed,
+       together with the two words before it, which may have fused it */
+    for (int i = 0; i < 3; ++i)
+    {
+        decoded[(uint16_t)(address - i)].kind    = K_STALE;
+        decoded[(uint16_t)(address - i)].handler = threaded_handlers[K_STALE];
+    }
+    if (code_bits[address >> 3] & (1 << (address & 7)))
+    {
+        ++page_gen[address >> BLOCK_PAGE_SHIFT];
+        ++code_gen_total;
+        block_invalidated = 1;
+    }
+    if (aot_bits[address >> 3] & (1 << (address & 7)))
+    {
+        aot_drop(address);
+    }
 }
 
-uint16_t mem_read(uint16_t address)
+void mem_write(uint16_t address, uint16_t val)
 {
-    if (address == MR_KBSR)
+    if (devices.io_page(address))
     {
-        if (check_key())
-        {
-            memory[MR_KBSR] = (1 << 15);
-            memory[MR_KBDR] = getchar();
-        }
-        else
+        if (Lc3Device* dev = devices.at(address))
         {
-            memory[MR_KBSR] = 0;
+            dev->write(address, val);
+            return;
         }
     }
+    ram_write(address, val);
+}
+
+uint16_t mem_read(uint16_t address)
+{
+    if (devices.io_page(address))
+    {
+        return device_read(address);
+    }
     return memory[address];
 }
 
 int running = 1;
+int halt_quiet = 0; /* --batch: lanes halt without printing */
+
+/* --telemetry (lc3_telemetry.hpp, only with -DLC3_TELEMETRY=1): every
+   engine counts instructions per slice and traps here; per-opcode counts
+   come from the table engine */
+#if LC3_TELEMETRY
+static VmCounters vm_counters;
+#endif
+/* the instruction set itself is Lc3Core (lc3_core.hpp); the table
+   engine, the single steps of the JIT and the TRAPs of every engine run
+   on it through these policies: fetches straight from memory, loads and
+   stores through the device bus, console traps, per-opcode telemetry */
+#include "lc3_core.hpp"
+
+struct GlobalMemory
+{
+    static constexpr bool stalls = false;
+    uint16_t fetch(uint16_t address) { return memory[address]; }
+    uint16_t read(uint16_t address) { return mem_read(address); }
+    void     write(uint16_t address, uint16_t val) { mem_write(address, val); }
+};
+
+struct ConsoleTraps
+{
+    bool trap(uint16_t*, uint8_t vector)
+    {
+        switch (vector)
+        {
+            case TRAP_GETC:
+                /* read a single ASCII char, parking until one arrives */
+                reg[R_R0] = (uint16_t)console.getc();
+                update_flags(R_R0);
+                break;
+            case TRAP_OUT:
+                console.putc((char)reg[R_R0]);
+                break;
+            case TRAP_PUTS:
+                {
+                    /* one char per word */
+                    uint16_t* c = memory + reg[R_R0];
+                    while (*c)
+                    {
+                        console.putc((char)*c);
+                        ++c;
+                    }
+                }
+                break;
+            case TRAP_IN:
+                {
+                    console_puts("Enter a character: ");
+                    int c = console.getc();
+                    console.putc((char)c);
+                    reg[R_R0] = (uint16_t)c;
+                    update_flags(R_R0);
+                }
+                break;
+            case TRAP_PUTSP:
+                {
+                    /* one char per byte (two bytes per word)
+                       here we need to swap back to
+                       big endian format */
+                    uint16_t* c = memory + reg[R_R0];
+                    while (*c)
+                    {
+                        char char1 = (*c) & 0xFF;
+                        console.putc(char1);
+                        char char2 = (*c) >> 8;
+                        if (char2) console.putc(char2);
+                        ++c;
+                    }
+                }
+                break;
+            case TRAP_HALT:
+                if (!halt_quiet)
+                {
+                    console_puts("HALT\n");
+                }
+                running = 0;
+                break;
+        }
+        return true;
+    }
+};
+
+struct TableHooks
+{
+    static constexpr bool interrupts = false;
+    void retire(uint16_t op) { (void)op; LC3_COUNT(vm_counters, op[op], 1); } /* op unused without LC3_TELEMETRY */
+    void trap(uint8_t) { LC3_COUNT(vm_counters, traps, 1); }
+    /* RTI and the reserved opcode; PC is back on it, as the other engines leave it */
+    void illegal(uint16_t instr)
+    {
+        printf("illegal opcode x%X at x%04X\n", instr >> 12, (unsigned)reg[R_PC]);
+        running = 0;
+    }
+};
+
+static Lc3Core<GlobalMemory, ConsoleTraps, EagerFlags, TableHooks> core(reg);
+static Lc3Core<GlobalMemory, ConsoleTraps, LazyFlags, TableHooks>  core_lazy(reg); /* --lazy-flags */
+
+/* one decoded opcode, for engines that only fall back to the
+   interpreter for some instructions (TRAPs, side exits) */
 template <unsigned op>
 void ins(uint16_t instr)
 {
-    uint16_t r0, r1, r2, imm5, imm_flag;
-    uint16_t pc_plus_off, base_plus_off;
+    core.exec<op>(instr);
+}
+
+/* table engine: fetch straight from memory (never a device register),
+   one switch over the core's opcodes */
+static int lazy_flags = 0;
+
+uint64_t run_table(uint64_t budget)
+{
+    return lazy_flags ? core_lazy.run(budget, running) : core.run(budget, running);
+}
+
+/* lazy condition codes (--lazy-flags): flag-setting instructions only
+   record their result; N/Z/P is worked out when a BR tests it, or when
+   the engine hands control back */
+
+static inline uint16_t cond_of(uint16_t v)
+{
+    return (uint16_t)(FL_POS << ((v == 0) + 2 * (v >> 15)));
+}
+static inline uint16_t cond_value(uint16_t cond)
+{
+    return cond == FL_ZRO ? 0 : cond == FL_NEG ? 0x8000 : 1;
+}
+static inline uint16_t alu_add(const Decoded* d)
+{
+    return reg[d->r1] + (d->base == K_ADD_I ? d->imm : reg[d->r2]);
+}
+static inline uint16_t alu_and(const Decoded* d)
+{
+    return reg[d->r1] & (d->base == K_AND_I ? d->imm : reg[d->r2]);
+}
+
+/* threaded engine: runs the pre-decoded stream, each handler jumps
+   straight to the next one (computed goto on GCC/Clang, a switch
+   elsewhere). The budget is only checked on taken control flow. */
+#if defined(__GNUC__)
+#define TARGET(k)  L_##k:
+#define DISPATCH() goto *ip->handler
+#else
+#define TARGET(k)  case k:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()     do { ++n; ++ip; DISPATCH(); } while (0)
+#define JUMP(t)    do { ++n; ip = decoded + (t); if (n >= budget) goto leave; DISPATCH(); } while (0)
+#define SETCC(r)   do { if (Lazy) { cc = reg[r]; } else { update_flags(r); } } while (0)
+#define COND()     (Lazy ? cond_of(cc) : reg[R_COND])
 
-    constexpr uint16_t opbit = (1 << op);
-    if (0x4EEE & opbit) { r0 = (instr >> 9) & 0x7; }
-    if (0x12F3 & opbit) { r1 = (instr >> 6) & 0x7; }
-    if (0x0022 & opbit)
+template <bool Lazy>
+uint64_t run_threaded_impl(uint64_t budget)
+{
+#if defined(__GNUC__)
+    static const void* const labels[K_COUNT] = {
+        &&L_K_STALE, &&L_K_NOP,   &&L_K_BR,    &&L_K_BRA,
+        &&L_K_ADD_R, &&L_K_ADD_I, &&L_K_AND_R, &&L_K_AND_I,
+        &&L_K_NOT,   &&L_K_LD,    &&L_K_LD_IO, &&L_K_LDI,
+        &&L_K_LDR,   &&L_K_LEA,   &&L_K_ST,    &&L_K_ST_IO,
+        &&L_K_STI,   &&L_K_STR,   &&L_K_JMP,   &&L_K_JSR,
+        &&L_K_JSRR,  &&L_K_TRAP,  &&L_K_BAD,   &&L_K_WRAP,
+        &&L_K_ADD_BR, &&L_K_ADD_ADD_BR, &&L_K_ADD_ADD, &&L_K_LD_ADD, &&L_K_AND_ADD
+    };
+    /* the decoded stream holds this instantiation's labels, rebind if needed */
+    if (threaded_handlers[K_STALE] != labels[K_STALE])
+    {
+        for (int k = 0; k < K_COUNT; ++k) { threaded_handlers[k] = labels[k]; }
+        predecode_all();
+    }
+#else
+    static bool bound = false;
+    if (!bound)
     {
-        imm_flag = (instr >> 5) & 0x1;
+        predecode_all();
+        bound = true;
+    }
+#endif
 
-        if (imm_flag)
-        {
-            imm5 = sign_extend(instr & 0x1F, 5);
-        }
-        else
-        {
-            r2 = instr & 0x7;
-        }
+    uint64_t n  = 0;
+    Decoded* ip = decoded + reg[R_PC];
+    uint16_t cc = cond_value(reg[R_COND]);
+    if (!running) { return 0; }
+    DISPATCH();
+
+#if !defined(__GNUC__)
+dispatch:
+    switch (ip->kind)
+    {
+#endif
+    TARGET(K_STALE)
+    {
+        uint16_t pc = (uint16_t)(ip - decoded);
+        *ip = decode_at(pc);
+        fuse_at(pc);
+        DISPATCH();
     }
-    if (0x00C0 & opbit)
-    {   // Base + offset
-        base_plus_off = reg[r1] + sign_extend(instr & 0x3F, 6);
+    TARGET(K_NOP)   { NEXT(); }
+    TARGET(K_BR)
+    {
+        if (ip->r0 & COND()) { JUMP(ip->imm); }
+        NEXT();
     }
-    if (0x4C0D & opbit)
+    TARGET(K_BRA)   { JUMP(ip->imm); }
+    TARGET(K_ADD_R) { reg[ip->r0] = reg[ip->r1] + reg[ip->r2]; SETCC(ip->r0); NEXT(); }
+    TARGET(K_ADD_I) { reg[ip->r0] = reg[ip->r1] + ip->imm;     SETCC(ip->r0); NEXT(); }
+    TARGET(K_AND_R) { reg[ip->r0] = reg[ip->r1] & reg[ip->r2]; SETCC(ip->r0); NEXT(); }
+    TARGET(K_AND_I) { reg[ip->r0] = reg[ip->r1] & ip->imm;     SETCC(ip->r0); NEXT(); }
+    TARGET(K_NOT)   { reg[ip->r0] = ~reg[ip->r1];              SETCC(ip->r0); NEXT(); }
+    TARGET(K_LD)    { reg[ip->r0] = memory[ip->imm];           SETCC(ip->r0); NEXT(); }
+    TARGET(K_LD_IO) { reg[ip->r0] = mem_read(ip->imm);         SETCC(ip->r0); NEXT(); }
+    TARGET(K_LDI)   { reg[ip->r0] = mem_read(mem_read(ip->imm)); SETCC(ip->r0); NEXT(); }
+    TARGET(K_LDR)   { reg[ip->r0] = mem_read(reg[ip->r1] + ip->imm); SETCC(ip->r0); NEXT(); }
+    TARGET(K_LEA)   { reg[ip->r0] = ip->imm;                   SETCC(ip->r0); NEXT(); }
+    TARGET(K_ST)    { ram_write(ip->imm, reg[ip->r0]); NEXT(); }
+    TARGET(K_ST_IO) { mem_write(ip->imm, reg[ip->r0]); NEXT(); }
+    TARGET(K_STI)   { mem_write(mem_read(ip->imm), reg[ip->r0]); NEXT(); }
+    TARGET(K_STR)   { mem_write(reg[ip->r1] + ip->imm, reg[ip->r0]); NEXT(); }
+    TARGET(K_JMP)   { JUMP(reg[ip->r1]); }
+    TARGET(K_JSR)
     {
-        // Indirect address
-        pc_plus_off = reg[R_PC] + sign_extend(instr & 0x1FF, 9);
+        reg[R_R7] = (uint16_t)(ip - decoded + 1);
+        JUMP(ip->imm);
     }
-    if (0x0001 & opbit)
+    TARGET(K_JSRR)
     {
-        // BR
-        uint16_t cond = (instr >> 9) & 0x7;
-        if (cond & reg[R_COND]) { reg[R_PC] = pc_plus_off; }
+        uint16_t target = reg[ip->r1];
+        reg[R_R7] = (uint16_t)(ip - decoded + 1);
+        JUMP(target);
     }
-    if (0x0002 & opbit)  // ADD
+    TARGET(K_TRAP)
     {
-        if (imm_flag)
-        {
-            reg[r0] = reg[r1] + imm5;
-        }
-        else
-        {
-            reg[r0] = reg[r1] + reg[r2];
-        }
+        reg[R_PC] = (uint16_t)(ip - decoded + 1);
+        if (Lazy) { reg[R_COND] = cond_of(cc); }
+        ins<OP_TRAP>(0xF000 | ip->imm);
+        if (Lazy) { cc = cond_value(reg[R_COND]); }
+        ++n;
+        ip = decoded + reg[R_PC];
+        if (!running || n >= budget) { goto leave; }
+        DISPATCH();
     }
-    if (0x0020 & opbit)  // AND
+    TARGET(K_BAD)
     {
-        if (imm_flag)
+        printf("illegal opcode x%X at x%04X\n",
+               memory[ip - decoded] >> 12, (unsigned)(ip - decoded));
+        running = 0;
+        goto leave;
+    }
+    TARGET(K_WRAP)  { ip = decoded; DISPATCH(); }
+
+    /* superinstructions; BRnzp is a BR whose mask always matches */
+    TARGET(K_ADD_BR)
+    {
+        reg[ip->r0] = alu_add(ip); SETCC(ip->r0);
+        n += 2;
+        if (ip[1].r0 & COND())
         {
-            reg[r0] = reg[r1] & imm5;
+            ip = decoded + ip[1].imm;
+            if (n >= budget) { goto leave; }
+            DISPATCH();
         }
-        else
+        ip += 2;
+        DISPATCH();
+    }
+    TARGET(K_ADD_ADD_BR)
+    {
+        reg[ip->r0] = alu_add(ip);
+        reg[ip[1].r0] = alu_add(ip + 1); SETCC(ip[1].r0);
+        n += 3;
+        if (ip[2].r0 & COND())
         {
-            reg[r0] = reg[r1] & reg[r2];
+            ip = decoded + ip[2].imm;
+            if (n >= budget) { goto leave; }
+            DISPATCH();
         }
+        ip += 3;
+        DISPATCH();
+    }
+    TARGET(K_ADD_ADD)
+    {
+        reg[ip->r0] = alu_add(ip);
+        reg[ip[1].r0] = alu_add(ip + 1); SETCC(ip[1].r0);
+        n += 2; ip += 2;
+        DISPATCH();
+    }
+    TARGET(K_LD_ADD)
+    {
+        reg[ip->r0] = memory[ip->imm];
+        reg[ip[1].r0] = alu_add(ip + 1); SETCC(ip[1].r0);
+        n += 2; ip += 2;
+        DISPATCH();
+    }
+    TARGET(K_AND_ADD)
+    {
+        reg[ip->r0] = alu_and(ip);
+        reg[ip[1].r0] = alu_add(ip + 1); SETCC(ip[1].r0);
+        n += 2; ip += 2;
+        DISPATCH();
+    }
+#if !defined(__GNUC__)
+    }
+#endif
+
+leave:
+    reg[R_PC] = (uint16_t)(ip - decoded);
+    if (Lazy) { reg[R_COND] = cond_of(cc); }
+    return n;
+}
+#undef TARGET
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef SETCC
+#undef COND
+
+uint64_t run_threaded(uint64_t budget)
+{
+    return lazy_flags ? run_threaded_impl<true>(budget) : run_threaded_impl<false>(budget);
+}
+
+/* --profile: the table engine, plus counts of the base kinds of
+   sequential instruction pairs and triples (candidates for fusion) */
+static uint64_t pair_counts[K_FUSED_FIRST][K_FUSED_FIRST];
+static uint64_t triple_counts[K_FUSED_FIRST][K_FUSED_FIRST][K_FUSED_FIRST];
+
+uint64_t run_profile(uint64_t budget)
+{
+    static uint8_t  prev[2] = { K_STALE, K_STALE };
+    static uint16_t prev_pc = 0;
+    uint64_t n = 0;
+    while (running && n < budget)
+    {
+        uint16_t pc   = reg[R_PC];
+        uint8_t  kind = decode(pc, memory[pc]).base;
+        if (pc != (uint16_t)(prev_pc + 1)) { prev[0] = prev[1] = K_STALE; }
+        ++pair_counts[prev[1]][kind];
+        ++triple_counts[prev[0]][prev[1]][kind];
+        prev[0] = prev[1];
+        prev[1] = kind;
+        prev_pc = pc;
+        n += run_table(1);
     }
-    if (0x0200 & opbit) { reg[r0] = ~reg[r1]; } // NOT
-    if (0x1000 & opbit) { reg[R_PC] = reg[r1]; } // JMP
-    if (0x0010 & opbit)  // JSR
+    return n;
+}
+
+static void print_profile()
+{
+    struct Top { uint64_t count; int a, b, c; };
+    Top pairs[8] = {}, triples[8] = {};
+    for (int a = 1; a < K_FUSED_FIRST; ++a)
     {
-        uint16_t long_flag = (instr >> 11) & 1;
-        reg[R_R7] = reg[R_PC];
-        if (long_flag)
+        for (int b = 1; b < K_FUSED_FIRST; ++b)
         {
-            pc_plus_off = reg[R_PC] + sign_extend(instr & 0x7FF, 11);
-            reg[R_PC] = pc_plus_off;
+            Top t = { pair_counts[a][b], a, b, -1 };
+            for (int i = 0; i < 8; ++i) { if (t.count > pairs[i].count) { Top x = pairs[i]; pairs[i] = t; t = x; } }
+            for (int c = 1; c < K_FUSED_FIRST; ++c)
+            {
+                Top u = { triple_counts[a][b][c], a, b, c };
+                for (int i = 0; i < 8; ++i) { if (u.count > triples[i].count) { Top x = triples[i]; triples[i] = u; u = x; } }
+            }
         }
-        else
-        {
-            reg[R_PC] = reg[r1];
-        }
-    }
-
-    if (0x0004 & opbit) { reg[r0] = mem_read(pc_plus_off); } // LD
-    if (0x0400 & opbit) { reg[r0] = mem_read(mem_read(pc_plus_off)); } // LDI
-    if (0x0040 & opbit) { reg[r0] = mem_read(base_plus_off); }  // LDR
-    if (0x4000 & opbit) { reg[r0] = pc_plus_off; } // LEA
-    if (0x0008 & opbit) { mem_write(pc_plus_off, reg[r0]); } // ST
-    if (0x0800 & opbit) { mem_write(mem_read(pc_plus_off), reg[r0]); } // STI
-    if (0x0080 & opbit) { mem_write(base_plus_off, reg[r0]); } // STR
-    if (0x8000 & opbit)  // TRAP
-    {
-         reg[R_R7] = reg[R_PC];
-         
-         switch (instr & 0xFF)
-         {
-             case TRAP_GETC:
-                 /* read a single ASCII char */
-                 reg[R_R0] = (uint16_t)getchar();
-                 update_flags(R_R0);
-                 break;
-             case TRAP_OUT:
-                 putc((char)reg[R_R0], stdout);
-                 fflush(stdout);
-                 break;
-             case TRAP_PUTS:
-                 {
-                     /* one char per word */
-                     uint16_t* c = memory + reg[R_R0];
-                     while (*c)
-                     {
-                         putc((char)*c, stdout);
-                         ++c;
-                     }
-                     fflush(stdout);
-                 }
-                 break;
-             case TRAP_IN:
-                 {
-                     printf("Enter a character: ");
-                     char c = getchar();
-                     putc(c, stdout);
-                     fflush(stdout);
-                     reg[R_R0] = (uint16_t)c;
-                     update_flags(R_R0);
-                 }
-                 break;
-             case TRAP_PUTSP:
-                 {
-                     /* one char per byte (two bytes per word)
-                        here we need to swap back to
-                        big endian format */
-                     uint16_t* c = memory + reg[R_R0];
-                     while (*c)
-                     {
-                         char char1 = (*c) & 0xFF;
-                         putc(char1, stdout);
-                         char char2 = (*c) >> 8;
-                         if (char2) putc(char2, stdout);
-                         ++c;
-                     }
-                     fflush(stdout);
-                 }
-                 break;
-             case TRAP_HALT:
-                 puts("HALT");
-                 fflush(stdout);
-                 running = 0;
-                 break;
-         }
-    }
-    //if (0x0100 & opbit) { } // RTI
-    if (0x4666 & opbit) { update_flags(r0); }
-}
-static void (*op_table[16])(uint16_t) = {
-    ins<0>, ins<1>, ins<2>, ins<3>,
-    ins<4>, ins<5>, ins<6>, ins<7>,
-    NULL, ins<9>, ins<10>, ins<11>,
-    ins<12>, NULL, ins<14>, ins<15>
+    }
+    printf("----- sequential pairs -----\n");
+    for (int i = 0; i < 8 && pairs[i].count; ++i)
+    {
+        printf("%12llu  %s ; %s\n", static_cast<unsigned long long>(pairs[i].count),
+               kind_names[pairs[i].a], kind_names[pairs[i].b]);
+    }
+    printf("----- sequential triples -----\n");
+    for (int i = 0; i < 8 && triples[i].count; ++i)
+    {
+        printf("%12llu  %s ; %s ; %s\n", static_cast<unsigned long long>(triples[i].count),
+               kind_names[triples[i].a], kind_names[triples[i].b], kind_names[triples[i].c]);
+    }
+}
+
+/* block engine: straight-line runs ending at BR/JMP/JSR/TRAP (or at a
+   page boundary) are decoded once, cached by entry PC and executed as a
+   unit; PC is only materialised at the end of the block */
+enum
+{
+    BLOCK_MAX_LEN = 64,
+    BLOCK_MAX     = 1 << 14,
+    BLOCK_POOL    = 1 << 16
 };
 
-int main(int argc, const char* argv[])
+struct Block
+{
+    uint32_t first; /* index of the first record in block_pool */
+    uint32_t gen;   /* page_gen of the block's page when it was built */
+    uint16_t entry; /* guest PC of the first instruction */
+    uint16_t count; /* instructions, terminator included */
+};
+
+static Block    blocks[BLOCK_MAX];
+static Decoded  block_pool[BLOCK_POOL];
+static uint32_t block_map[MEMORY_MAX]; /* entry PC -> block index + 1 */
+static uint32_t blocks_used = 0, block_pool_used = 0;
+
+struct BlockStats
+{
+    uint64_t built, rebuilt, flushes, entries;
+};
+static BlockStats block_stats;
+
+static int is_block_end(uint8_t kind)
+{
+    return kind == K_BR || kind == K_BRA || kind == K_JMP || kind == K_JSR
+        || kind == K_JSRR || kind == K_TRAP || kind == K_BAD;
+}
+
+static void block_flush()
 {
-    if (argc < 2)
+    memset(block_map, 0, sizeof(block_map));
+    memset(code_bits, 0, sizeof(code_bits));
+    blocks_used = block_pool_used = 0;
+    ++block_stats.flushes;
+    ++code_gen_total; /* code_bits are gone, so compiled code is no longer protected */
+}
+
+static Block* block_build(uint16_t entry, uint32_t slot)
+{
+    if (blocks_used == BLOCK_MAX || block_pool_used + BLOCK_MAX_LEN > BLOCK_POOL)
     {
-        /* show usage string */
-        printf("lc3 [image-file1] ...\n");
-        exit(2);
+        block_flush();
+        slot = 0;
     }
-    
-    for (int j = 1; j < argc; ++j)
+    if (slot == 0)
     {
-        if (!read_image(argv[j]))
+        slot = ++blocks_used;
+    }
+    else
+    {
+        ++block_stats.rebuilt;
+    }
+
+    Block* b = &blocks[slot - 1];
+    b->entry = entry;
+    b->first = block_pool_used;
+    b->gen   = page_gen[entry >> BLOCK_PAGE_SHIFT];
+    b->count = 0;
+
+    uint16_t pc = entry;
+    for (;;)
+    {
+        Decoded d = decode_at(pc);
+        block_pool[block_pool_used++] = d;
+        code_bits[pc >> 3] |= (uint8_t)(1 << (pc & 7));
+        ++b->count;
+        ++pc;
+        if (is_block_end(d.kind) || b->count == BLOCK_MAX_LEN
+            || (pc >> BLOCK_PAGE_SHIFT) != (entry >> BLOCK_PAGE_SHIFT))
         {
-            printf("failed to load image: %s\n", argv[j]);
-            exit(1);
+            break;
         }
     }
-    signal(SIGINT, handle_interrupt);
-    disable_input_buffering();
+    block_map[entry] = slot;
+    ++block_stats.built;
+    return b;
+}
 
-    enum { PC_START = 0x3000 };
-    reg[R_PC] = PC_START;
+static inline Block* block_lookup(uint16_t pc)
+{
+    uint32_t slot = block_map[pc];
+    if (slot)
+    {
+        Block* b = &blocks[slot - 1];
+        if (b->gen == page_gen[pc >> BLOCK_PAGE_SHIFT]) { return b; }
+    }
+    return block_build(pc, slot);
+}
 
-   /* ▶ —– Stop-watch variables —– */
-    using clock   = std::chrono::high_resolution_clock;
-    auto  t_start = clock::now();
-    uint64_t instr_count = 0;      // counts executed instructions
-    /* ▶––––––––––––––––––––––––––– */
+/* sampling profiler (--sample-profile PREFIX): the block engine with
+   every block entry counted, which gives exact per-PC counts for the
+   block's range, and a shadow call stack where JSR/JSRR push the callee
+   and JMP R7 pops it. A timer thread raises sample_due every --sample-us;
+   the next block entry takes the sample, charging the TSC ticks since the
+   previous sample to that block and one count to the current stack.
+   Names come from the .sym file asm.py writes next to the image. */
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 
-    while (running)
-{
-    uint16_t instr = mem_read(reg[R_PC]++);
-    uint16_t op    = instr >> 12;
-    op_table[op](instr);
+enum { PROF_STACK_MAX = 256 };
+static uint64_t prof_execs[MEMORY_MAX];   /* entries of the block starting at PC */
+static uint32_t prof_len[MEMORY_MAX];     /* its length when last entered */
+static uint64_t prof_samples[MEMORY_MAX];
+static uint64_t prof_ticks[MEMORY_MAX];
+static uint16_t prof_stack[PROF_STACK_MAX];
+static uint32_t prof_depth = 0;           /* frames past PROF_STACK_MAX are counted, not named */
+static uint64_t prof_last_tsc = 0;
+static uint64_t prof_total = 0;
+static std::map<std::vector<uint16_t>, uint64_t> prof_folded;
+static std::atomic<bool> sample_due(false);
+static std::atomic<bool> prof_quit(false);
+static std::thread prof_timer;
 
-    ++instr_count;                       // keep this first
+static void prof_sample(uint16_t entry)
+{
+    sample_due.store(false, std::memory_order_relaxed);
+    uint64_t now = tsc_now();
+    ++prof_samples[entry];
+    prof_ticks[entry] += now - prof_last_tsc;
+    prof_last_tsc = now;
+    ++prof_total;
+    uint32_t depth = prof_depth < PROF_STACK_MAX ? prof_depth : (uint32_t)PROF_STACK_MAX;
+    ++prof_folded[std::vector<uint16_t>(prof_stack, prof_stack + depth)];
+}
 
-/* ---------- live-stats banner (refresh every 100 ms) ---------- */
-static auto last_print = clock::now();
-auto now = clock::now();
-if (now - last_print >= std::chrono::milliseconds(100)) {
-    last_print = now;
+static inline void prof_call(uint16_t target)
+{
+    if (prof_depth < PROF_STACK_MAX) { prof_stack[prof_depth] = target; }
+    ++prof_depth;
+}
 
-    uint64_t ns_tot = std::chrono::duration_cast<
-                        std::chrono::nanoseconds>(now - t_start).count();
-    double   ns_pi  = static_cast<double>(ns_tot) / instr_count;
-    double   mips   = 1e3 / ns_pi;   // (1e9 / ns) / 1e6
+static inline void prof_return()
+{
+    if (prof_depth > 1) { --prof_depth; } /* the root frame stays */
+}
 
-    printf("\033[s");           // save cursor
-    printf("\033[15;1H");       // move to row 15, col 1 (adjust if needed)
-    printf("\033[K");           // clear line
-    printf("Instr: %10llu | %.1f ns/op | %.2f MIPS",
-           static_cast<unsigned long long>(instr_count),
-           ns_pi, mips);
-    printf("\033[u");           // restore cursor
-    fflush(stdout);
+static void prof_start(uint16_t pc, unsigned period_us)
+{
+    prof_stack[0]  = pc;
+    prof_depth     = 1;
+    prof_last_tsc  = tsc_now();
+    prof_timer = std::thread([period_us]
+    {
+        while (!prof_quit.load(std::memory_order_relaxed))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(period_us));
+            sample_due.store(true, std::memory_order_relaxed);
+        }
+    });
 }
-/* ------------------------------------------------------------- */
 
-/* ----------------------------------------------- */
+static void prof_stop()
+{
+    prof_quit.store(true);
+    if (prof_timer.joinable()) { prof_timer.join(); }
+}
 
-/* ----------------------------------------------- */
+struct ProfSymbol
+{
+    uint16_t    addr;
+    std::string name;
+};
+static std::vector<ProfSymbol> prof_symbols;
 
+/* image.obj -> image.sym: "x3000 LABEL" per line */
+static void prof_load_symbols(const char* image)
+{
+    std::string path(image);
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos && path.find_first_of("/\\", dot) == std::string::npos) { path.resize(dot); }
+    FILE* f = fopen((path + ".sym").c_str(), "r");
+    if (!f) { return; }
+    unsigned addr;
+    char     name[128];
+    while (fscanf(f, " x%x %127s", &addr, name) == 2)
+    {
+        prof_symbols.push_back({ (uint16_t)addr, name });
+    }
+    fclose(f);
+    std::stable_sort(prof_symbols.begin(), prof_symbols.end(),
+                     [](const ProfSymbol& a, const ProfSymbol& b) { return a.addr < b.addr; });
 }
 
+/* LABEL, LABEL+n for the nearest label at or below pc, else x%04X */
+static std::string prof_name(uint16_t pc)
+{
+    char buf[160];
+    auto it = std::upper_bound(prof_symbols.begin(), prof_symbols.end(), pc,
+                               [](uint16_t v, const ProfSymbol& s) { return v < s.addr; });
+    if (it == prof_symbols.begin())
+    {
+        snprintf(buf, sizeof(buf), "x%04X", (unsigned)pc);
+    }
+    else if ((--it)->addr == pc)
+    {
+        return it->name;
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%s+%u", it->name.c_str(), (unsigned)(pc - it->addr));
+    }
+    return buf;
+}
 
-    /* ▶ —– Stop-watch: print results —– */
-    auto t_end   = clock::now();
-    auto ns_total =
-        std::chrono::duration_cast<std::chrono::nanoseconds>(t_end - t_start).count();
+/* PREFIX.folded (flamegraph.pl input), PREFIX.pcs, PREFIX.blocks */
+static int prof_write(const char* prefix)
+{
+    std::string base(prefix);
+    FILE* folded = fopen((base + ".folded").c_str(), "w");
+    FILE* pcs    = fopen((base + ".pcs").c_str(), "w");
+    FILE* blks   = fopen((base + ".blocks").c_str(), "w");
+    if (!folded || !pcs || !blks)
+    {
+        if (folded) { fclose(folded); }
+        if (pcs)    { fclose(pcs); }
+        if (blks)   { fclose(blks); }
+        return 0;
+    }
 
-    double ns_per_instr = static_cast<double>(ns_total) / instr_count;
-    double ips          = 1e9 / ns_per_instr;   // instr per second
+    for (const auto& st : prof_folded)
+    {
+        std::string line;
+        for (size_t i = 0; i < st.first.size(); ++i) { line += (i ? ";" : "") + prof_name(st.first[i]); }
+        fprintf(folded, "%s %llu\n", line.c_str(), static_cast<unsigned long long>(st.second));
+    }
 
-    printf("\n===== LC-3 Benchmark =====\n");
-    printf("Executed : %llu instructions\n", static_cast<unsigned long long>(instr_count));
-    printf("Elapsed  : %.3f ms\n", ns_total / 1e6);
+    static uint64_t pc_counts[MEMORY_MAX];
+    std::vector<uint32_t> order;
+    for (uint32_t e = 0; e < MEMORY_MAX; ++e)
+    {
+        if (!prof_execs[e]) { continue; }
+        order.push_back(e);
+        for (uint32_t i = 0; i < prof_len[e]; ++i) { pc_counts[(uint16_t)(e + i)] += prof_execs[e]; }
+    }
+    std::sort(order.begin(), order.end(), [](uint32_t a, uint32_t b)
+    {
+        return prof_ticks[a] != prof_ticks[b] ? prof_ticks[a] > prof_ticks[b] : prof_execs[a] > prof_execs[b];
+    });
+    uint64_t ticks = 0;
+    for (uint32_t e : order) { ticks += prof_ticks[e]; }
+    fprintf(blks, "# entry symbol length executions samples ticks percent\n");
+    for (uint32_t e : order)
+    {
+        fprintf(blks, "x%04X %s %u %llu %llu %llu %.2f\n", e, prof_name((uint16_t)e).c_str(), (unsigned)prof_len[e],
+                static_cast<unsigned long long>(prof_execs[e]), static_cast<unsigned long long>(prof_samples[e]),
+                static_cast<unsigned long long>(prof_ticks[e]), ticks ? 100.0 * prof_ticks[e] / ticks : 0.0);
+    }
+
+    std::vector<uint32_t> hot;
+    for (uint32_t pc = 0; pc < MEMORY_MAX; ++pc) { if (pc_counts[pc]) { hot.push_back(pc); } }
+    std::sort(hot.begin(), hot.end(), [](uint32_t a, uint32_t b) { return pc_counts[a] > pc_counts[b]; });
+    fprintf(pcs, "# pc symbol executions\n");
+    for (uint32_t pc : hot)
+    {
+        fprintf(pcs, "x%04X %s %llu\n", pc, prof_name((uint16_t)pc).c_str(),
+                static_cast<unsigned long long>(pc_counts[pc]));
+    }
+    fclose(folded);
+    fclose(pcs);
+    fclose(blks);
+
+    printf("Samples  : %llu, %zu stacks -> %s.folded, %s.pcs, %s.blocks\n",
+           static_cast<unsigned long long>(prof_total), prof_folded.size(), prefix, prefix, prefix);
+    for (size_t i = 0; i < order.size() && i < 5 && prof_ticks[order[i]]; ++i)
+    {
+        printf("%8.2f%%  %s\n", ticks ? 100.0 * prof_ticks[order[i]] / ticks : 0.0, prof_name((uint16_t)order[i]).c_str());
+    }
+    return 1;
+}
+
+template <bool Sampled>
+static uint64_t run_block_impl(uint64_t budget)
+{
+    uint64_t n  = 0;
+    uint16_t pc = reg[R_PC];
+
+    while (running && n < budget)
+    {
+        const Block*   b    = block_lookup(pc);
+        const Decoded* d    = block_pool + b->first;
+        const Decoded* end  = d + b->count;
+        uint16_t       next = b->entry + b->count;
+        ++block_stats.entries;
+        if (Sampled)
+        {
+            ++prof_execs[b->entry];
+            prof_len[b->entry] = b->count;
+            if (sample_due.load(std::memory_order_relaxed)) { prof_sample(b->entry); }
+        }
+
+        for (; d < end; ++d)
+        {
+            switch (d->kind)
+            {
+                case K_NOP:   break;
+                case K_ADD_R: reg[d->r0] = reg[d->r1] + reg[d->r2]; update_flags(d->r0); break;
+                case K_ADD_I: reg[d->r0] = reg[d->r1] + d->imm;     update_flags(d->r0); break;
+                case K_AND_R: reg[d->r0] = reg[d->r1] & reg[d->r2]; update_flags(d->r0); break;
+                case K_AND_I: reg[d->r0] = reg[d->r1] & d->imm;     update_flags(d->r0); break;
+                case K_NOT:   reg[d->r0] = ~reg[d->r1];             update_flags(d->r0); break;
+                case K_LD:    reg[d->r0] = memory[d->imm];          update_flags(d->r0); break;
+                case K_LD_IO: reg[d->r0] = mem_read(d->imm);        update_flags(d->r0); break;
+                case K_LDI:   reg[d->r0] = mem_read(mem_read(d->imm)); update_flags(d->r0); break;
+                case K_LDR:   reg[d->r0] = mem_read(reg[d->r1] + d->imm); update_flags(d->r0); break;
+                case K_LEA:   reg[d->r0] = d->imm;                  update_flags(d->r0); break;
+                case K_ST:    ram_write(d->imm, reg[d->r0]); goto stored;
+                case K_ST_IO: mem_write(d->imm, reg[d->r0]); goto stored;
+                case K_STI:   mem_write(mem_read(d->imm), reg[d->r0]); goto stored;
+                case K_STR:   mem_write(reg[d->r1] + d->imm, reg[d->r0]); goto stored;
+
+                /* terminators, always the last record of a block */
+                case K_BR:    if (d->r0 & reg[R_COND]) { next = d->imm; } break;
+                case K_BRA:   next = d->imm; break;
+                case K_JMP:
+                    next = reg[d->r1];
+                    if (Sampled && d->r1 == R_R7) { prof_return(); }
+                    break;
+                case K_JSR:
+                    reg[R_R7] = next;
+                    next = d->imm;
+                    if (Sampled) { prof_call(next); }
+                    break;
+                case K_JSRR:
+                {
+                    uint16_t target = reg[d->r1];
+                    reg[R_R7] = next;
+                    next = target;
+                    if (Sampled) { prof_call(next); }
+                    break;
+                }
+                case K_TRAP:
+                    reg[R_PC] = next;
+                    ins<OP_TRAP>(0xF000 | d->imm);
+                    next = reg[R_PC];
+                    break;
+                default: /* K_BAD: stop with PC on the offending instruction */
+                    next = b->entry + (uint16_t)(d - (block_pool + b->first));
+                    printf("illegal opcode x%X at x%04X\n", memory[next] >> 12, (unsigned)next);
+                    running = 0;
+                    end = d;
+                    break;
+            }
+            continue;
+
+        stored:
+            /* the store hit cached code: leave the block right after it */
+            if (block_invalidated)
+            {
+                block_invalidated = 0;
+                next = b->entry + (uint16_t)(d - (block_pool + b->first)) + 1;
+                end  = d + 1;
+                break;
+            }
+        }
+        n += (uint64_t)(end - (block_pool + b->first));
+        pc = next;
+    }
+    reg[R_PC] = pc;
+    return n;
+}
+
+uint64_t run_block(uint64_t budget)
+{
+    return run_block_impl<false>(budget);
+}
+
+uint64_t run_sample(uint64_t budget)
+{
+    return run_block_impl<true>(budget);
+}
+
+/* jit engine: block entries are counted while the block engine runs
+   them; past jit_threshold a block is translated to x86-64 code in an
+   executable arena. Guest R0-R7 live in r8d-r15d, PC in edi, COND in
+   esi, and the memory base in rbx. Compiled blocks chain through a
+   dispatch stub (or directly, when the successor is already compiled)
+   until the budget in rbp runs out or a lookup misses. TRAPs, the device
+   page and stores into cached code take a side exit, and the
+   interpreter executes that one instruction through ins<op>. */
+enum
+{
+    JIT_ARENA_SIZE = 4 << 20,
+    JIT_NEVER      = 0xFFFF /* jit_heat marker: block starts with an uncovered instruction */
+};
+
+static uint8_t*       jit_arena = NULL;
+static size_t         jit_used  = 0;
+static const uint8_t* jit_entry[MEMORY_MAX]; /* compiled code for a block entry PC */
+static uint16_t       jit_heat[MEMORY_MAX];
+static uint32_t       jit_threshold = 16;
+static int            jit_disabled  = 0;     /* --interp-only */
+static int64_t        jit_budget_left;
+static uint32_t       jit_gen_seen;
+static uint32_t     (*jit_enter)(void);      /* returns 1 on a side exit */
+static const uint8_t* jit_dispatch;
+static const uint8_t* jit_exit;
+
+struct JitStats
+{
+    uint64_t compiled, entries, side_exits, flushes;
+};
+static JitStats jit_stats;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include "x64_emitter.hpp"
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+static inline X64Reg jit_host(int r) { return (X64Reg)(R8 + r); }
+
+static uint8_t* jit_alloc_arena()
+{
+#if defined(_WIN32)
+    return (uint8_t*)VirtualAlloc(NULL, JIT_ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    void* p = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : (uint8_t*)p;
+#endif
+}
+
+/* entry trampoline, dispatch stub and exit stub at the start of the arena */
+static void jit_emit_runtime()
+{
+    static const X64Reg saved[] = { RBX, RBP, RDI, RSI, R12, R13, R14, R15 };
+    X64Emitter e(jit_arena, JIT_ARENA_SIZE);
+
+    /* exit: eax already holds the exit reason */
+    jit_exit = e.here();
+    e.mov64(RDX, (uint64_t)(uintptr_t)reg);
+    for (int r = 0; r < 8; ++r) { e.store16(mem_at(RDX, 2 * r), jit_host(r)); }
+    e.store16(mem_at(RDX, 2 * R_PC), RDI);
+    e.store16(mem_at(RDX, 2 * R_COND), RSI);
+    e.mov64(RDX, (uint64_t)(uintptr_t)&jit_budget_left);
+    e.store64(mem_at(RDX), RBP);
+    for (int i = 7; i >= 0; --i) { e.pop(saved[i]); }
+    e.ret();
+
+    /* dispatch: edi = next guest PC */
+    jit_dispatch = e.here();
+    e.test64(RBP, RBP);
+    uint8_t* out_of_budget = e.jcc(CC_LE);
+    e.mov64(RDX, (uint64_t)(uintptr_t)jit_entry);
+    e.load64(RAX, mem_at(RDX, RDI, 8));
+    e.test64(RAX, RAX);
+    uint8_t* miss = e.jcc(CC_E);
+    e.jmp(RAX);
+    X64Emitter::patch(out_of_budget, e.here());
+    X64Emitter::patch(miss, e.here());
+    e.mov(RAX, 0u);
+    e.jmp(jit_exit);
+
+    /* entry */
+    jit_enter = (uint32_t (*)(void))(void*)e.here();
+    for (int i = 0; i < 8; ++i) { e.push(saved[i]); }
+    e.mov64(RDX, (uint64_t)(uintptr_t)reg);
+    for (int r = 0; r < 8; ++r) { e.movzx16(jit_host(r), mem_at(RDX, 2 * r)); }
+    e.movzx16(RDI, mem_at(RDX, 2 * R_PC));
+    e.movzx16(RSI, mem_at(RDX, 2 * R_COND));
+    e.mov64(RBX, (uint64_t)(uintptr_t)memory);
+    e.mov64(RDX, (uint64_t)(uintptr_t)&jit_budget_left);
+    e.load64(RBP, mem_at(RDX));
+    e.jmp(jit_dispatch);
+
+    jit_used = e.size();
+}
+
+static void jit_flush()
+{
+    memset(jit_entry, 0, sizeof(jit_entry));
+    memset(jit_heat, 0, sizeof(jit_heat));
+    jit_used = 0;
+    jit_emit_runtime();
+    jit_gen_seen = code_gen_total;
+    ++jit_stats.flushes;
+}
+
+/* esi = N/Z/P of the 16-bit value in src */
+static void jit_emit_cond(X64Emitter& e, X64Reg src)
+{
+    e.mov(RSI, (uint32_t)FL_POS);
+    e.mov(RCX, (uint32_t)FL_ZRO);
+    e.test(src, src);
+    e.cmov(CC_E, RSI, RCX);
+    e.mov(RCX, (uint32_t)FL_NEG);
+    e.test(src, 0x8000u);
+    e.cmov(CC_NE, RSI, RCX);
+}
+
+/* leave the block for guest PC `pc`, chaining directly when possible */
+static void jit_emit_goto(X64Emitter& e, uint16_t pc, uint16_t self_pc, const uint8_t* self)
+{
+    e.mov(RDI, (uint32_t)pc);
+    const uint8_t* target = pc == self_pc ? self : jit_entry[pc];
+    if (target)
+    {
+        e.test64(RBP, RBP);
+        e.jcc(CC_G, target);
+    }
+    e.jmp(jit_dispatch);
+}
+
+/* ZF clear when the guest address in addr is on a device page; uses RAX
+   and RDX (K_ST never needs it, device-page STs decode to K_ST_IO) */
+static void jit_emit_io_check(X64Emitter& e, X64Reg addr)
+{
+    e.mov(RAX, addr);
+    e.shr(RAX, DeviceBus::PAGE_SHIFT);
+    e.mov64(RDX, (uint64_t)(uintptr_t)devices.page_table());
+    e.movzx8(RAX, mem_at(RDX, RAX, 1));
+    e.test(RAX, RAX);
+}
+
+static int jit_covered(const Decoded& d)
+{
+    switch (d.kind)
+    {
+        case K_LD_IO: case K_ST_IO: case K_TRAP: case K_BAD: case K_STALE: case K_WRAP: return 0;
+        case K_LDI: case K_STI: return !devices.io_page(d.imm);
+        case K_ST: return !(code_bits[d.imm >> 3] & (1 << (d.imm & 7)));
+        default: return 1;
+    }
+}
+
+struct JitSideExit
+{
+    uint8_t* slot;
+    uint16_t index;     /* instruction index in the block */
+    int16_t  flag_reg;  /* guest register that last set N/Z/P, or -1 */
+};
+
+static int jit_compile(uint16_t pc)
+{
+    const Block*   b = block_lookup(pc);
+    const Decoded* d = block_pool + b->first;
+    if (!jit_covered(d[0])) { jit_heat[pc] = JIT_NEVER; return 0; }
+    if (JIT_ARENA_SIZE - jit_used < 16 * 1024) { jit_flush(); b = block_lookup(pc); d = block_pool + b->first; }
+
+    uint8_t* start = jit_arena + jit_used;
+    X64Emitter e(start, JIT_ARENA_SIZE - jit_used);
+    JitSideExit exits[BLOCK_MAX_LEN + 1];
+    int n_exits  = 0;
+    int flag_reg = -1;
+    int ended    = 0;
+
+    e.sub64(RBP, b->count);
+    for (uint16_t i = 0; i < b->count && !ended; ++i)
+    {
+        const Decoded& r   = d[i];
+        uint16_t       ipc = b->entry + i;
+        X64Reg         h0  = jit_host(r.r0);
+        X64Reg         h1  = jit_host(r.r1);
+        X64Reg         h2  = jit_host(r.r2);
+
+        if (!jit_covered(r))
+        {
+            exits[n_exits++] = { e.jmp(), i, (int16_t)flag_reg };
+            ended = 1;
+            break;
+        }
+        switch (r.kind)
+        {
+            case K_NOP: break;
+            case K_ADD_R: e.mov(RAX, h1); e.add(RAX, h2); e.movzx16(h0, RAX); break;
+            case K_ADD_I: e.mov(RAX, h1); e.add(RAX, (int32_t)(int16_t)r.imm); e.movzx16(h0, RAX); break;
+            case K_AND_R: e.mov(RAX, h1); e.and_(RAX, h2); e.mov(h0, RAX); break;
+            case K_AND_I: e.mov(RAX, h1); e.and_(RAX, (int32_t)r.imm); e.mov(h0, RAX); break;
+            case K_NOT:   e.mov(RAX, h1); e.not_(RAX); e.movzx16(h0, RAX); break;
+            case K_LEA:   e.mov(h0, (uint32_t)r.imm); break;
+            case K_LD:    e.movzx16(h0, mem_at(RBX, 2 * r.imm)); break;
+            case K_LDI:
+            case K_LDR:
+                if (r.kind == K_LDI)
+                {
+                    e.movzx16(RCX, mem_at(RBX, 2 * r.imm));
+                }
+                else
+                {
+                    e.mov(RCX, h1);
+                    e.add(RCX, (int32_t)(int16_t)r.imm);
+                    e.movzx16(RCX, RCX);
+                }
+                jit_emit_io_check(e, RCX);
+                exits[n_exits++] = { e.jcc(CC_NE), i, (int16_t)flag_reg };
+                e.movzx16(h0, mem_at(RBX, RCX, 2));
+                break;
+            case K_ST:
+            case K_STI:
+            case K_STR:
+                if (r.kind == K_ST)
+                {
+                    e.mov(RCX, (uint32_t)r.imm);
+                }
+                else if (r.kind == K_STI)
+                {
+                    e.movzx16(RCX, mem_at(RBX, 2 * r.imm));
+                }
+                else
+                {
+                    e.mov(RCX, h1);
+                    e.add(RCX, (int32_t)(int16_t)r.imm);
+                    e.movzx16(RCX, RCX);
+                }
+                if (r.kind != K_ST)
+                {
+                    jit_emit_io_check(e, RCX);
+                    exits[n_exits++] = { e.jcc(CC_NE), i, (int16_t)flag_reg };
+                }
+                e.mov64(RDX, (uint64_t)(uintptr_t)code_bits);
+                e.bt(mem_at(RDX), RCX);
+                exits[n_exits++] = { e.jcc(CC_B), i, (int16_t)flag_reg };
+                e.store16(mem_at(RBX, RCX, 2), h0);
+                break;
+
+            case K_BR:
+            {
+                if (flag_reg >= 0) { jit_emit_cond(e, jit_host(flag_reg)); }
+                e.test(RSI, (uint32_t)r.r0);
+                uint8_t* taken = e.jcc(CC_NE);
+                jit_emit_goto(e, ipc + 1, b->entry, start);
+                X64Emitter::patch(taken, e.here());
+                jit_emit_goto(e, r.imm, b->entry, start);
+                ended = 1;
+                break;
+            }
+            case K_BRA:
+                if (flag_reg >= 0) { jit_emit_cond(e, jit_host(flag_reg)); }
+                jit_emit_goto(e, r.imm, b->entry, start);
+                ended = 1;
+                break;
+            case K_JMP:
+            case K_JSRR:
+                if (flag_reg >= 0) { jit_emit_cond(e, jit_host(flag_reg)); }
+                e.mov(RDI, h1);
+                if (r.kind == K_JSRR) { e.mov(jit_host(R_R7), (uint32_t)(uint16_t)(ipc + 1)); }
+                e.jmp(jit_dispatch);
+                ended = 1;
+                break;
+            case K_JSR:
+                if (flag_reg >= 0) { jit_emit_cond(e, jit_host(flag_reg)); }
+                e.mov(jit_host(R_R7), (uint32_t)(uint16_t)(ipc + 1));
+                jit_emit_goto(e, r.imm, b->entry, start);
+                ended = 1;
+                break;
+        }
+        switch (r.kind)
+        {
+            case K_ADD_R: case K_ADD_I: case K_AND_R: case K_AND_I: case K_NOT:
+            case K_LD: case K_LDI: case K_LDR: case K_LEA:
+                flag_reg = r.r0;
+                break;
+        }
+    }
+    if (!ended)
+    {
+        /* page boundary or length cap: fall through to the next block */
+        if (flag_reg >= 0) { jit_emit_cond(e, jit_host(flag_reg)); }
+        jit_emit_goto(e, (uint16_t)(b->entry + b->count), b->entry, start);
+    }
+
+    /* side exits: refund the instructions not executed, hand the
+       instruction at `index` to the interpreter */
+    for (int x = 0; x < n_exits; ++x)
+    {
+        X64Emitter::patch(exits[x].slot, e.here());
+        e.add64(RBP, b->count - exits[x].index);
+        if (exits[x].flag_reg >= 0) { jit_emit_cond(e, jit_host(exits[x].flag_reg)); }
+        e.mov(RDI, (uint32_t)(uint16_t)(b->entry + exits[x].index));
+        e.mov(RAX, 1u);
+        e.jmp(jit_exit);
+    }
+
+    if (!e.ok())
+    {
+        jit_flush();
+        return 0;
+    }
+    jit_used += e.size();
+    jit_entry[pc] = start;
+    ++jit_stats.compiled;
+    return 1;
+}
+#else
+static int  jit_compile(uint16_t pc) { jit_heat[pc] = JIT_NEVER; return 0; }
+static void jit_flush() { jit_gen_seen = code_gen_total; }
+#endif
+
+/* one instruction through the core, used after a side exit */
+static void jit_step_interp()
+{
+    uint16_t op = memory[reg[R_PC]] >> 12;
+    if (op == OP_RTI || op == OP_RES)
+    {
+        printf("illegal opcode x%X at x%04X\n", op, (unsigned)reg[R_PC]);
+        running = 0;
+        return;
+    }
+    uint16_t instr = memory[reg[R_PC]++];
+    core.step(instr);
+}
+
+uint64_t run_jit(uint64_t budget)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (!jit_arena && !jit_disabled)
+    {
+        jit_arena = jit_alloc_arena();
+        if (!jit_arena) { jit_disabled = 1; }
+        else            { jit_flush(); }
+    }
+#else
+    jit_disabled = 1;
+#endif
+
+    uint64_t n = 0;
+    while (running && n < budget)
+    {
+        if (jit_gen_seen != code_gen_total) { jit_flush(); }
+
+        uint16_t pc = reg[R_PC];
+        if (jit_entry[pc])
+        {
+            int64_t left    = (int64_t)(budget - n);
+            jit_budget_left = left;
+            uint32_t side   = jit_enter();
+            n += (uint64_t)(left - jit_budget_left);
+            ++jit_stats.entries;
+            if (side)
+            {
+                ++jit_stats.side_exits;
+                jit_step_interp();
+                ++n;
+            }
+            continue;
+        }
+        if (!jit_disabled && jit_heat[pc] != JIT_NEVER && ++jit_heat[pc] >= jit_threshold
+            && jit_compile(pc))
+        {
+            continue;
+        }
+        n += run_block(1);
+    }
+    return n;
+}
+
+/* aot engine (--aot module): blocks translated offline by aot.py and
+   loaded from a shared library. They run on the same reg/memory state and
+   call back into mem_read/mem_write/ins<OP_TRAP>. A store into translated
+   code drops the blocks covering that word (and leaves the running block
+   right after the store); anything without a translated block, including
+   code written at runtime, runs in the block engine. */
+#include "lc3_aot.hpp"
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#endif
+
+static Lc3AotFn            aot_entry[MEMORY_MAX];
+static uint8_t             aot_len[MEMORY_MAX];
+static const Lc3AotModule* aot_module = NULL;
+
+struct AotStats
+{
+    uint64_t entries, fallback, dropped;
+};
+static AotStats aot_stats;
+
+static void aot_drop(uint16_t address)
+{
+    aot_invalidated = 1;
+    for (int back = 0; back < 256; ++back)
+    {
+        uint16_t pc = (uint16_t)(address - back);
+        if (aot_entry[pc] && (uint32_t)pc + aot_len[pc] > address)
+        {
+            for (uint32_t a = pc; a < (uint32_t)pc + aot_len[pc]; ++a)
+            {
+                aot_bits[a >> 3] &= (uint8_t)~(1 << (a & 7));
+            }
+            aot_entry[pc] = NULL;
+            ++aot_stats.dropped;
+        }
+    }
+}
+
+static void aot_trap(uint16_t vector)
+{
+    ins<OP_TRAP>(0xF000 | vector);
+}
+
+static int aot_load(const char* path)
+{
+#if defined(_WIN32)
+    HMODULE lib = LoadLibraryA(path);
+    Lc3AotModuleFn get = lib ? (Lc3AotModuleFn)(void*)GetProcAddress(lib, "lc3_aot_module") : NULL;
+#else
+    void* lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    Lc3AotModuleFn get = lib ? (Lc3AotModuleFn)dlsym(lib, "lc3_aot_module") : NULL;
+#endif
+    if (!get)
+    {
+        printf("failed to load aot module: %s\n", path);
+        return 0;
+    }
+    const Lc3AotModule* m = get();
+    if (m->version != LC3_AOT_VERSION
+        || (uint32_t)m->origin + m->image_len > MEMORY_MAX
+        || memcmp(memory + m->origin, m->image, m->image_len * sizeof(uint16_t)) != 0)
+    {
+        printf("aot module %s was not built from the loaded image\n", path);
+        return 0;
+    }
+
+    static const Lc3AotEnv env = { reg, memory, mem_read, mem_write, aot_trap, &aot_invalidated, aot_entry };
+    m->init(&env);
+    for (uint32_t i = 0; i < m->block_count; ++i)
+    {
+        const Lc3AotBlock& b = m->blocks[i];
+        aot_entry[b.pc] = b.fn;
+        aot_len[b.pc]   = (uint8_t)b.len;
+        for (uint32_t a = b.pc; a < (uint32_t)b.pc + b.len; ++a)
+        {
+            aot_bits[a >> 3] |= (uint8_t)(1 << (a & 7));
+        }
+    }
+    aot_module = m;
+    return 1;
+}
+
+uint64_t run_aot(uint64_t budget)
+{
+    uint64_t n = 0;
+    while (running && n < budget)
+    {
+        Lc3AotFn fn = aot_entry[reg[R_PC]];
+        if (fn)
+        {
+            reg[R_PC] = fn(&n, budget);
+            aot_invalidated = 0;
+            ++aot_stats.entries;
+        }
+        else
+        {
+            uint64_t k = run_block(1);
+            aot_stats.fallback += k;
+            n += k;
+        }
+    }
+    return n;
+}
+
+/* --convert out.lc3i: write the loaded image(s) as an .lc3i container
+   with the decode of every word and the words that start a basic block.
+   Entries are found by following control flow from the start of the image
+   (branch and call targets, return points, fall-through after a
+   conditional branch or TRAP), so data words never become blocks. */
+static int convert_image(const char* path)
+{
+    if (image_hi <= image_lo) { return 0; }
+    static Lc3ImageOp ops[MEMORY_MAX];
+    static uint8_t    entries[MEMORY_MAX / 8];
+    static uint8_t    seen[MEMORY_MAX / 8];
+    static uint16_t   work[MEMORY_MAX];
+    uint32_t          top = 0;
+    auto in_image = [](uint32_t pc) { return pc >= image_lo && pc < image_hi; };
+    auto enter = [&](uint32_t pc)
+    {
+        if (!in_image(pc) || (entries[pc >> 3] & (1 << (pc & 7)))) { return; }
+        entries[pc >> 3] |= (uint8_t)(1 << (pc & 7));
+        work[top++] = (uint16_t)pc;
+    };
+
+    for (uint32_t pc = image_lo; pc < image_hi; ++pc)
+    {
+        Decoded d = decode((uint16_t)pc, memory[pc]);
+        Lc3ImageOp& op = ops[pc - image_lo];
+        op.imm  = d.imm;
+        op.r0   = d.r0;
+        op.r1   = d.r1;
+        op.r2   = d.r2;
+        op.kind = d.base;
+    }
+
+    enter(image_lo);
+    while (top)
+    {
+        /* walk one block */
+        for (uint32_t pc = work[--top]; in_image(pc) && !(seen[pc >> 3] & (1 << (pc & 7))); ++pc)
+        {
+            seen[pc >> 3] |= (uint8_t)(1 << (pc & 7));
+            const Lc3ImageOp& op = ops[pc - image_lo];
+            if (op.kind == K_BR || op.kind == K_BRA || op.kind == K_JSR) { enter(op.imm); }
+            if (op.kind == K_BR || op.kind == K_JSR || op.kind == K_JSRR
+                || (op.kind == K_TRAP && op.imm != TRAP_HALT))
+            {
+                enter(pc + 1);
+            }
+            if (is_block_end(op.kind)) { break; }
+        }
+    }
+    return lc3_image_write(path, memory, (uint16_t)image_lo, image_hi - image_lo, DECODE_VERSION, ops, entries);
+}
+
+/* block engines: build the blocks an .lc3i image lists up front */
+static void prebuild_blocks()
+{
+    for (uint32_t pc = 0; pc < MEMORY_MAX; ++pc)
+    {
+        if (loaded_image->is_entry((uint16_t)pc) && memory[pc] == loaded_image->memory[pc])
+        {
+            block_lookup((uint16_t)pc);
+        }
+    }
+}
+
+/* batch engine (--batch K): K lanes run the loaded image in lockstep, for
+   kernels that are run over many independent inputs. Lane i starts with
+   R0 = i and R1 = K. Registers and memory are kept in structure-of-arrays
+   form (word or register major, lane minor), so one decoded instruction is
+   applied to LANE_W lanes per vector operation (lane_vec.hpp).
+
+   Each step takes the lowest PC among running lanes and executes the word
+   there for every lane at that PC holding the same word. Lanes that take
+   different sides of a branch end up at different PCs and run in separate
+   steps until their PCs meet again. TRAPs, loads and stores on device
+   pages, LDI/STI and RTI/reserved opcodes drop out to batch_lane_step,
+   which runs one lane through the scalar interpreter; LDR/STR addresses
+   differ per lane, so those lanes are handled one at a time within the
+   vector step. Devices are shared by all lanes. */
+#include "lane_vec.hpp"
+
+static uint32_t  batch_k    = 0;    /* lanes requested */
+static uint32_t  batch_w    = 0;    /* lanes allocated, a multiple of LANE_W */
+static uint16_t* batch_mem  = NULL; /* [MEMORY_MAX][batch_w] */
+static uint16_t* batch_reg  = NULL; /* [R_COUNT][batch_w] */
+static uint16_t* batch_live = NULL; /* 0xFFFF while the lane runs */
+
+struct BatchStats
+{
+    uint64_t steps, instr, scalar;
+};
+static BatchStats batch_stats;
+
+static inline uint16_t* batch_word(uint16_t address) { return batch_mem + (size_t)address * batch_w; }
+static inline uint16_t* batch_r(int r) { return batch_reg + (size_t)r * batch_w; }
+
+static int batch_init(uint32_t k, uint16_t pc)
+{
+    batch_k    = k;
+    batch_w    = (k + LANE_W - 1) / LANE_W * LANE_W;
+    batch_mem  = (uint16_t*)malloc(sizeof(uint16_t) * MEMORY_MAX * batch_w);
+    batch_reg  = (uint16_t*)calloc((size_t)R_COUNT * batch_w, sizeof(uint16_t));
+    batch_live = (uint16_t*)calloc(batch_w, sizeof(uint16_t));
+    if (!batch_mem || !batch_reg || !batch_live) { return 0; }
+
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        uint16_t* w = batch_word((uint16_t)address);
+        for (uint32_t lane = 0; lane < batch_w; ++lane) { w[lane] = memory[address]; }
+    }
+    for (uint32_t lane = 0; lane < k; ++lane)
+    {
+        batch_r(R_R0)[lane] = (uint16_t)lane;
+        batch_r(R_R1)[lane] = (uint16_t)k;
+        batch_r(R_PC)[lane] = pc;
+        batch_live[lane]    = 0xFFFF;
+    }
+    return 1;
+}
+
+static uint16_t batch_lane_read(uint32_t lane, uint16_t address)
+{
+    if (devices.io_page(address))
+    {
+        if (Lc3Device* dev = devices.at(address)) { return dev->read(address); }
+    }
+    return batch_word(address)[lane];
+}
+
+static void batch_lane_write(uint32_t lane, uint16_t address, uint16_t val)
+{
+    if (devices.io_page(address))
+    {
+        if (Lc3Device* dev = devices.at(address))
+        {
+            dev->write(address, val);
+            return;
+        }
+    }
+    batch_word(address)[lane] = val;
+}
+
+static void batch_lane_trap(uint32_t lane, uint16_t* r, uint8_t vector)
+{
+    switch (vector)
+    {
+        case TRAP_GETC:
+            r[R_R0] = (uint16_t)console.getc();
+            r[R_COND] = cond_of(r[R_R0]);
+            break;
+        case TRAP_OUT:
+            console.putc((char)r[R_R0]);
+            break;
+        case TRAP_PUTS:
+            for (uint16_t a = r[R_R0]; batch_word(a)[lane]; ++a) { console.putc((char)batch_word(a)[lane]); }
+            break;
+        case TRAP_IN:
+        {
+            console_puts("Enter a character: ");
+            int c = console.getc();
+            console.putc((char)c);
+            r[R_R0] = (uint16_t)c;
+            r[R_COND] = cond_of(r[R_R0]);
+            break;
+        }
+        case TRAP_PUTSP:
+            for (uint16_t a = r[R_R0]; batch_word(a)[lane]; ++a)
+            {
+                uint16_t w = batch_word(a)[lane];
+                console.putc((char)(w & 0xFF));
+                if (w >> 8) { console.putc((char)(w >> 8)); }
+            }
+            break;
+        case TRAP_HALT:
+            batch_live[lane] = 0;
+            break;
+    }
+}
+
+/* one instruction of one lane, same semantics as ins<op> */
+static void batch_lane_step(uint32_t lane)
+{
+    uint16_t r[R_COUNT];
+    for (int i = 0; i < R_COUNT; ++i) { r[i] = batch_r(i)[lane]; }
+
+    uint16_t pc       = r[R_PC];
+    uint16_t instr    = batch_lane_read(lane, r[R_PC]++);
+    uint16_t dr       = (instr >> 9) & 0x7;
+    uint16_t sr1      = (instr >> 6) & 0x7;
+    uint16_t operand  = (instr >> 5) & 1 ? sign_extend(instr & 0x1F, 5) : r[instr & 0x7];
+    uint16_t pc_off   = r[R_PC] + sign_extend(instr & 0x1FF, 9);
+    uint16_t base_off = r[sr1] + sign_extend(instr & 0x3F, 6);
+    int      set_cc   = 1;
+    switch (instr >> 12)
+    {
+        case OP_ADD: r[dr] = r[sr1] + operand; break;
+        case OP_AND: r[dr] = r[sr1] & operand; break;
+        case OP_NOT: r[dr] = ~r[sr1]; break;
+        case OP_LD:  r[dr] = batch_lane_read(lane, pc_off); break;
+        case OP_LDI: r[dr] = batch_lane_read(lane, batch_lane_read(lane, pc_off)); break;
+        case OP_LDR: r[dr] = batch_lane_read(lane, base_off); break;
+        case OP_LEA: r[dr] = pc_off; break;
+        default:
+            set_cc = 0;
+            switch (instr >> 12)
+            {
+                case OP_BR:  if (dr & r[R_COND]) { r[R_PC] = pc_off; } break;
+                case OP_ST:  batch_lane_write(lane, pc_off, r[dr]); break;
+                case OP_STI: batch_lane_write(lane, batch_lane_read(lane, pc_off), r[dr]); break;
+                case OP_STR: batch_lane_write(lane, base_off, r[dr]); break;
+                case OP_JMP: r[R_PC] = r[sr1]; break;
+                case OP_JSR:
+                {
+                    uint16_t base = r[sr1];
+                    r[R_R7] = r[R_PC];
+                    r[R_PC] = (instr >> 11) & 1 ? r[R_PC] + sign_extend(instr & 0x7FF, 11) : base;
+                    break;
+                }
+                case OP_TRAP:
+                    r[R_R7] = r[R_PC];
+                    batch_lane_trap(lane, r, instr & 0xFF);
+                    break;
+                default: /* RTI, reserved: the lane stops on it, as the table engine does */
+                    r[R_PC] = pc;
+                    printf("illegal opcode x%X at x%04X (lane %u)\n", instr >> 12, (unsigned)pc, (unsigned)lane);
+                    batch_live[lane] = 0;
+                    --batch_stats.instr; /* counted by batch_step, not retired */
+                    break;
+            }
+    }
+    if (set_cc) { r[R_COND] = cond_of(r[dr]); }
+    for (int i = 0; i < R_COUNT; ++i) { batch_r(i)[lane] = r[i]; }
+}
+
+static inline LVec batch_cond(LVec v)
+{
+    LVec cc = lv_select(lv_eq(v, lv_splat(0)), lv_splat(FL_ZRO), lv_splat(FL_POS));
+    return lv_select(lv_neg(v), lv_splat(FL_NEG), cc);
+}
+
+/* runs `instr` at `pc` for every lane parked there; returns the lowest PC
+   of the lanes still running afterwards */
+static uint16_t batch_step(uint16_t pc, uint16_t instr)
+{
+    const uint16_t op       = instr >> 12;
+    const uint16_t dr       = (instr >> 9) & 0x7;
+    const uint16_t sr1      = (instr >> 6) & 0x7;
+    const int      imm      = (instr >> 5) & 1;
+    const uint16_t next     = pc + 1;
+    const uint16_t pc_off   = next + sign_extend(instr & 0x1FF, 9);
+    const uint16_t off6     = sign_extend(instr & 0x3F, 6);
+    const uint16_t jsr_dest = next + sign_extend(instr & 0x7FF, 11);
+    const int scalar = op == OP_TRAP || op == OP_LDI || op == OP_STI || op == OP_RTI || op == OP_RES
+                    || ((op == OP_LD || op == OP_ST) && devices.io_page(pc_off));
+
+    const LVec v_pc = lv_splat(pc), v_instr = lv_splat(instr), v_next = lv_splat(next);
+    const LVec v_ones = lv_splat(0xFFFF), v_imm = lv_splat(sign_extend(instr & 0x1F, 5));
+    LVec v_min = v_ones;
+
+    uint16_t* const rd   = batch_r(dr);
+    uint16_t* const rs1  = batch_r(sr1);
+    uint16_t* const rs2  = batch_r(instr & 0x7);
+    uint16_t* const rpc  = batch_r(R_PC);
+    uint16_t* const rcc  = batch_r(R_COND);
+    uint16_t* const code = batch_word(pc);
+
+    ++batch_stats.steps;
+    for (uint32_t c = 0; c < batch_w; c += LANE_W)
+    {
+        LMask m = lv_mand(lv_mand(lv_eq(lv_load(rpc + c), v_pc), lv_eq(lv_load(batch_live + c), v_ones)),
+                          lv_eq(lv_load(code + c), v_instr));
+        uint32_t bits = lv_bits(m);
+
+/* masked write-back: only lanes in m change */
+#define PUT(p, v) lv_store((p) + c, lv_select(m, (v), lv_load((p) + c)))
+        if (bits)
+        {
+            batch_stats.instr += lv_popcount(bits);
+            if (scalar)
+            {
+                batch_stats.scalar += lv_popcount(bits);
+                for (; bits; bits &= bits - 1) { batch_lane_step(c + lv_ctz(bits)); }
+            }
+            else switch (op)
+            {
+                case OP_ADD:
+                case OP_AND:
+                case OP_NOT:
+                case OP_LEA:
+                case OP_LD:
+                {
+                    LVec v;
+                    if (op == OP_LEA)      { v = lv_splat(pc_off); }
+                    else if (op == OP_LD)  { v = lv_load(batch_word(pc_off) + c); }
+                    else if (op == OP_NOT) { v = lv_not(lv_load(rs1 + c)); }
+                    else
+                    {
+                        LVec b = imm ? v_imm : lv_load(rs2 + c);
+                        v = op == OP_ADD ? lv_add(lv_load(rs1 + c), b) : lv_and(lv_load(rs1 + c), b);
+                    }
+                    PUT(rd, v);
+                    PUT(rcc, batch_cond(v));
+                    PUT(rpc, v_next);
+                    break;
+                }
+                case OP_ST:
+                    PUT(batch_word(pc_off), lv_load(rd + c));
+                    PUT(rpc, v_next);
+                    break;
+                case OP_BR:
+                {
+                    LMask taken = lv_test(lv_load(rcc + c), lv_splat(dr));
+                    PUT(rpc, lv_select(taken, lv_splat(pc_off), v_next));
+                    break;
+                }
+                case OP_JMP:
+                    PUT(rpc, lv_load(rs1 + c));
+                    break;
+                case OP_JSR:
+                {
+                    LVec base = lv_load(rs1 + c);
+                    PUT(batch_r(R_R7), v_next);
+                    PUT(rpc, (instr >> 11) & 1 ? lv_splat(jsr_dest) : base);
+                    break;
+                }
+                case OP_LDR:
+                case OP_STR:
+                    for (; bits; bits &= bits - 1)
+                    {
+                        uint32_t lane    = c + lv_ctz(bits);
+                        uint16_t address = rs1[lane] + off6;
+                        if (devices.io_page(address))
+                        {
+                            ++batch_stats.scalar;
+                            batch_lane_step(lane);
+                            continue;
+                        }
+                        if (op == OP_STR)
+                        {
+                            batch_word(address)[lane] = rd[lane];
+                        }
+                        else
+                        {
+                            rd[lane]  = batch_word(address)[lane];
+                            rcc[lane] = cond_of(rd[lane]);
+                        }
+                        rpc[lane] = next;
+                    }
+                    break;
+            }
+        }
+#undef PUT
+        LMask live = lv_eq(lv_load(batch_live + c), v_ones);
+        v_min = lv_min(v_min, lv_select(live, lv_load(rpc + c), v_ones));
+    }
+    return lv_hmin(v_min);
+}
+
+/* runs every lane to HALT; returns lane-instructions executed */
+static uint64_t run_batch()
+{
+    const LVec v_ones = lv_splat(0xFFFF);
+    uint16_t pc = 0;
+    for (uint32_t lane = 0; lane < batch_k; ++lane)
+    {
+        if (lane == 0 || batch_r(R_PC)[lane] < pc) { pc = batch_r(R_PC)[lane]; }
+    }
+    for (;;)
+    {
+        /* the first running lane at pc supplies the word to execute */
+        uint32_t leader = batch_w;
+        const LVec v_pc = lv_splat(pc);
+        for (uint32_t c = 0; c < batch_w; c += LANE_W)
+        {
+            uint32_t bits = lv_bits(lv_mand(lv_eq(lv_load(batch_r(R_PC) + c), v_pc),
+                                            lv_eq(lv_load(batch_live + c), v_ones)));
+            if (bits)
+            {
+                leader = c + lv_ctz(bits);
+                break;
+            }
+        }
+        if (leader == batch_w) { break; } /* every lane has halted */
+        pc = batch_step(pc, batch_word(pc)[leader]);
+    }
+    return batch_stats.instr;
+}
+
+/* --batch K: run the K lanes, then the same K inputs one at a time through
+   the table engine, and compare throughput and final registers */
+static void batch_main(uint16_t start)
+{
+    static uint16_t image[MEMORY_MAX];
+    memcpy(image, memory, sizeof(image));
+    if (!batch_init(batch_k, start))
+    {
+        printf("--batch %u: cannot allocate %zu MB of lane memory\n", batch_k,
+               sizeof(uint16_t) * MEMORY_MAX * (size_t)batch_w >> 20);
+        exit(1);
+    }
+    halt_quiet = 1;
+
+    using clock = std::chrono::high_resolution_clock;
+    auto     t0       = clock::now();
+    uint64_t batch_n  = run_batch();
+    double   batch_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+
+    uint64_t scalar_n   = 0;
+    double   scalar_ns  = 0;
+    uint32_t mismatched = 0;
+    for (uint32_t lane = 0; lane < batch_k; ++lane)
+    {
+        memcpy(memory, image, sizeof(image));
+        memset(reg, 0, sizeof(reg));
+        reg[R_R0] = (uint16_t)lane;
+        reg[R_R1] = (uint16_t)batch_k;
+        reg[R_PC] = start;
+        running   = 1;
+        auto t1 = clock::now();
+        while (running) { scalar_n += run_table(1 << 16); }
+        scalar_ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t1).count();
+        for (int r = 0; r < R_COUNT; ++r)
+        {
+            if (reg[r] != batch_r(r)[lane])
+            {
+                ++mismatched;
+                break;
+            }
+        }
+    }
+
+    double batch_mips  = batch_ns ? batch_n * 1e3 / batch_ns : 0;
+    double scalar_mips = scalar_ns ? scalar_n * 1e3 / scalar_ns : 0;
+    console.stop();
+    printf("\n===== LC-3 Batch =====\n");
+    printf("Lanes    : %u (%s, %d lanes per op)\n", batch_k, LANE_ISA, LANE_W);
+    printf("Batch    : %llu instructions in %.3f ms, %.2f M instr/s\n",
+           static_cast<unsigned long long>(batch_n), batch_ns / 1e6, batch_mips);
+    printf("Lockstep : %llu steps, %.1f lanes/step, %llu lane-instructions scalar\n",
+           static_cast<unsigned long long>(batch_stats.steps),
+           batch_stats.steps ? (double)batch_n / batch_stats.steps : 0.0,
+           static_cast<unsigned long long>(batch_stats.scalar));
+    printf("Scalar   : %llu instructions in %.3f ms, %.2f M instr/s (table engine, one input at a time)\n",
+           static_cast<unsigned long long>(scalar_n), scalar_ns / 1e6, scalar_mips);
+    printf("Speedup  : %.2fx\n", scalar_mips ? batch_mips / scalar_mips : 0.0);
+    printf("Mismatch : %u lanes\n", mismatched);
+    printf("======================\n");
+}
+
+enum
+{
+    ENGINE_TABLE = 0,
+    ENGINE_THREADED,
+    ENGINE_BLOCK,
+    ENGINE_JIT,
+    ENGINE_PROFILE,
+    ENGINE_AOT,
+    ENGINE_SAMPLE,
+    ENGINE_COUNT
+};
+static const char* engine_names[ENGINE_COUNT] = { "table", "threaded", "block", "jit", "profile", "aot", "sample" };
+static uint64_t (*engine_run[ENGINE_COUNT])(uint64_t) = {
+    run_table, run_threaded, run_block, run_jit, run_profile, run_aot, run_sample
+};
+
+int main(int argc, const char* argv[])
+{
+    int engine = ENGINE_TABLE;
+    int images = 0;
+    const char* aot_path = NULL;
+    const char* convert_path = NULL;
+    const char* telemetry_path = NULL;
+    unsigned    telemetry_ms = 100;
+    const char* image_path = NULL;
+    uint64_t    max_instr = UINT64_MAX;
+    int         json = 0;
+    const char* sample_path = NULL;
+    unsigned    sample_us = 1000;
+    devices_init();
+    for (int j = 1; j < argc; ++j)
+    {
+        if (strcmp(argv[j], "--engine") == 0 && j + 1 < argc)
+        {
+            const char* name = argv[++j];
+            for (engine = 0; engine < ENGINE_COUNT; ++engine)
+            {
+                if (strcmp(name, engine_names[engine]) == 0) { break; }
+            }
+            if (engine == ENGINE_COUNT)
+            {
+                printf("unknown engine: %s\n", name);
+                exit(2);
+            }
+            continue;
+        }
+        if (strcmp(argv[j], "--profile") == 0)
+        {
+            engine = ENGINE_PROFILE;
+            continue;
+        }
+        if (strcmp(argv[j], "--lazy-flags") == 0)
+        {
+            lazy_flags = 1;
+            continue;
+        }
+        if (strcmp(argv[j], "--superinstr") == 0)
+        {
+            fuse_enabled = 1;
+            continue;
+        }
+        if (strcmp(argv[j], "--aot") == 0 && j + 1 < argc)
+        {
+            aot_path = argv[++j];
+            engine   = ENGINE_AOT;
+            continue;
+        }
+        if (strcmp(argv[j], "--convert") == 0 && j + 1 < argc)
+        {
+            convert_path = argv[++j];
+            continue;
+        }
+        if (strcmp(argv[j], "--batch") == 0 && j + 1 < argc)
+        {
+            batch_k = (uint32_t)atoi(argv[++j]);
+            continue;
+        }
+        if (strcmp(argv[j], "--telemetry") == 0 && j + 1 < argc)
+        {
+            telemetry_path = argv[++j];
+            continue;
+        }
+        if (strcmp(argv[j], "--telemetry-ms") == 0 && j + 1 < argc)
+        {
+            telemetry_ms = (unsigned)atoi(argv[++j]);
+            continue;
+        }
+        if (strcmp(argv[j], "--sample-profile") == 0 && j + 1 < argc)
+        {
+            sample_path = argv[++j];
+            engine      = ENGINE_SAMPLE;
+            continue;
+        }
+        if (strcmp(argv[j], "--sample-us") == 0 && j + 1 < argc)
+        {
+            sample_us = (unsigned)atoi(argv[++j]);
+            continue;
+        }
+        if (strcmp(argv[j], "--max-instr") == 0 && j + 1 < argc)
+        {
+            max_instr = strtoull(argv[++j], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[j], "--json") == 0)
+        {
+            json = 1;
+            continue;
+        }
+        if (strcmp(argv[j], "--interp-only") == 0)
+        {
+            jit_disabled = 1;
+            continue;
+        }
+        if (strcmp(argv[j], "--jit-threshold") == 0 && j + 1 < argc)
+        {
+            jit_threshold = (uint32_t)atoi(argv[++j]);
+            continue;
+        }
+        if (!read_image(argv[j]))
+        {
+            printf("failed to load image: %s\n", argv[j]);
+            exit(1);
+        }
+        image_path = argv[j];
+        ++images;
+    }
+    if (images == 0)
+    {
+        /* show usage string */
+        printf("lc3 [--engine table|threaded|block|jit|aot] [--lazy-flags] [--superinstr] [--profile]\n"
+               "    [--interp-only] [--jit-threshold N] [--aot module] [--batch K] [--convert out.lc3i]\n"
+               "    [--telemetry snapshot-file] [--telemetry-ms N] [--max-instr N] [--json]\n"
+               "    [--sample-profile PREFIX] [--sample-us N]\n"
+               "    [image-file1 (.obj or .lc3i)] ...\n");
+        exit(2);
+    }
+    if (convert_path)
+    {
+        if (!convert_image(convert_path))
+        {
+            printf("failed to write image: %s\n", convert_path);
+            exit(1);
+        }
+        printf("wrote %s: x%04X, %u words\n", convert_path, image_lo, image_hi - image_lo);
+        return 0;
+    }
+    if (aot_path && !aot_load(aot_path))
+    {
+        exit(1);
+    }
+    if (telemetry_path && !LC3_TELEMETRY)
+    {
+        printf("--telemetry: built without LC3_TELEMETRY\n");
+        exit(2);
+    }
+    Telemetry telemetry;
+#if LC3_TELEMETRY
+    telemetry.add("lc3", &vm_counters);
+#endif
+    if (telemetry_path && !telemetry.start(telemetry_path, telemetry_ms))
+    {
+        printf("failed to open telemetry snapshot: %s\n", telemetry_path);
+        exit(1);
+    }
+    if (loaded_image && (engine == ENGINE_BLOCK || engine == ENGINE_JIT || engine == ENGINE_AOT
+                         || engine == ENGINE_SAMPLE))
+    {
+        prebuild_blocks();
+    }
+    signal(SIGINT, handle_interrupt);
+    disable_input_buffering();
+    console.start();
+
+    enum { PC_START = 0x3000 };
+    reg[R_PC] = PC_START;
+    if (batch_k)
+    {
+        batch_main(PC_START);
+        restore_input_buffering();
+        return 0;
+    }
+
+    if (sample_path)
+    {
+        prof_load_symbols(image_path ? image_path : "");
+        prof_start(PC_START, sample_us ? sample_us : 1);
+    }
+
+   /* ▶ —– Stop-watch variables —– */
+    using clock   = std::chrono::high_resolution_clock;
+    auto  t_start = clock::now();
+    uint64_t instr_count = 0;      // counts executed instructions
+    /* ▶––––––––––––––––––––––––––– */
+
+    while (running && instr_count < max_instr)
+{
+    /* engines run in slices so the banner check is off the per-instruction path;
+       block-based engines may finish their last block past --max-instr */
+    uint64_t left  = max_instr - instr_count;
+    uint64_t slice = engine_run[engine](left < (1 << 16) ? left : (1 << 16));
+    instr_count += slice;
+    LC3_COUNT(vm_counters, instr, slice);
+
+/* ---------- live-stats banner (refresh every 100 ms) ---------- */
+/* with --telemetry the snapshot file takes its place; --json runs headless */
+static auto last_print = clock::now();
+auto now = clock::now();
+if (!telemetry_path && !json && now - last_print >= std::chrono::milliseconds(100)) {
+    last_print = now;
+
+    uint64_t ns_tot = std::chrono::duration_cast<
+                        std::chrono::nanoseconds>(now - t_start).count();
+    double   ns_pi  = static_cast<double>(ns_tot) / instr_count;
+    double   mips   = 1e3 / ns_pi;   // (1e9 / ns) / 1e6
+
+    /* one write through the console, so it cannot split guest output */
+    char banner[128];
+    int len = snprintf(banner, sizeof(banner),
+                       "\033[s"         // save cursor
+                       "\033[15;1H"     // move to row 15, col 1 (adjust if needed)
+                       "\033[K"         // clear line
+                       "Instr: %10llu | %.1f ns/op | %.2f MIPS"
+                       "\033[u",        // restore cursor
+                       static_cast<unsigned long long>(instr_count),
+                       ns_pi, mips);
+    console.write(banner, (size_t)len);
+}
+/* ------------------------------------------------------------- */
+
+/* ----------------------------------------------- */
+
+/* ----------------------------------------------- */
+
+}
+
+
+    /* ▶ —– Stop-watch: print results —– */
+    auto t_end   = clock::now();
+    console.stop();
+    telemetry.stop();
+    prof_stop();
+    auto ns_total =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t_end - t_start).count();
+
+    /* 0 for both when nothing retired (an illegal first opcode), so --json stays valid */
+    double ns_per_instr = instr_count ? static_cast<double>(ns_total) / instr_count : 0.0;
+    double ips          = ns_per_instr > 0 ? 1e9 / ns_per_instr : 0.0;   // instr per second
+
+    if (json)
+    {
+        /* one line for bench.py and other scripts; guest output comes before it */
+        printf("\n{\"image\": \"");
+        for (const char* c = image_path; *c; ++c)
+        {
+            if (*c == '\\' || *c == '"') { putchar('\\'); }
+            putchar(*c);
+        }
+        printf("\", \"engine\": \"%s\", \"instructions\": %llu, \"ns\": %lld, "
+               "\"ns_per_instr\": %.3f, \"mips\": %.3f, \"halted\": %s}\n",
+               engine_names[engine], static_cast<unsigned long long>(instr_count),
+               static_cast<long long>(ns_total), ns_per_instr, ips / 1e6, running ? "false" : "true");
+        restore_input_buffering();
+        return 0;
+    }
+
+    printf("\n===== LC-3 Benchmark =====\n");
+    printf("Executed : %llu instructions\n", static_cast<unsigned long long>(instr_count));
+    printf("Elapsed  : %.3f ms\n", ns_total / 1e6);
     printf("Latency  : %.1f ns / instr\n", ns_per_instr);
     printf("Throughput: %.2f M instr/s\n", ips / 1e6);
+    if (engine == ENGINE_BLOCK)
+    {
+        printf("Blocks   : %llu built, %llu rebuilt, %llu flushes\n",
+               static_cast<unsigned long long>(block_stats.built),
+               static_cast<unsigned long long>(block_stats.rebuilt),
+               static_cast<unsigned long long>(block_stats.flushes));
+        printf("Entries  : %llu (%.1f instr / entry)\n",
+               static_cast<unsigned long long>(block_stats.entries),
+               block_stats.entries ? static_cast<double>(instr_count) / block_stats.entries : 0.0);
+    }
+    if (engine == ENGINE_PROFILE)
+    {
+        print_profile();
+    }
+    if (sample_path && !prof_write(sample_path))
+    {
+        printf("failed to write sample profile: %s.*\n", sample_path);
+    }
+    if (engine == ENGINE_AOT)
+    {
+        printf("AOT      : %u blocks loaded, %llu entries, %llu dropped\n",
+               aot_module ? aot_module->block_count : 0u,
+               static_cast<unsigned long long>(aot_stats.entries),
+               static_cast<unsigned long long>(aot_stats.dropped));
+        printf("Fallback : %llu instructions in the block engine\n",
+               static_cast<unsigned long long>(aot_stats.fallback));
+    }
+    if (engine == ENGINE_JIT)
+    {
+        printf("JIT      : %s, %llu blocks compiled, %zu bytes, %llu flushes\n",
+               jit_disabled ? "off (interpreter only)" : "on",
+               static_cast<unsigned long long>(jit_stats.compiled), jit_used,
+               static_cast<unsigned long long>(jit_stats.flushes));
+        printf("Native   : %llu entries, %llu side exits\n",
+               static_cast<unsigned long long>(jit_stats.entries),
+               static_cast<unsigned long long>(jit_stats.side_exits));
+    }
     printf("==========================\n");
     /* ▶––––––––––––––––––––––––––– */
     restore_input_buffering();
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+
+// Interface between the VM and ahead-of-time translated images (aot.py).
+// A module is a shared library that exports lc3_aot_module(); every
+// translated basic block runs against the VM's own reg/memory arrays and
+// calls back into it for device reads, stores and traps.
+
+#if defined(_WIN32)
+#define LC3_AOT_EXPORT extern "C" __declspec(dllexport)
+#else
+#define LC3_AOT_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+enum { LC3_AOT_VERSION = 1 };
+
+struct Lc3AotEnv {
+    uint16_t* reg;                                  // R0-R7, PC, COND
+    uint16_t* memory;
+    uint16_t (*mem_read)(uint16_t address);         // device page reads
+    void     (*mem_write)(uint16_t address, uint16_t val);
+    void     (*trap)(uint16_t vector);              // reg[R_PC] already points past the TRAP
+    const int* invalidated;                         // set by mem_write when it hits translated code
+    uint16_t (* const* entry)(uint64_t*, uint64_t); // live blocks by PC, NULL once dropped
+};
+
+// Runs one block and returns the next guest PC; *n is advanced by the
+// number of instructions executed (less than len after a store into
+// translated code, which leaves the block right after the store). Blocks
+// chain into translated successors until *n reaches budget.
+typedef uint16_t (*Lc3AotFn)(uint64_t* n, uint64_t budget);
+
+struct Lc3AotBlock {
+    uint16_t pc;
+    uint16_t len;
+    Lc3AotFn fn;
+};
+
+struct Lc3AotModule {
+    uint32_t           version;
+    uint16_t           origin;      // the image the module was built from
+    uint32_t           image_len;
+    const uint16_t*    image;
+    uint32_t           block_count;
+    const Lc3AotBlock* blocks;
+    void             (*init)(const Lc3AotEnv* env);
+};
+
+typedef const Lc3AotModule* (*Lc3AotModuleFn)(void);
@@ -0,0 +1,181 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "ring_buffer.hpp"
+#include "lc3_devices.hpp"
+#if defined(_WIN32)
+#include <Windows.h>
+#include <conio.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Console I/O off the VM thread. The VM pushes output into one SPSC ring
+// and takes keys from another; a dedicated I/O thread drains the output
+// with one write per batch and feeds keys in, so the VM thread never makes
+// a console syscall. getc() parks the VM thread while no key is waiting,
+// and putc() only yields when the output ring is full. Once stdin is at
+// end of file and every key has been taken, getc() returns EOF.
+//
+// One VM thread uses the VM side (putc/write/try_getc/getc); printf output
+// from that thread must wait until stop().
+
+class Console {
+public:
+    enum { OUT_SIZE = 1 << 16, IN_SIZE = 256, KEY_POLL_MS = 1 };
+
+    ~Console() { stop(); }
+
+    void start() {
+        if (io.joinable()) return;
+        fflush(stdout); // whatever was printed before goes out first
+        quit.store(false, std::memory_order_relaxed);
+        io = std::thread([this] { service(); });
+    }
+
+    // writes out everything queued so far and joins the I/O thread
+    void stop() {
+        if (!io.joinable()) return;
+        quit.store(true, std::memory_order_release);
+        io.join();
+    }
+
+    void putc(char c) {
+        while (!out.push(c)) std::this_thread::yield();
+    }
+    void write(const char* s, size_t n) {
+        while (n) {
+            size_t done = out.push_bulk(s, n);
+            if (!done) std::this_thread::yield();
+            s += done;
+            n -= done;
+        }
+    }
+
+    bool try_getc(char& c) { return in.pop(c); }
+    int getc() {
+        char c;
+        if (in.pop(c)) return (uint8_t)c;
+        bool got = false;
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&] { return (got = in.pop(c)) || input_eof.load(std::memory_order_acquire); });
+        return got || in.pop(c) ? (uint8_t)c : EOF;
+    }
+
+private:
+    RingBuffer<char, OUT_SIZE> out;
+    RingBuffer<char, IN_SIZE> in;
+    std::thread io;
+    std::atomic<bool> quit{ false };
+    std::mutex lock;
+    std::condition_variable wake;
+    std::atomic<bool> input_eof{ false };
+    char batch[OUT_SIZE]; // I/O thread only
+
+    void service() {
+        for (;;) {
+            bool quitting = quit.load(std::memory_order_acquire);
+            size_t n = out.pop_bulk(batch, sizeof(batch));
+            if (n) {
+                host_write(batch, n);
+                continue;
+            }
+            if (quitting) break; // the VM stopped before stop(): all drained
+            int c = host_key(KEY_POLL_MS);
+            if (c < 0) continue;
+            while (!in.push((char)c)) { // a full ring waits for the guest
+                if (quit.load(std::memory_order_acquire)) return;
+                std::this_thread::yield();
+            }
+            { std::lock_guard<std::mutex> guard(lock); }
+            wake.notify_one();
+        }
+    }
+
+    static void host_write(const char* s, size_t n) {
+#if defined(_WIN32)
+        DWORD done;
+        WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), s, (DWORD)n, &done, NULL);
+#else
+        while (n) {
+            ssize_t done = ::write(1, s, n);
+            if (done <= 0) return;
+            s += done;
+            n -= (size_t)done;
+        }
+#endif
+    }
+
+    // next key, or -1 after waiting up to ms without one
+    int host_key(int ms) {
+#if defined(_WIN32)
+        if (_kbhit()) return getchar();
+        Sleep(ms);
+        return -1;
+#else
+        if (input_eof.load(std::memory_order_relaxed)) {
+            poll(nullptr, 0, ms);
+            return -1;
+        }
+        pollfd p = { 0, POLLIN, 0 };
+        if (poll(&p, 1, ms) <= 0) return -1;
+        unsigned char c;
+        if (read(0, &c, 1) == 1) return c;
+        { // stdin closed: stop polling it and let a parked getc() see EOF
+            std::lock_guard<std::mutex> guard(lock);
+            input_eof.store(true, std::memory_order_release);
+        }
+        wake.notify_one();
+        return -1;
+#endif
+    }
+};
+
+// KBSR/KBDR on the console: KBSR is ready while a key is held, reading
+// KBDR takes it
+class ConsoleKeyboard : public Lc3Device {
+public:
+    explicit ConsoleKeyboard(Console& console) : console(console) {}
+
+    uint16_t read(uint16_t addr) override {
+        if (!held) held = console.try_getc(key);
+        if (addr == MR_KBSR) return held ? 1 << 15 : 0;
+        held = false;
+        return (uint16_t)(uint8_t)key;
+    }
+    void write(uint16_t, uint16_t) override {}
+
+    void map_on(DeviceBus& bus) {
+        bus.map(MR_KBSR, 1, this);
+        bus.map(MR_KBDR, 1, this);
+    }
+
+private:
+    Console& console;
+    char key = 0;
+    bool held = false;
+};
+
+// DSR/DDR on the console
+class ConsoleDisplay : public Lc3Device {
+public:
+    explicit ConsoleDisplay(Console& console) : console(console) {}
+
+    uint16_t read(uint16_t addr) override { return addr == MR_DSR ? 1 << 15 : 0; }
+    void write(uint16_t addr, uint16_t val) override {
+        if (addr == MR_DDR) console.putc((char)val);
+    }
+
+    void map_on(DeviceBus& bus) {
+        bus.map(MR_DSR, 1, this);
+        bus.map(MR_DDR, 1, this);
+    }
+
+private:
+    Console& console;
+};
@@ -0,0 +1,281 @@
+#pragma once
+#include <stdint.h>
+
+// The LC-3 instruction set, once, for every front end. Lc3Core runs over
+// the front end's own registers (R0-R7, PC, COND) and is specialized at
+// compile time by four policies, all called inline through members:
+//
+//   Memory  fetch(addr), read(addr), write(addr, val) and a constexpr
+//           `stalls`. When it is true, stalled() after each access says it
+//           could not complete (a channel register that would wait) and
+//           the core abandons the instruction before it writes a register
+//   Traps   trap(reg, vector); false stalls the TRAP the same way
+//   Flags   EagerFlags keeps COND current; LazyFlags keeps the last result
+//           and works out N/Z/P only when a BR tests it
+//   Hooks   retire(op) after every instruction, trap(vector) before every
+//           TRAP; NoHooks compiles to nothing. A constexpr `interrupts`
+//           turns on the interrupt model below; without it illegal(instr)
+//           is called for RTI and the reserved opcode
+//
+// Each opcode is its own exec<Op>() with the decode it needs and nothing
+// else, and run() is a single switch over them. A stalled instruction is
+// not counted; putting PC back on it for the retry is up to the policy.
+//
+// Interrupts (Hooks::interrupts) follow the LC-3 model, with the
+// privileged registers in sys. They are only looked for where a block
+// ends (a taken BR, JMP, JSR, TRAP or RTI) and only when hooks.pending()
+// says so, so straight-line code never pays for them. poll(vector) then
+// names the most urgent request and its priority, taken if above the PSR's.
+// Entry moves a user-mode program to the supervisor stack (R6 <->
+// Saved_SSP), pushes PSR and PC, raises the priority and jumps through the
+// vector table at x0100. RTI pops them and looks again; in user mode it is
+// a privilege exception (x00), and the reserved opcode is an illegal
+// opcode exception (x01). Without interrupts both are illegal: the core
+// puts PC back on the instruction, calls hooks.illegal() and stops as for
+// a stall, so the policy halts the program.
+
+enum { LC3_R6 = 6, LC3_R7 = 7, LC3_PC = 8, LC3_COND = 9 };
+enum {
+    LC3_PSR_USER = 0x8000,  // PSR bit 15: user mode
+    LC3_PSR_PRIORITY = 0x0700,
+    LC3_IVT = 0x0100,       // interrupt vector table, x0100-x01FF
+    LC3_VEC_PRIVILEGE = 0x00,
+    LC3_VEC_ILLEGAL = 0x01
+};
+
+// privileged state; the PSR's N/Z/P bits live in COND
+struct Lc3System {
+    uint16_t psr = LC3_PSR_USER; // user mode, priority 0
+    uint16_t saved_usp = 0;
+    uint16_t saved_ssp = 0x3000; // the supervisor stack grows down from here
+};
+
+// the dispatch is forced into run(); traps are kept out of it so the
+// loop does not pay for their register pressure
+#if defined(_MSC_VER)
+#define LC3_INLINE __forceinline
+#define LC3_NOINLINE __declspec(noinline)
+#else
+#define LC3_INLINE inline __attribute__((always_inline))
+#define LC3_NOINLINE __attribute__((noinline))
+#endif
+
+struct EagerFlags {
+    static uint16_t nzp(uint16_t v) { return (uint16_t)(1 << ((v == 0) + 2 * (v >> 15))); }
+
+    void set(uint16_t* reg, uint16_t v) { reg[LC3_COND] = nzp(v); }
+    bool test(const uint16_t* reg, uint16_t cond) const { return (cond & reg[LC3_COND]) != 0; }
+    void load(const uint16_t*) {}
+    void sync(uint16_t*) const {}
+};
+
+// COND is only written back by sync(), at the end of run() and around
+// traps; load() takes a COND of 0 (nothing set yet) as P
+struct LazyFlags {
+    uint16_t last = 1;
+
+    void set(uint16_t*, uint16_t v) { last = v; }
+    bool test(const uint16_t*, uint16_t cond) const { return (cond & EagerFlags::nzp(last)) != 0; }
+    void load(const uint16_t* reg) {
+        uint16_t c = reg[LC3_COND];
+        last = c == 2 ? 0 : c == 4 ? 0x8000 : 1;
+    }
+    void sync(uint16_t* reg) const { reg[LC3_COND] = EagerFlags::nzp(last); }
+};
+
+struct NoHooks {
+    static constexpr bool interrupts = false;
+    void retire(uint16_t) {}
+    void trap(uint8_t) {}
+    void illegal(uint16_t) {} // run() returns short, PC on the instruction
+};
+
+template <class Memory, class Traps, class Flags = EagerFlags, class Hooks = NoHooks>
+class Lc3Core {
+public:
+    uint16_t* reg;
+    Memory mem;
+    Traps traps;
+    Flags flags;
+    Hooks hooks;
+    Lc3System sys;
+
+    explicit Lc3Core(uint16_t* reg, Memory mem = Memory(), Traps traps = Traps(), Hooks hooks = Hooks())
+        : reg(reg), mem(mem), traps(traps), hooks(hooks) {}
+
+    // up to budget instructions while running holds; returns how many
+    // retired, stopping early at an instruction that stalled
+    template <class Running>
+    uint64_t run(uint64_t budget, const Running& running) {
+        flags.load(reg);
+        uint64_t n = 0;
+        while (running && n < budget) {
+            uint16_t instr = mem.fetch(reg[LC3_PC]++);
+            if (!step(instr)) break;
+            hooks.retire(instr >> 12);
+            ++n;
+        }
+        flags.sync(reg);
+        return n;
+    }
+
+    // one fetched instruction; false if it stalled
+    LC3_INLINE bool step(uint16_t instr) {
+        switch (instr >> 12) {
+            case 0x0: return exec<0x0>(instr);
+            case 0x1: return exec<0x1>(instr);
+            case 0x2: return exec<0x2>(instr);
+            case 0x3: return exec<0x3>(instr);
+            case 0x4: return exec<0x4>(instr);
+            case 0x5: return exec<0x5>(instr);
+            case 0x6: return exec<0x6>(instr);
+            case 0x7: return exec<0x7>(instr);
+            case 0x8: return exec<0x8>(instr);
+            case 0x9: return exec<0x9>(instr);
+            case 0xA: return exec<0xA>(instr);
+            case 0xB: return exec<0xB>(instr);
+            case 0xC: return exec<0xC>(instr);
+            case 0xD: return exec<0xD>(instr);
+            case 0xE: return exec<0xE>(instr);
+            default:  return exec<0xF>(instr);
+        }
+    }
+
+    template <unsigned Op>
+    LC3_INLINE bool exec(uint16_t instr) {
+        uint16_t* r = reg;
+        const uint16_t dr = (instr >> 9) & 7; // also SR of stores, nzp of BR
+        const uint16_t sr1 = (instr >> 6) & 7; // also BaseR
+        const uint16_t pc = r[LC3_PC];
+        if constexpr (Op == 0x0) { // BR
+            if (flags.test(r, dr)) {
+                r[LC3_PC] = pc + sext<9>(instr);
+                boundary();
+            }
+        } else if constexpr (Op == 0x1) { // ADD
+            r[dr] = r[sr1] + (instr & 0x20 ? sext<5>(instr) : r[instr & 7]);
+            flags.set(r, r[dr]);
+        } else if constexpr (Op == 0x5) { // AND
+            r[dr] = r[sr1] & (instr & 0x20 ? sext<5>(instr) : r[instr & 7]);
+            flags.set(r, r[dr]);
+        } else if constexpr (Op == 0x9) { // NOT
+            r[dr] = ~r[sr1];
+            flags.set(r, r[dr]);
+        } else if constexpr (Op == 0x2 || Op == 0x6 || Op == 0xA) { // LD, LDR, LDI
+            uint16_t addr = Op == 0x6 ? (uint16_t)(r[sr1] + sext<6>(instr)) : (uint16_t)(pc + sext<9>(instr));
+            if (Op == 0xA) {
+                addr = mem.read(addr);
+                if (stalled()) return false;
+            }
+            uint16_t v = mem.read(addr);
+            if (stalled()) return false;
+            r[dr] = v;
+            flags.set(r, v);
+        } else if constexpr (Op == 0x3 || Op == 0x7 || Op == 0xB) { // ST, STR, STI
+            uint16_t addr = Op == 0x7 ? (uint16_t)(r[sr1] + sext<6>(instr)) : (uint16_t)(pc + sext<9>(instr));
+            if (Op == 0xB) {
+                addr = mem.read(addr);
+                if (stalled()) return false;
+            }
+            mem.write(addr, r[dr]);
+            if (stalled()) return false;
+        } else if constexpr (Op == 0xE) { // LEA (sets the flags, as in the 2nd edition)
+            r[dr] = pc + sext<9>(instr);
+            flags.set(r, r[dr]);
+        } else if constexpr (Op == 0x4) { // JSR, JSRR
+            uint16_t base = r[sr1]; // before R7 is written: JSRR R7
+            r[LC3_R7] = pc;
+            r[LC3_PC] = instr & 0x800 ? (uint16_t)(pc + sext<11>(instr)) : base;
+            boundary();
+        } else if constexpr (Op == 0xC) { // JMP, RET
+            r[LC3_PC] = r[sr1];
+            boundary();
+        } else if constexpr (Op == 0xF) { // TRAP
+            if (!trap(instr)) return false;
+            boundary();
+        } else if constexpr (Op == 0x8 || Op == 0xD) { // RTI, reserved
+            if constexpr (!Hooks::interrupts) {
+                r[LC3_PC] = pc - 1;
+                hooks.illegal(instr);
+                return false;
+            } else if constexpr (Op == 0x8) {
+                rti();
+            } else {
+                exception(LC3_VEC_ILLEGAL);
+            }
+        }
+        return true;
+    }
+
+private:
+    LC3_NOINLINE bool trap(uint16_t instr) {
+        hooks.trap((uint8_t)instr);
+        reg[LC3_R7] = reg[LC3_PC];
+        flags.sync(reg); // traps read and write COND directly
+        bool done = traps.trap(reg, (uint8_t)instr);
+        flags.load(reg);
+        return done;
+    }
+
+    LC3_INLINE void boundary() {
+        if constexpr (Hooks::interrupts) {
+            if (hooks.pending()) interrupt();
+        }
+    }
+
+    LC3_NOINLINE void interrupt() {
+        uint8_t vector = 0;
+        int priority = hooks.poll(vector);
+        if (priority <= (sys.psr & LC3_PSR_PRIORITY) >> 8) return;
+        flags.sync(reg);
+        enter(vector, (uint16_t)priority);
+        flags.load(reg);
+    }
+
+    LC3_NOINLINE void exception(uint8_t vector) {
+        flags.sync(reg);
+        enter(vector, (sys.psr & LC3_PSR_PRIORITY) >> 8);
+        flags.load(reg);
+    }
+
+    // COND is current (synced) here
+    void enter(uint8_t vector, uint16_t priority) {
+        uint16_t psr = sys.psr | reg[LC3_COND];
+        if (sys.psr & LC3_PSR_USER) {
+            sys.saved_usp = reg[LC3_R6];
+            reg[LC3_R6] = sys.saved_ssp;
+        }
+        mem.write(--reg[LC3_R6], psr);
+        mem.write(--reg[LC3_R6], reg[LC3_PC]);
+        sys.psr = (uint16_t)(priority << 8); // supervisor
+        hooks.enter(vector);
+        reg[LC3_PC] = mem.read(LC3_IVT + vector);
+    }
+
+    LC3_NOINLINE void rti() {
+        if (sys.psr & LC3_PSR_USER) {
+            exception(LC3_VEC_PRIVILEGE);
+            return;
+        }
+        reg[LC3_PC] = mem.read(reg[LC3_R6]++);
+        uint16_t psr = mem.read(reg[LC3_R6]++);
+        sys.psr = psr & (LC3_PSR_USER | LC3_PSR_PRIORITY);
+        reg[LC3_COND] = psr & 7;
+        if (sys.psr & LC3_PSR_USER) {
+            sys.saved_ssp = reg[LC3_R6];
+            reg[LC3_R6] = sys.saved_usp;
+        }
+        flags.load(reg);
+        interrupt(); // one the old priority held off
+    }
+
+    bool stalled() {
+        if constexpr (Memory::stalls) return mem.stalled();
+        else return false;
+    }
+
+    template <int Bits>
+    static uint16_t sext(uint16_t x) {
+        return (uint16_t)((int16_t)(uint16_t)(x << (16 - Bits)) >> (16 - Bits));
+    }
+};
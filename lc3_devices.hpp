@@ -0,0 +1,104 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// Memory-mapped devices for the LC-3 VMs.
+//
+// DeviceBus keeps one attribute byte per 256-word page: zero for plain
+// RAM, nonzero when some device register lives on the page. Loads and
+// stores look at that byte only; words on a flagged page go to the device
+// mapped there (or to RAM when none is), everything else goes straight to
+// memory. Engines that resolve addresses at decode time (LD/ST, block and
+// JIT code) consult the table once per decoded instruction instead.
+//
+// Mappings hold raw device pointers, so the devices must outlive the bus.
+
+enum {
+    MR_KBSR = 0xFE00, // keyboard status: bit 15 set when a key is waiting
+    MR_KBDR = 0xFE02, // keyboard data: the key read by the last KBSR poll
+    MR_DSR  = 0xFE04, // display status: bit 15 set when DDR can be written
+    MR_DDR  = 0xFE06  // display data: writing prints the low byte
+};
+
+class Lc3Device {
+public:
+    virtual ~Lc3Device() {}
+    virtual uint16_t read(uint16_t addr) = 0;
+    virtual void write(uint16_t addr, uint16_t val) = 0;
+};
+
+class DeviceBus {
+public:
+    enum { PAGE_SHIFT = 8, PAGE_COUNT = 1 << (16 - PAGE_SHIFT), MAX_MAPPINGS = 8 };
+
+    bool io_page(uint16_t addr) const { return io[addr >> PAGE_SHIFT] != 0; }
+    const uint8_t* page_table() const { return io; } // for generated code
+
+    // words [base, base + words) answer to dev; false when the bus is full
+    bool map(uint16_t base, uint32_t words, Lc3Device* dev) {
+        if (n_maps == MAX_MAPPINGS || !words || base + words > 0x10000) return false;
+        maps[n_maps++] = { base, words, dev };
+        for (uint32_t p = base >> PAGE_SHIFT; p <= (base + words - 1) >> PAGE_SHIFT; ++p) io[p] = 1;
+        return true;
+    }
+
+    // device for one word of a flagged page; nullptr means plain RAM
+    Lc3Device* at(uint16_t addr) const {
+        for (int i = 0; i < n_maps; ++i) {
+            if ((uint32_t)(addr - maps[i].base) < maps[i].words) return maps[i].dev;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Mapping {
+        uint16_t base;
+        uint32_t words;
+        Lc3Device* dev;
+    };
+    uint8_t io[PAGE_COUNT]{};
+    Mapping maps[MAX_MAPPINGS]{};
+    int n_maps = 0;
+};
+
+// KBSR/KBDR: a KBSR read polls the host and latches the key into KBDR
+class KeyboardDevice : public Lc3Device {
+public:
+    explicit KeyboardDevice(int (*key_ready)()) : key_ready(key_ready) {}
+
+    uint16_t read(uint16_t addr) override {
+        if (addr != MR_KBSR) return kbdr;
+        if (!key_ready()) return 0;
+        kbdr = (uint16_t)getchar();
+        return 1 << 15;
+    }
+    void write(uint16_t, uint16_t) override {}
+
+    // what the next KBDR read returns, as if a KBSR poll had taken key
+    void latch(uint16_t key) { kbdr = key; }
+
+    void map_on(DeviceBus& bus) {
+        bus.map(MR_KBSR, 1, this);
+        bus.map(MR_KBDR, 1, this);
+    }
+
+private:
+    int (*key_ready)();
+    uint16_t kbdr = 0;
+};
+
+// DSR/DDR: always ready, DDR writes go to stdout
+class DisplayDevice : public Lc3Device {
+public:
+    uint16_t read(uint16_t addr) override { return addr == MR_DSR ? 1 << 15 : 0; }
+    void write(uint16_t addr, uint16_t val) override {
+        if (addr != MR_DDR) return;
+        putchar((char)val);
+        fflush(stdout);
+    }
+
+    void map_on(DeviceBus& bus) {
+        bus.map(MR_DSR, 1, this);
+        bus.map(MR_DDR, 1, this);
+    }
+};
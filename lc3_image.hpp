@@ -0,0 +1,181 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// .lc3i - native little-endian LC-3 image container, mapped read-only
+// with mmap/MapViewOfFile and used in place:
+//
+//   0             Lc3ImageHeader
+//   memory_off    all 65536 words of guest memory (4 KiB aligned)
+//   decoded_off   one Lc3ImageOp per word in [origin, origin + words)
+//   entries_off   65536-bit bitmap of basic-block entry words
+//
+// `lc3-vm --convert out.lc3i image.obj` writes one. The decoded table uses
+// that build's decode kinds, tagged with decode_version; a reader with a
+// different version ignores the table and decodes the words itself.
+//
+// lc3_image_open() keeps every image it loads (.lc3i or .obj) for the life
+// of the process, so VMs loading the same path share one read-only copy.
+
+enum { LC3I_VERSION = 1, LC3I_ALIGN = 4096 };
+
+struct Lc3ImageHeader {
+    char     magic[4];       // "LC3I"
+    uint16_t version;
+    uint16_t origin;
+    uint32_t words;          // image length from origin
+    uint32_t decode_version;
+    uint32_t memory_off, decoded_off, entries_off, file_size;
+};
+
+struct Lc3ImageOp {
+    uint16_t imm;            // sign-extended immediate or resolved PC-relative address
+    uint8_t  r0, r1, r2;
+    uint8_t  kind;
+    uint16_t reserved;
+};
+
+struct Lc3Image {
+    const uint16_t*   memory  = nullptr; // 65536 words
+    const Lc3ImageOp* decoded = nullptr; // nullptr for .obj
+    const uint8_t*    entries = nullptr; // nullptr for .obj
+    uint16_t origin = 0;
+    uint32_t words = 0;
+    uint32_t decode_version = 0;
+
+    bool is_entry(uint16_t pc) const { return entries && (entries[pc >> 3] >> (pc & 7) & 1); }
+    const Lc3ImageOp* op(uint16_t pc) const {
+        uint32_t i = (uint16_t)(pc - origin);
+        return decoded && i < words ? &decoded[i] : nullptr;
+    }
+};
+
+inline bool lc3_image_write(const char* path, const uint16_t* memory, uint16_t origin, uint32_t words,
+                            uint32_t decode_version, const Lc3ImageOp* ops, const uint8_t* entries) {
+    auto align = [](uint32_t off) { return (off + LC3I_ALIGN - 1) & ~(uint32_t)(LC3I_ALIGN - 1); };
+    Lc3ImageHeader h = {};
+    memcpy(h.magic, "LC3I", 4);
+    h.version = LC3I_VERSION;
+    h.origin = origin;
+    h.words = words;
+    h.decode_version = decode_version;
+    h.memory_off = align(sizeof(h));
+    h.decoded_off = h.memory_off + 65536 * sizeof(uint16_t);
+    h.entries_off = h.decoded_off + words * sizeof(Lc3ImageOp);
+    h.file_size = h.entries_off + 65536 / 8;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    static const uint8_t pad[LC3I_ALIGN] = {};
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+           && fwrite(pad, h.memory_off - sizeof(h), 1, f) == 1
+           && fwrite(memory, sizeof(uint16_t), 65536, f) == 65536
+           && fwrite(ops, sizeof(Lc3ImageOp), words, f) == words
+           && fwrite(entries, 65536 / 8, 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+// read-only mapping that is never unmapped
+inline const uint8_t* lc3_map_file(const char* path, size_t* size) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER len;
+    HANDLE mapping = GetFileSizeEx(file, &len) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    *size = (size_t)len.QuadPart;
+    return (const uint8_t*)p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    void* p = fstat(fd, &st) == 0 ? mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    *size = (size_t)st.st_size;
+    return (const uint8_t*)p;
+#endif
+}
+
+struct Lc3ImageSlot {
+    Lc3Image image;
+    std::unique_ptr<uint16_t[]> owned; // .obj contents; .lc3i files stay mapped instead
+};
+
+inline bool lc3_load_lc3i(const char* path, Lc3ImageSlot& slot) {
+    size_t size = 0;
+    const uint8_t* base = lc3_map_file(path, &size);
+    if (!base) return false;
+    const Lc3ImageHeader* h = (const Lc3ImageHeader*)base;
+    if (size < sizeof(*h) || memcmp(h->magic, "LC3I", 4) != 0 || h->version != LC3I_VERSION
+        || h->file_size > size || h->memory_off % LC3I_ALIGN
+        || (uint64_t)h->memory_off + 65536 * sizeof(uint16_t) > h->file_size
+        || (uint64_t)h->decoded_off + (uint64_t)h->words * sizeof(Lc3ImageOp) > h->file_size
+        || (uint64_t)h->entries_off + 65536 / 8 > h->file_size) {
+        return false;
+    }
+    slot.image.memory = (const uint16_t*)(base + h->memory_off);
+    slot.image.decoded = (const Lc3ImageOp*)(base + h->decoded_off);
+    slot.image.entries = base + h->entries_off;
+    slot.image.origin = h->origin;
+    slot.image.words = h->words;
+    slot.image.decode_version = h->decode_version;
+    return true;
+}
+
+// big-endian .obj: origin word, then the image
+inline bool lc3_load_obj(const char* path, Lc3ImageSlot& slot) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    uint16_t origin;
+    if (fread(&origin, sizeof(origin), 1, file) != 1) {
+        fclose(file);
+        return false;
+    }
+    origin = (uint16_t)((origin << 8) | (origin >> 8));
+    slot.owned.reset(new uint16_t[65536]());
+    uint16_t* p = slot.owned.get() + origin;
+    size_t words = fread(p, sizeof(uint16_t), 65536 - origin, file);
+    fclose(file);
+    for (size_t i = 0; i < words; ++i) p[i] = (uint16_t)((p[i] << 8) | (p[i] >> 8));
+    slot.image.memory = slot.owned.get();
+    slot.image.origin = origin;
+    slot.image.words = (uint32_t)words;
+    return true;
+}
+
+// nullptr when the file cannot be read; safe to call from several threads
+inline const Lc3Image* lc3_image_open(const char* path) {
+    static std::mutex lock;
+    static std::unordered_map<std::string, std::unique_ptr<Lc3ImageSlot>> cache;
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<Lc3ImageSlot>& slot = cache[path];
+    if (!slot) {
+        std::unique_ptr<Lc3ImageSlot> s(new Lc3ImageSlot());
+        size_t len = strlen(path);
+        bool lc3i = len > 5 && strcmp(path + len - 5, ".lc3i") == 0;
+        if (!(lc3i ? lc3_load_lc3i(path, *s) : lc3_load_obj(path, *s))) {
+            cache.erase(path);
+            return nullptr;
+        }
+        slot = std::move(s);
+    }
+    return &slot->image;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "vm_channel.hpp"
+
+// Interrupt sources of an LC3VM, beside the LC-3 interrupt model itself
+// (PSR, supervisor stack, vector table, RTI) in lc3_core.hpp.
+//
+// Registers on page xFE, each status register LC-3 style (bit 15 ready,
+// bit 14 interrupt enable):
+//   MR_TMR      timer status: bit 15 set when the period has run out;
+//               reading clears it
+//   MR_TMR_US   timer period in microseconds; a store (re)starts the
+//               timer, 0 stops it
+//   MR_BUSIR    bus status: bit 15 while a word is waiting (or the channel
+//               is closed and drained) on a channel in MR_BUSMASK
+//   MR_BUSMASK  bit n: channel n raises the bus interrupt
+//   MR_SSP      Saved_SSP, the stack an interrupt in user mode switches to
+//   MR_PSR      privilege (bit 15) and priority (bits 10-8); a store sets
+//               the priority, N/Z/P read as zero
+// The timer interrupts at priority 6 through x0181, the bus at 5 through
+// x0182. TRAP x26 (WAIT) sleeps until one of them can be taken.
+enum {
+    MR_TMR = 0xFE50,
+    MR_TMR_US = 0xFE51,
+    MR_BUSIR = 0xFE52,
+    MR_BUSMASK = 0xFE53,
+    MR_SSP = 0xFE54,
+    MR_PSR = 0xFFFC,
+    IRQ_REGS = 5 // MR_TMR..MR_SSP
+};
+enum { IRQ_READY = 1 << 15, IRQ_ENABLE = 1 << 14 };
+enum { VEC_TIMER = 0x81, VEC_BUS = 0x82, PL_TIMER = 6, PL_BUS = 5 };
+
+// Where a VM's interrupt check stands. The core looks for interrupts when
+// the instruction count reaches check_at: never while no source is enabled,
+// otherwise every POLL_INSTR instructions (the timer, and buses in other
+// processes, which cannot ring), and at the next block boundary once a
+// sender rings. A VM asleep in WAIT is woken by a ring or its timer, and
+// looks again every IDLE_POLL anyway.
+class Doorbell : public ChannelDoorbell {
+public:
+    enum : uint64_t { NEVER = UINT64_MAX, POLL_INSTR = 1024 };
+    static constexpr std::chrono::milliseconds IDLE_POLL{ 1 };
+
+    std::atomic<uint64_t> check_at{ NEVER };
+
+    // seq_cst against sleeping, so a ring cannot fall between the
+    // sleeper's last look and its wait
+    void ring() override {
+        check_at.store(0, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(m);
+            cv.notify_one();
+        }
+    }
+
+    // until rung or deadline
+    void sleep_until(std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(m);
+        sleeping.store(true, std::memory_order_seq_cst);
+        while (check_at.load(std::memory_order_seq_cst) != 0 && std::chrono::steady_clock::now() < deadline) {
+            cv.wait_until(lock, deadline);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> sleeping{ false };
+    std::mutex m;
+    std::condition_variable cv;
+};
@@ -0,0 +1,333 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include "lc3_devices.hpp"
+#include "lc3_image.hpp"
+#include "lc3_telemetry.hpp"
+#include "cow_memory.hpp"
+
+// Virtual NIC for LC3VM: RX and TX descriptor rings in guest memory, fed
+// from a host packet source (a pcap file, mapped and read in place, or a
+// pktgen-style generator) at the source's offered load.
+//
+// Registers from MR_NIC:
+//   CTRL     store 1 to start (the source's clock starts then), 0 to stop
+//            receiving; a load returns NIC_RX_READY (bit 15) when a filled
+//            descriptor is waiting, NIC_SRC_DONE (bit 14) once the source
+//            is exhausted, and bit 0 while enabled
+//   RX_BASE  guest address of the RX ring, RX_SIZE descriptors (a power of
+//   RX_SIZE  two up to NIC_MAX_RING; stored before CTRL)
+//   RX_HEAD  free-running count of descriptors the NIC has filled
+//   RX_TAIL  free-running count the guest has handed back; storing it
+//            returns every descriptor before it to the NIC
+//   TX_BASE, TX_SIZE, TX_HEAD, TX_TAIL  the same for transmit: storing
+//            TX_TAIL sends every descriptor up to it, and TX_HEAD follows
+//   DROPS    packets dropped so far (low 16 bits)
+// A descriptor is four words: buffer address and capacity in words (set by
+// the guest), packet length in bytes and status (set by the NIC: DESC_DONE,
+// plus DESC_TRUNC when the packet did not fit). Packet bytes are packed two
+// to a word, first byte in the high half, as on the wire.
+//
+// DMA happens when the guest touches a NIC register: every packet due by
+// then goes into the next free RX descriptor, in arrival order, or counts
+// as a drop when the guest has none free. The guest only learns of new
+// packets through RX_HEAD or CTRL and only frees descriptors through
+// RX_TAIL, so this gives the drops a device writing at arrival time would.
+// Latency is from a packet's arrival to the guest handing its descriptor
+// back.
+
+enum {
+    MR_NIC = 0xFE40,
+    NIC_CTRL = 0, NIC_RX_BASE, NIC_RX_SIZE, NIC_RX_HEAD, NIC_RX_TAIL,
+    NIC_TX_BASE, NIC_TX_SIZE, NIC_TX_HEAD, NIC_TX_TAIL, NIC_DROPS, NIC_REGS
+};
+enum { NIC_ENABLE = 1, NIC_SRC_DONE = 1 << 14, NIC_RX_READY = 1 << 15, NIC_MAX_RING = 256 };
+enum { DESC_ADDR, DESC_CAP, DESC_LEN, DESC_STATUS, DESC_WORDS };
+enum { DESC_DONE = 1 << 15, DESC_TRUNC = 1 };
+
+// arrival of a packet that is not paced: it arrives whenever an RX
+// descriptor is free, so the source runs as fast as the guest takes it
+static const uint64_t NIC_UNPACED = ~0ull;
+
+struct NicPacket {
+    const uint8_t* data = nullptr; // valid until the source's next call
+    uint32_t len = 0;
+    uint64_t at_ns = 0;            // after the NIC was started, or NIC_UNPACED
+};
+
+class PacketSource {
+public:
+    virtual ~PacketSource() {}
+    virtual bool next(NicPacket& p) = 0; // false once exhausted
+};
+
+// Classic pcap (microsecond or nanosecond, either byte order), read from
+// the mapping. rate > 0 paces packets evenly at rate per second; otherwise
+// they keep the capture's spacing divided by speed, and speed 0 leaves
+// them unpaced.
+class PcapSource : public PacketSource {
+public:
+    bool open(const char* path, double rate, double speed) {
+        base = lc3_map_file(path, &size);
+        if (!base || size < 24) return false;
+        uint32_t magic;
+        memcpy(&magic, base, 4);
+        if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) swapped = false;
+        else if (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) swapped = true;
+        else return false;
+        nanos = magic == 0xA1B23C4D || magic == 0x4D3CB2A1;
+        pos = 24;
+        this->rate = rate;
+        this->speed = speed;
+        return true;
+    }
+
+    bool next(NicPacket& p) override {
+        if (pos + 16 > size) return false;
+        uint32_t sec = word(pos), frac = word(pos + 4), incl = word(pos + 8);
+        if (pos + 16 + incl > size) return false;
+        uint64_t ts = (uint64_t)sec * 1000000000ull + (nanos ? frac : frac * 1000ull);
+        if (!count) first = ts;
+        p.data = base + pos + 16;
+        p.len = incl;
+        if (rate > 0) p.at_ns = (uint64_t)(count * 1e9 / rate);
+        else if (speed > 0) p.at_ns = (uint64_t)((ts - first) / speed);
+        else p.at_ns = NIC_UNPACED;
+        pos += 16 + incl;
+        ++count;
+        return true;
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t size = 0, pos = 0;
+    bool swapped = false, nanos = false;
+    double rate = 0, speed = 1;
+    uint64_t count = 0, first = 0;
+
+    uint32_t word(size_t at) const {
+        uint32_t v;
+        memcpy(&v, base + at, 4);
+        return swapped ? (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24) : v;
+    }
+};
+
+// pktgen-style UDP/IPv4 frames of size bytes (60-1514, no FCS): count of
+// them at rate per second (0: unpaced), the UDP source port cycling over
+// flows values and a 32-bit sequence number at the start of the payload
+class PktgenSource : public PacketSource {
+public:
+    PktgenSource(uint32_t size, uint64_t count, double rate, uint32_t flows)
+        : count(count), rate(rate), flows(flows ? flows : 1) {
+        len = size < 60 ? 60 : size > 1514 ? 1514 : size;
+        static const uint8_t eth[14] = { 2, 0, 0, 0, 0, 2, 2, 0, 0, 0, 0, 1, 0x08, 0x00 };
+        memcpy(frame, eth, sizeof(eth));
+        uint8_t* ip = frame + 14;
+        uint16_t ip_len = (uint16_t)(len - 14);
+        const uint8_t hdr[20] = { 0x45, 0, (uint8_t)(ip_len >> 8), (uint8_t)ip_len, 0, 0, 0x40, 0, 64, 17, 0, 0,
+                                  10, 0, 0, 1, 10, 0, 0, 2 };
+        memcpy(ip, hdr, sizeof(hdr));
+        uint32_t sum = 0;
+        for (int i = 0; i < 20; i += 2) sum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        ip[10] = (uint8_t)(~sum >> 8);
+        ip[11] = (uint8_t)~sum;
+        uint8_t* udp = ip + 20;
+        uint16_t udp_len = (uint16_t)(ip_len - 20);
+        const uint8_t uh[8] = { 0, 9, 0, 9, (uint8_t)(udp_len >> 8), (uint8_t)udp_len, 0, 0 }; // no checksum
+        memcpy(udp, uh, sizeof(uh));
+    }
+
+    bool next(NicPacket& p) override {
+        if (sent == count) return false;
+        uint8_t* udp = frame + 34;
+        uint16_t port = (uint16_t)(9 + sent % flows);
+        udp[0] = (uint8_t)(port >> 8);
+        udp[1] = (uint8_t)port;
+        for (int i = 0; i < 4; ++i) udp[8 + i] = (uint8_t)(sent >> (24 - 8 * i));
+        p.data = frame;
+        p.len = len;
+        p.at_ns = rate > 0 ? (uint64_t)(sent * 1e9 / rate) : NIC_UNPACED;
+        ++sent;
+        return true;
+    }
+
+private:
+    uint8_t frame[1514]{};
+    uint32_t len;
+    uint64_t count, sent = 0;
+    double rate;
+    uint32_t flows;
+};
+
+class NicDevice : public Lc3Device {
+public:
+    // DMA goes through mem (copy-on-write like any store); tx_pcap, when
+    // given, gets every transmitted packet and is closed with the device
+    NicDevice(CowMemory& mem, PacketSource* source, FILE* tx_pcap = nullptr)
+        : mem(mem), source(source), tx_pcap(tx_pcap) {
+        if (tx_pcap) {
+            uint32_t header[6] = { 0xA1B2C3D4, 0x00040002, 0, 0, 65535, 1 }; // v2.4, Ethernet
+            fwrite(header, sizeof(header), 1, tx_pcap);
+        }
+    }
+    NicDevice(const NicDevice&) = delete;
+    NicDevice& operator=(const NicDevice&) = delete;
+    ~NicDevice() {
+        if (tx_pcap) fclose(tx_pcap);
+    }
+
+    uint16_t read(uint16_t addr) override {
+        pump();
+        switch (addr - MR_NIC) {
+            case NIC_CTRL:
+                return (rx_head != rx_tail ? NIC_RX_READY : 0) | (exhausted ? NIC_SRC_DONE : 0) | (enabled ? NIC_ENABLE : 0);
+            case NIC_RX_BASE: return rx_base;
+            case NIC_RX_SIZE: return rx_size;
+            case NIC_RX_HEAD: return rx_head;
+            case NIC_RX_TAIL: return rx_tail;
+            case NIC_TX_BASE: return tx_base;
+            case NIC_TX_SIZE: return tx_size;
+            case NIC_TX_HEAD: return tx_head;
+            case NIC_TX_TAIL: return tx_head;
+            case NIC_DROPS: return (uint16_t)drops;
+        }
+        return 0;
+    }
+
+    void write(uint16_t addr, uint16_t val) override {
+        pump();
+        switch (addr - MR_NIC) {
+            case NIC_CTRL: control(val); break;
+            case NIC_RX_BASE: rx_base = val; break;
+            case NIC_RX_SIZE: rx_size = ring_size(val); break;
+            case NIC_RX_TAIL: give_back(val); break;
+            case NIC_TX_BASE: tx_base = val; break;
+            case NIC_TX_SIZE: tx_size = ring_size(val); break;
+            case NIC_TX_TAIL: transmit(val); break;
+        }
+        pump(); // unpaced packets take the descriptors just returned
+    }
+
+    uint64_t offered = 0, received = 0, processed = 0, drops = 0, truncated = 0;
+    uint64_t tx_packets = 0, tx_bytes = 0;
+    HdrHistogram latency_ns; // arrival to descriptor returned
+
+    void report(const char* name) const {
+        double secs = last_ns ? last_ns / 1e9 : 0;
+        printf("%-8s offered %llu  received %llu  processed %llu  dropped %llu (%.2f%%)  truncated %llu  sent %llu\n",
+               name, (unsigned long long)offered, (unsigned long long)received, (unsigned long long)processed,
+               (unsigned long long)drops, offered ? 100.0 * drops / offered : 0.0, (unsigned long long)truncated,
+               (unsigned long long)tx_packets);
+        char load[48] = "unpaced";
+        if (offer_ns) snprintf(load, sizeof(load), "%.0f pkt/s offered", offered * 1e9 / offer_ns);
+        printf("%-8s %.0f pkt/s over %.2f ms (%s)  latency us p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+               "", secs ? processed / secs : 0.0, secs * 1e3, load, latency_ns.percentile(50) / 1e3,
+               latency_ns.percentile(99) / 1e3, latency_ns.percentile(99.9) / 1e3, latency_ns.max() / 1e3);
+    }
+
+private:
+    CowMemory& mem;
+    PacketSource* source;
+    FILE* tx_pcap;
+    bool enabled = false, exhausted = false, have_next = false;
+    NicPacket next_pkt;
+    std::chrono::steady_clock::time_point t0;
+    uint64_t last_ns = 0;  // last descriptor returned, after start
+    uint64_t offer_ns = 0; // arrival of the last paced packet
+    uint16_t rx_base = 0, rx_size = 0, rx_head = 0, rx_tail = 0;
+    uint16_t tx_base = 0, tx_size = 0, tx_head = 0;
+    uint64_t arrived[NIC_MAX_RING]{};
+
+    static uint16_t ring_size(uint16_t n) { return n && n <= NIC_MAX_RING && !(n & (n - 1)) ? n : 0; }
+
+    uint64_t now_ns() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    void control(uint16_t val) {
+        if ((val & NIC_ENABLE) && !enabled) t0 = std::chrono::steady_clock::now();
+        enabled = (val & NIC_ENABLE) != 0;
+    }
+
+    // every packet due by now, in order
+    void pump() {
+        if (!enabled || exhausted) return;
+        uint64_t now = now_ns();
+        for (;;) {
+            if (!have_next && !(have_next = source->next(next_pkt))) {
+                exhausted = true;
+                return;
+            }
+            bool paced = next_pkt.at_ns != NIC_UNPACED;
+            if (paced && next_pkt.at_ns > now) return;
+            bool full = !rx_size || (uint16_t)(rx_head - rx_tail) >= rx_size;
+            if (full && !paced) return; // waits for a free descriptor
+            have_next = false;
+            ++offered;
+            if (paced) offer_ns = next_pkt.at_ns;
+            if (full) ++drops;
+            else dma(next_pkt, paced ? next_pkt.at_ns : now);
+        }
+    }
+
+    void dma(const NicPacket& p, uint64_t at) {
+        uint16_t d = (uint16_t)(rx_base + (rx_head & (rx_size - 1)) * DESC_WORDS);
+        uint16_t buf = mem.read(d + DESC_ADDR);
+        uint32_t cap = mem.read(d + DESC_CAP);
+        uint32_t words = (p.len + 1) / 2;
+        bool trunc = words > cap;
+        if (trunc) {
+            words = cap;
+            ++truncated;
+        }
+        for (uint32_t i = 0; i < words; ++i) {
+            uint16_t hi = p.data[2 * i], lo = 2 * i + 1 < p.len ? p.data[2 * i + 1] : 0;
+            mem.write((uint16_t)(buf + i), (uint16_t)(hi << 8 | lo));
+        }
+        mem.write(d + DESC_LEN, (uint16_t)p.len);
+        mem.write(d + DESC_STATUS, DESC_DONE | (trunc ? DESC_TRUNC : 0));
+        arrived[rx_head & (rx_size - 1)] = at;
+        ++rx_head;
+        ++received;
+    }
+
+    void give_back(uint16_t tail) {
+        uint16_t n = (uint16_t)(tail - rx_tail);
+        if (n > (uint16_t)(rx_head - rx_tail)) return; // returns descriptors the NIC never filled
+        uint64_t now = now_ns();
+        for (uint16_t i = 0; i < n; ++i) {
+            uint64_t at = arrived[(rx_tail + i) & (rx_size - 1)];
+            latency_ns.record(now > at ? now - at : 0);
+        }
+        rx_tail = tail;
+        processed += n;
+        if (n) last_ns = now;
+    }
+
+    void transmit(uint16_t tail) {
+        for (; tx_size && tx_head != tail; ++tx_head) {
+            uint16_t d = (uint16_t)(tx_base + (tx_head & (tx_size - 1)) * DESC_WORDS);
+            uint16_t buf = mem.read(d + DESC_ADDR);
+            uint16_t len = mem.read(d + DESC_LEN);
+            ++tx_packets;
+            tx_bytes += len;
+            if (tx_pcap) write_record(buf, len);
+            mem.write(d + DESC_STATUS, DESC_DONE);
+        }
+    }
+
+    void write_record(uint16_t buf, uint16_t len) {
+        uint64_t ns = now_ns();
+        uint32_t rec[4] = { (uint32_t)(ns / 1000000000), (uint32_t)(ns % 1000000000 / 1000), len, len };
+        uint8_t bytes[0x10000];
+        for (uint32_t i = 0; i < len; ++i) {
+            uint16_t w = mem.read((uint16_t)(buf + i / 2));
+            bytes[i] = (uint8_t)(i & 1 ? w : w >> 8);
+        }
+        fwrite(rec, sizeof(rec), 1, tx_pcap);
+        fwrite(bytes, 1, len, tx_pcap);
+    }
+};
@@ -0,0 +1,240 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <Windows.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Telemetry plane: per-VM counters that the VM thread bumps with plain
+// relaxed loads and stores (no locked instructions), and a sidecar thread
+// that samples them, keeps rdtsc-based HDR histograms of the per-interval
+// costs and rewrites a text snapshot every period. Point the snapshot at
+// /dev/shm (or any tmpfs) to get a shared-memory page other processes can
+// read; it is replaced with a rename, so readers never see half of one.
+//
+// Everything is compiled out unless LC3_TELEMETRY is 1 (-DLC3_TELEMETRY=1):
+// LC3_COUNT then expands to nothing and the VMs carry no counters.
+
+#ifndef LC3_TELEMETRY
+#define LC3_TELEMETRY 0
+#endif
+
+#if LC3_TELEMETRY
+#define LC3_COUNT(counters, field, n) VmCounters::add((counters).field, (n))
+#else
+#define LC3_COUNT(counters, field, n) ((void)0)
+#endif
+
+inline uint64_t tsc_now() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// One VM's counters on cache lines of their own, so a VM never shares a
+// line with another VM or with the sampler's state. Written by one thread.
+struct alignas(64) VmCounters {
+    std::atomic<uint64_t> instr{ 0 };
+    std::atomic<uint64_t> traps{ 0 };
+    std::atomic<uint64_t> msg_send{ 0 };
+    std::atomic<uint64_t> msg_recv{ 0 };
+    std::atomic<uint64_t> spins{ 0 };
+    std::atomic<uint64_t> op[16]{};
+
+    // single writer: a relaxed read-modify-write without the lock prefix
+    static void add(std::atomic<uint64_t>& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// Log-linear histogram over the whole uint64_t range: values below 2 *
+// SUB_HALF are exact, above that each power of two is split into SUB_HALF
+// buckets, so a reported value is within 1/SUB_HALF (1.6%) of the truth.
+class HdrHistogram {
+public:
+    enum { SUB_BITS = 6, SUB_HALF = 1 << SUB_BITS, BUCKETS = 2 * SUB_HALF + (63 - SUB_BITS) * SUB_HALF };
+
+    void record(uint64_t v) {
+        ++counts[index(v)];
+        ++total;
+        if (v > top) top = v;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return top; }
+
+    // smallest recorded value with at least p percent of the samples at or
+    // below it (the top of its bucket, capped at max)
+    uint64_t percentile(double p) const {
+        if (!total) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)total + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= rank) return highest(i) < top ? highest(i) : top;
+        }
+        return top;
+    }
+
+private:
+    uint64_t counts[BUCKETS]{};
+    uint64_t total = 0;
+    uint64_t top = 0;
+
+    static unsigned index(uint64_t v) {
+        if (v < 2 * SUB_HALF) return (unsigned)v;
+        unsigned msb = 63;
+        while (!(v >> msb)) --msb;
+        unsigned shift = msb - SUB_BITS; // v >> shift lands in [SUB_HALF, 2 * SUB_HALF)
+        return 2 * SUB_HALF + (shift - 1) * SUB_HALF + (unsigned)((v >> shift) - SUB_HALF);
+    }
+    static uint64_t highest(unsigned i) {
+        if (i < 2 * SUB_HALF) return i;
+        unsigned shift = (i - 2 * SUB_HALF) / SUB_HALF + 1;
+        uint64_t sub = (i - 2 * SUB_HALF) % SUB_HALF + SUB_HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+// Sidecar sampler. add() every VM before start(); the counters must
+// outlive stop(), which takes a last sample and writes the final snapshot.
+class Telemetry {
+public:
+    ~Telemetry() { stop(); }
+
+    void add(const char* name, const VmCounters* counters) {
+        sources.emplace_back(new Source(name, counters));
+    }
+
+    bool start(const char* snapshot_path, unsigned period_ms) {
+        path = snapshot_path;
+        period = std::chrono::milliseconds(period_ms ? period_ms : 1);
+        FILE* f = fopen((path + ".tmp").c_str(), "w");
+        if (!f) return false;
+        fclose(f);
+        quit = false;
+        io = std::thread([this] { sampler(); });
+        return true;
+    }
+
+    void stop() {
+        if (!io.joinable()) return;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_one();
+        io.join();
+    }
+
+private:
+    struct Source {
+        std::string name;
+        const VmCounters* c;
+        uint64_t instr = 0, recv = 0;   // at the last sample
+        HdrHistogram kinstr_ticks;      // ticks per 1000 instructions, per interval
+        HdrHistogram msg_ticks;         // ticks per received message, per interval
+
+        Source(const char* name, const VmCounters* c) : name(name), c(c) {}
+    };
+
+    std::vector<std::unique_ptr<Source>> sources;
+    std::string path;
+    std::chrono::milliseconds period{ 100 };
+    std::thread io;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit = false;
+    uint64_t seq = 0;
+    uint64_t tsc_start = 0, tsc_last = 0;
+    std::chrono::steady_clock::time_point wall_start;
+
+    void sampler() {
+        wall_start = std::chrono::steady_clock::now();
+        tsc_start = tsc_last = tsc_now();
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            bool last = wake.wait_for(guard, period, [this] { return quit; });
+            sample();
+            write_snapshot();
+            if (last) return;
+        }
+    }
+
+    void sample() {
+        uint64_t now = tsc_now();
+        uint64_t dt = now - tsc_last;
+        tsc_last = now;
+        for (auto& s : sources) {
+            uint64_t instr = s->c->instr.load(std::memory_order_relaxed);
+            uint64_t recv = s->c->msg_recv.load(std::memory_order_relaxed);
+            if (instr > s->instr) s->kinstr_ticks.record(dt * 1000 / (instr - s->instr));
+            if (recv > s->recv) s->msg_ticks.record(dt / (recv - s->recv));
+            s->instr = instr;
+            s->recv = recv;
+        }
+        ++seq;
+    }
+
+    void write_snapshot() {
+        static const char* op_names[16] = { "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+                                            "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP" };
+        double us = (double)std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - wall_start).count();
+        std::string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        fprintf(f, "seq %llu\nticks_per_us %.1f\n", (unsigned long long)seq,
+                us > 0 ? (double)(tsc_last - tsc_start) / us : 0.0);
+        for (auto& s : sources) {
+            const VmCounters& c = *s->c;
+            fprintf(f, "vm %s instr %llu traps %llu send %llu recv %llu spins %llu\n", s->name.c_str(),
+                    (unsigned long long)c.instr.load(std::memory_order_relaxed),
+                    (unsigned long long)c.traps.load(std::memory_order_relaxed),
+                    (unsigned long long)c.msg_send.load(std::memory_order_relaxed),
+                    (unsigned long long)c.msg_recv.load(std::memory_order_relaxed),
+                    (unsigned long long)c.spins.load(std::memory_order_relaxed));
+            fprintf(f, "vm %s op", s->name.c_str());
+            for (int i = 0; i < 16; ++i) {
+                fprintf(f, " %s %llu", op_names[i], (unsigned long long)c.op[i].load(std::memory_order_relaxed));
+            }
+            fprintf(f, "\n");
+            print_histogram(f, s->name, "kinstr_ticks", s->kinstr_ticks);
+            print_histogram(f, s->name, "msg_ticks", s->msg_ticks);
+        }
+        fclose(f);
+        replace(tmp, path);
+    }
+
+    static void print_histogram(FILE* f, const std::string& name, const char* what, const HdrHistogram& h) {
+        fprintf(f, "vm %s %s n %llu p50 %llu p99 %llu p99.9 %llu max %llu\n", name.c_str(), what,
+                (unsigned long long)h.count(), (unsigned long long)h.percentile(50),
+                (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+                (unsigned long long)h.max());
+    }
+
+    static void replace(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+        MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+        rename(from.c_str(), to.c_str());
+#endif
+    }
+};
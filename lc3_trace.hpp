@@ -0,0 +1,303 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ring_buffer.hpp"
+
+// Record/replay traces (.lc3r) for LC3VM. A recording VM logs every input
+// whose value or timing depends on other threads or on the host: channel
+// words it receives, channel status reads, closed-channel receives, and
+// KBSR polls with the keys they latched. Everything else a VM does follows
+// from its image and those inputs, so replaying the trace re-runs one VM
+// bit-exact on its own, with no channels, peers or spinning.
+//
+// Stream layout after the header ("LC3R", version, image path):
+//   event  = kind (3 bits) | instruction delta (5 bits; 31 = escape, the
+//            delta minus 31 follows as a varint), then the payload
+//   RECV   = zigzag varint of the word minus the previous received word
+//   BULK   = varint word count, then each word as in RECV
+//   STATUS, KEY = varint value
+//   END    = varint state hash (instruction count from the delta)
+// Instruction counts are deltas from the previous event and received words
+// deltas from the previous word, so a tight receive loop over a counting
+// stream costs two bytes per word.
+//
+// The VM thread encodes an event into a few bytes on its stack and pushes
+// them into an SPSC ring; a writer thread drains the ring to the file.
+
+enum TraceKind : uint8_t {
+    TRACE_RECV,   // a channel word reached the VM
+    TRACE_STATUS, // a channel status register read, and what it returned
+    TRACE_CLOSED, // a receive found its channel closed and drained
+    TRACE_IDLE,   // KBSR poll with no key waiting
+    TRACE_KEY,    // KBSR poll that latched a key into KBDR
+    TRACE_BULK,   // RECV_BULK moved some words; they follow
+    TRACE_END     // last event: where the run stopped and its state hash
+};
+
+enum : uint32_t { TRACE_MAGIC = 0x52334C43 /* "LC3R" */, TRACE_VERSION = 1 };
+
+struct TraceEvent {
+    uint8_t kind = TRACE_END;
+    uint64_t instr = 0; // instruction count when the input was taken
+    uint16_t value = 0; // word, status or key; the word count for BULK
+};
+
+class TraceWriter {
+public:
+    enum { RING_SIZE = 1 << 18, DRAIN_WAIT_US = 200, BULK_CHUNK = 64, MAX_EVENT = 24 };
+
+    ~TraceWriter() { close(); }
+
+    bool open(const char* path, const char* image) {
+        file = fopen(path, "wb");
+        if (!file) return false;
+        uint32_t header[2] = { TRACE_MAGIC, TRACE_VERSION };
+        uint16_t len = (uint16_t)strlen(image);
+        ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(&len, sizeof(len), 1, file) == 1
+          && fwrite(image, 1, len, file) == len;
+        bytes = sizeof(header) + sizeof(len) + len;
+        quit.store(false, std::memory_order_relaxed);
+        io = std::thread([this] { drain(); });
+        return true;
+    }
+
+    // RECV, STATUS, CLOSED, IDLE or KEY
+    void event(uint8_t kind, uint64_t instr, uint16_t value = 0) {
+        uint8_t* start = begin();
+        uint8_t* p = head(start, kind, instr);
+        if (kind == TRACE_RECV) p = word(p, value);
+        else if (kind == TRACE_STATUS || kind == TRACE_KEY) p = varint(p, value);
+        end(start, p);
+    }
+
+    void bulk(uint64_t instr, const uint16_t* words, size_t n) {
+        uint8_t buf[16 + 3 * BULK_CHUNK];
+        uint8_t* p = varint(head(buf, TRACE_BULK, instr), n);
+        for (size_t i = 0; i < n; i += BULK_CHUNK) {
+            size_t end = n - i < BULK_CHUNK ? n : i + BULK_CHUNK;
+            for (size_t j = i; j < end; ++j) p = word(p, words[j]);
+            put(buf, (size_t)(p - buf));
+            p = buf;
+        }
+        if (!n) put(buf, (size_t)(p - buf));
+    }
+
+    // writes END, drains the ring and closes the file; false on a write error
+    bool finish(uint64_t instr, uint64_t state_hash) {
+        uint8_t* start = begin();
+        end(start, varint(head(start, TRACE_END, instr), state_hash));
+        close();
+        return ok;
+    }
+
+    uint64_t events() const { return n_events; }
+    uint64_t size() const { return bytes; } // final once finish() returns
+
+private:
+    CachedRingBuffer<uint8_t, RING_SIZE> ring;
+    FILE* file = nullptr;
+    std::thread io;
+    std::atomic<bool> quit{ false };
+    bool ok = false;
+    uint64_t last_instr = 0, n_events = 0; // VM thread only
+    uint16_t last_word = 0;
+    uint8_t spill[MAX_EVENT];
+    bool spilled = false;
+    uint64_t bytes = 0;                     // writer thread only
+    uint8_t batch[1 << 16];
+
+    static uint8_t* varint(uint8_t* p, uint64_t v) {
+        while (v >= 0x80) {
+            *p++ = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (uint8_t)v;
+        return p;
+    }
+
+    uint8_t* head(uint8_t* p, uint8_t kind, uint64_t instr) {
+        uint64_t delta = instr - last_instr;
+        last_instr = instr;
+        ++n_events;
+        if (delta < 31) {
+            *p++ = (uint8_t)(kind | delta << 3);
+            return p;
+        }
+        *p++ = (uint8_t)(kind | 31 << 3);
+        return varint(p, delta - 31);
+    }
+
+    uint8_t* word(uint8_t* p, uint16_t w) {
+        uint16_t d = (uint16_t)(w - last_word);
+        last_word = w;
+        return varint(p, (uint16_t)(d << 1) ^ (d & 0x8000 ? 0xFFFF : 0)); // zigzag
+    }
+
+    // an event is encoded straight into the ring; only where the free space
+    // wraps (or runs out) does it go through spill and put()
+    uint8_t* begin() {
+        uint8_t* slots;
+        spilled = ring.write_reserve(&slots, MAX_EVENT) < MAX_EVENT;
+        return spilled ? spill : slots;
+    }
+
+    void end(uint8_t* start, uint8_t* p) {
+        if (spilled) put(start, (size_t)(p - start));
+        else ring.write_commit((size_t)(p - start));
+    }
+
+    void put(const uint8_t* b, size_t n) {
+        while (n) {
+            size_t done = ring.push_bulk(b, n);
+            if (!done) std::this_thread::yield(); // the writer is behind
+            b += done;
+            n -= done;
+        }
+    }
+
+    void drain() {
+        for (;;) {
+            bool quitting = quit.load(std::memory_order_acquire);
+            size_t n = ring.pop_bulk(batch, sizeof(batch));
+            if (n) {
+                ok = fwrite(batch, 1, n, file) == n && ok;
+                bytes += n;
+                continue;
+            }
+            if (quitting) return;
+            std::this_thread::sleep_for(std::chrono::microseconds(DRAIN_WAIT_US));
+        }
+    }
+
+    void close() {
+        if (!io.joinable()) return;
+        quit.store(true, std::memory_order_release);
+        io.join();
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+    }
+};
+
+// Whole trace in memory; open() walks it once to check it and find END.
+class TraceReader {
+public:
+    bool open(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        uint32_t header[2];
+        uint16_t len;
+        bool ok = fread(header, sizeof(header), 1, f) == 1 && header[0] == TRACE_MAGIC
+               && header[1] == TRACE_VERSION && fread(&len, sizeof(len), 1, f) == 1;
+        if (ok) {
+            image_path.resize(len);
+            ok = fread(&image_path[0], 1, len, f) == len;
+        }
+        uint8_t chunk[1 << 16];
+        size_t n;
+        while (ok && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+        fclose(f);
+        if (!ok) return false;
+
+        Event e;
+        while (decode(e)) {
+            ++n_events;
+            for (uint16_t i = 0; e.kind == TRACE_BULK && i < e.value; ++i) bulk_word();
+        }
+        if (bad || e.kind != TRACE_END) return false;
+        end_at = e.instr;
+        end_state = e.hash;
+        at = Cursor();
+        return true;
+    }
+
+    const char* image() const { return image_path.c_str(); }
+    uint64_t end_instr() const { return end_at; }
+    uint64_t end_hash() const { return end_state; }
+    uint64_t events() const { return n_events; }
+    uint64_t taken() const { return n_taken; }
+
+    // next input; false at END or on a damaged trace. The e.value words of
+    // a BULK event then come from bulk_word(), in order.
+    bool next(TraceEvent& e) {
+        Event x;
+        if (!decode(x)) return false;
+        e = x;
+        ++n_taken;
+        return true;
+    }
+
+    // next input without taking it
+    bool peek(TraceEvent& e) {
+        Cursor saved = at;
+        Event x;
+        bool got = decode(x);
+        at = saved;
+        e = x;
+        return got;
+    }
+
+    uint16_t bulk_word() {
+        uint64_t z = varint();
+        at.word = (uint16_t)(at.word + (uint16_t)((z >> 1) ^ (0 - (z & 1))));
+        return at.word;
+    }
+
+private:
+    struct Event : TraceEvent {
+        uint64_t hash = 0; // END only
+    };
+    struct Cursor {
+        size_t pos = 0;
+        uint64_t instr = 0;
+        uint16_t word = 0;
+    };
+
+    std::vector<uint8_t> data;
+    std::string image_path;
+    Cursor at;
+    bool bad = false;
+    uint64_t end_at = 0, end_state = 0, n_events = 0, n_taken = 0;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at.pos >= data.size()) break;
+            uint8_t b = data[at.pos++];
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        bad = true;
+        return 0;
+    }
+
+    bool decode(Event& e) {
+        if (bad || at.pos >= data.size()) {
+            bad = true;
+            return false;
+        }
+        uint8_t b = data[at.pos++];
+        uint64_t delta = b >> 3;
+        if (delta == 31) delta += varint();
+        at.instr += delta;
+        e.kind = b & 7;
+        e.instr = at.instr;
+        e.value = 0;
+        switch (e.kind) {
+            case TRACE_RECV: e.value = bulk_word(); break;
+            case TRACE_STATUS:
+            case TRACE_KEY:
+            case TRACE_BULK: e.value = (uint16_t)varint(); break;
+            case TRACE_END: e.hash = varint(); return false;
+            case TRACE_CLOSED:
+            case TRACE_IDLE: break;
+            default: bad = true; return false;
+        }
+        return !bad;
+    }
+};
@@ -0,0 +1,1005 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "vm_channel.hpp"
+#include "cow_memory.hpp"
+#include "lc3_image.hpp"
+#include "lc3_devices.hpp"
+#include "lc3_telemetry.hpp"
+#include "lc3_trace.hpp"
+#include "lc3_core.hpp"
+#include "lc3_interrupts.hpp"
+#if defined(_WIN32)
+#include <conio.h>
+static inline int lc3_key_ready() { return _kbhit(); }
+#else
+#include <poll.h>
+static inline int lc3_key_ready() {
+    pollfd p = { 0, POLLIN, 0 };
+    return poll(&p, 1, 0) > 0;
+}
+#endif
+
+// LC-3 VM used by the multi-VM front ends (dual-vm, multi_vm, vm-pool).
+// Each instance owns its registers and its copy-on-write memory and talks
+// to other VMs only through the Channels attached to it. Instructions run
+// on an Lc3Core (lc3_core.hpp) specialized for this class.
+
+enum { LC3VM_MAX_CHANNELS = 16 };
+enum RunState { VM_RUNNING, VM_BLOCKED, VM_HALTED };
+
+// Memory-mapped channel registers, a pair per channel ID from LC3VM_CH_MMIO
+// (next to the keyboard and display on page xFE):
+//   +2*id     status: CH_RX_READY (bit 15, so BRn after the load) when a word
+//             is waiting, CH_TX_READY when a data store will not wait,
+//             CH_CLOSED once the channel is closed and drained (or absent)
+//   +2*id+1   data: a load takes the waiting word, a store sends one
+// A status load receives into a one-word holding register, and a store to
+// a full channel is held until there is room, so polling never blocks; a
+// data access that has to wait behaves like RECV/SEND (spin, or yield).
+enum {
+    LC3VM_CH_MMIO = 0xFE20,
+    CH_RX_READY = 1 << 15,
+    CH_TX_READY = 1 << 14,
+    CH_CLOSED = 1
+};
+
+// A channel's holding registers: the word a status load took off the
+// channel before the data load reads it, and a stored word still waiting
+// for room.
+struct LC3Port {
+    uint16_t rx = 0, tx = 0;
+    bool rx_full = false, tx_full = false;
+};
+
+// Architectural state of an LC3VM: registers, the privileged registers,
+// memory, the channel holding registers, the interrupt source registers
+// and where an interrupted bulk trap resumes. The memory is shared
+// copy-on-write with the VM it came from, so taking one is cheap.
+// Attached channels, the time left in the timer's period and statistics
+// are not part of it; a restored timer starts a new period.
+struct LC3Snapshot {
+    uint16_t reg[10]{};
+    Lc3System sys;
+    bool running = true;
+    uint32_t bulk_progress = 0;
+    LC3Port ports[LC3VM_MAX_CHANNELS];
+    uint16_t tmr_status = 0, tmr_us = 0, bus_status = 0, bus_mask = 0;
+    CowMemory memory;
+
+    // "LC3S", version, registers, PSR, Saved_USP, Saved_SSP, running,
+    // bulk_progress, rx, tx and full bits (rx 1, tx 2) of each port, timer
+    // status and period, bus status and mask, then all 64K words in host
+    // byte order
+    bool save(const char* path) const {
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        uint32_t header[2] = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION };
+        uint16_t run = running;
+        uint16_t priv[3] = { sys.psr, sys.saved_usp, sys.saved_ssp };
+        uint16_t held[LC3VM_MAX_CHANNELS][3];
+        for (unsigned i = 0; i < LC3VM_MAX_CHANNELS; ++i) {
+            held[i][0] = ports[i].rx;
+            held[i][1] = ports[i].tx;
+            held[i][2] = (uint16_t)(ports[i].rx_full | ports[i].tx_full << 1);
+        }
+        uint16_t irq[4] = { tmr_status, tmr_us, bus_status, bus_mask };
+        bool ok = fwrite(header, sizeof(header), 1, f) == 1
+               && fwrite(reg, sizeof(reg), 1, f) == 1
+               && fwrite(priv, sizeof(priv), 1, f) == 1
+               && fwrite(&run, sizeof(run), 1, f) == 1
+               && fwrite(&bulk_progress, sizeof(bulk_progress), 1, f) == 1
+               && fwrite(held, sizeof(held), 1, f) == 1
+               && fwrite(irq, sizeof(irq), 1, f) == 1;
+        for (unsigned i = 0; ok && i < CowMemory::PAGE_COUNT; ++i) {
+            ok = fwrite(memory.page(i), sizeof(uint16_t) * CowMemory::PAGE_WORDS, 1, f) == 1;
+        }
+        return fclose(f) == 0 && ok;
+    }
+
+    // all-zero pages stay on the shared zero page
+    bool load(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        uint32_t header[2];
+        uint16_t run, priv[3], held[LC3VM_MAX_CHANNELS][3], irq[4];
+        bool ok = fread(header, sizeof(header), 1, f) == 1
+               && header[0] == SNAPSHOT_MAGIC && header[1] == SNAPSHOT_VERSION
+               && fread(reg, sizeof(reg), 1, f) == 1
+               && fread(priv, sizeof(priv), 1, f) == 1
+               && fread(&run, sizeof(run), 1, f) == 1
+               && fread(&bulk_progress, sizeof(bulk_progress), 1, f) == 1
+               && fread(held, sizeof(held), 1, f) == 1
+               && fread(irq, sizeof(irq), 1, f) == 1;
+        memory = CowMemory();
+        uint16_t buf[CowMemory::PAGE_WORDS];
+        static const uint16_t zero[CowMemory::PAGE_WORDS] = {};
+        for (unsigned i = 0; ok && i < CowMemory::PAGE_COUNT; ++i) {
+            ok = fread(buf, sizeof(buf), 1, f) == 1;
+            if (ok && memcmp(buf, zero, sizeof(buf)) != 0) memcpy(memory.writable(i), buf, sizeof(buf));
+        }
+        fclose(f);
+        running = run != 0;
+        sys.psr = priv[0];
+        sys.saved_usp = priv[1];
+        sys.saved_ssp = priv[2];
+        for (unsigned i = 0; ok && i < LC3VM_MAX_CHANNELS; ++i) {
+            ports[i].rx = held[i][0];
+            ports[i].tx = held[i][1];
+            ports[i].rx_full = held[i][2] & 1;
+            ports[i].tx_full = (held[i][2] & 2) != 0;
+        }
+        if (ok) {
+            tmr_status = irq[0];
+            tmr_us = irq[1];
+            bus_status = irq[2];
+            bus_mask = irq[3];
+        }
+        return ok;
+    }
+
+    enum : uint32_t { SNAPSHOT_MAGIC = 0x5333434C /* "LC3S" */, SNAPSHOT_VERSION = 4 };
+};
+
+class LC3VM {
+public:
+    LC3VM() {
+        keyboard.map_on(devices);
+        display.map_on(devices);
+        devices.map(LC3VM_CH_MMIO, 2 * LC3VM_MAX_CHANNELS, &channel_regs);
+        devices.map(MR_TMR, IRQ_REGS, &irq_regs);
+        devices.map(MR_PSR, 1, &irq_regs);
+    }
+    ~LC3VM() {
+        for (Channel* ch : channels) {
+            ChannelDoorbell* ours = &doorbell;
+            if (ch) ch->doorbell.compare_exchange_strong(ours, nullptr);
+        }
+    }
+    LC3VM(const LC3VM&) = delete; // the device bus points into this VM
+    LC3VM& operator=(const LC3VM&) = delete;
+
+    CowMemory memory;
+    uint16_t reg[10]{};  // R0–R7, PC, COND
+    bool running = true;
+    uint64_t instr_count = 0;
+    uint64_t msg_send = 0;
+    uint64_t msg_recv = 0;
+    uint64_t words_send = 0;
+    uint64_t words_recv = 0;
+    uint64_t recv_spin_total = 0;
+    uint64_t max_instr = UINT64_MAX; // instruction cap; by default runs until HALT
+    uint64_t recv_closed = 0;
+    uint64_t interrupts = 0;  // interrupts and exceptions taken
+    uint64_t waits = 0;       // TRAP x26
+    double idle_ms = 0;       // asleep in WAIT
+    double elapsed_ms = 0;
+    const char* image_name = "";
+
+    // virtual time (vm_sim.hpp): every retired instruction adds its
+    // opcode's cost to cycles. With cycles_per_us set the timer counts
+    // cycles instead of wall-clock microseconds.
+    uint64_t cycles = 0;
+    uint16_t op_cost[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+    uint32_t cycles_per_us = 0;
+
+    // scheduled mode (vm_scheduler.hpp): a SEND/RECV that would block
+    // rewinds PC to the TRAP and ends the quantum instead of spinning
+    bool yield_on_block = false;
+    uint64_t yields = 0;
+
+#if LC3_TELEMETRY
+    VmCounters telemetry; // relaxed copies of the counters above, for a Telemetry sampler
+#endif
+
+    // record/replay (lc3_trace.hpp): with trace_out every nondeterministic
+    // input is logged as it is taken; with trace_in those inputs come from
+    // the trace instead of channels and the keyboard, and a mismatch sets
+    // diverged and halts the VM
+    TraceWriter* trace_out = nullptr;
+    TraceReader* trace_in = nullptr;
+    bool diverged = false;
+
+    // TRAP x30-x33 use channel 0, TRAP x34/x35 the channel whose ID is in R1
+    Channel* channels[LC3VM_MAX_CHANNELS]{};
+    ChannelCursor cursors[LC3VM_MAX_CHANNELS];
+    uint64_t ch_sent[LC3VM_MAX_CHANNELS]{};
+    uint64_t ch_recv[LC3VM_MAX_CHANNELS]{};
+
+    // the channel must outlive the VM
+    void attach(int id, Channel* ch) {
+        channels[id] = ch;
+        cursors[id] = ch->subscribe();
+        bus_doorbells();
+    }
+
+    // another device on the I/O page, e.g. a NicDevice (lc3_nic.hpp) at
+    // MR_NIC; it must outlive the VM. False when the bus is full.
+    bool map_device(uint16_t base, uint32_t words, Lc3Device* dev) { return devices.map(base, words, dev); }
+
+    // .obj or .lc3i; each file is read once per process (lc3_image.hpp)
+    // and a VM's first image is mapped page by page rather than copied
+    void load_image(const char* path) {
+        const Lc3Image* img = lc3_image_open(path);
+        if (!img) {
+            printf("failed to load image: %s\n", path);
+            exit(1);
+        }
+        image_name = path;
+        if (!image_loaded) {
+            for (unsigned i = 0; i < CowMemory::PAGE_COUNT; ++i) memory.map(i, img->memory + i * CowMemory::PAGE_WORDS);
+        } else {
+            for (uint32_t i = 0; i < img->words; ++i) {
+                uint16_t addr = (uint16_t)(img->origin + i);
+                memory.write(addr, img->memory[addr]);
+            }
+        }
+        image_loaded = true;
+        reg[8] = img->origin;  // R_PC
+    }
+
+    LC3Snapshot snapshot() const {
+        LC3Snapshot s;
+        memcpy(s.reg, reg, sizeof(reg));
+        s.sys = core.sys;
+        s.running = running;
+        s.bulk_progress = bulk_progress;
+        memcpy(s.ports, ports, sizeof(ports));
+        s.tmr_status = tmr_status;
+        s.tmr_us = tmr_us;
+        s.bus_status = bus_status;
+        s.bus_mask = bus_mask;
+        s.memory = memory;
+        return s;
+    }
+
+    // statistics, channels and limits are left as they are
+    void restore(const LC3Snapshot& s) {
+        memcpy(reg, s.reg, sizeof(reg));
+        core.sys = s.sys;
+        running = s.running;
+        bulk_progress = s.bulk_progress;
+        memcpy(ports, s.ports, sizeof(ports));
+        tmr_status = s.tmr_status;
+        tmr_us = s.tmr_us;
+        bus_status = s.bus_status;
+        bus_mask = s.bus_mask;
+        blocked = false;
+        memory = s.memory;
+        image_loaded = true;
+        irq_resume();
+    }
+
+    // new VM in this one's state, sharing its memory copy-on-write; it
+    // starts with no channels attached and zeroed statistics
+    std::unique_ptr<LC3VM> fork() const {
+        std::unique_ptr<LC3VM> child(new LC3VM());
+        memcpy(child->reg, reg, sizeof(reg));
+        child->core.sys = core.sys;
+        child->running = running;
+        child->bulk_progress = bulk_progress;
+        memcpy(child->ports, ports, sizeof(ports));
+        child->memory = memory;
+        child->image_loaded = true;
+        child->image_name = image_name;
+        child->max_instr = max_instr;
+        child->yield_on_block = yield_on_block;
+        memcpy(child->op_cost, op_cost, sizeof(op_cost));
+        child->cycles_per_us = cycles_per_us;
+        child->tmr_status = tmr_status;
+        child->tmr_us = tmr_us;
+        child->bus_status = bus_status;
+        child->bus_mask = bus_mask;
+        child->irq_resume();
+        return child;
+    }
+
+    void run() {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        if (instr_count < max_instr) core.run(max_instr - instr_count, running);
+        if (running) flush_at_limit(false);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // Runs up to quantum instructions. VM_BLOCKED means the current TRAP
+    // could not complete and will be retried when the VM runs again.
+    RunState run_quantum(uint64_t quantum) { return run_slice(quantum, running); }
+
+    // the same, until cycles reaches end (vm_sim.hpp); the last instruction
+    // (and what its channel operation costs) may go past it
+    RunState run_cycles(uint64_t end) { return run_slice(UINT64_MAX, UntilCycle{ this, end }); }
+
+    // after VM_BLOCKED on virtual time: the cycle at which the timer makes
+    // a WAIT takeable, UINT64_MAX when it will not
+    uint64_t timer_due() const {
+        return cycles_per_us && tmr_us && tmr_status & IRQ_ENABLE ? tmr_due : UINT64_MAX;
+    }
+
+    // FNV-1a over the registers, the running flag and all of memory
+    uint64_t state_hash() const {
+        uint64_t h = 0xCBF29CE484222325ull;
+        auto mix = [&h](uint16_t w) { h = (h ^ w) * 0x100000001B3ull; };
+        for (uint16_t r : reg) mix(r);
+        mix(running);
+        for (unsigned i = 0; i < CowMemory::PAGE_COUNT; ++i) {
+            const uint16_t* page = memory.page(i);
+            for (unsigned j = 0; j < CowMemory::PAGE_WORDS; ++j) mix(page[j]);
+        }
+        return h;
+    }
+
+    void report() const {
+        double ns_per_instr = instr_count ? elapsed_ms * 1e6 / instr_count : 0;
+        double mips = ns_per_instr ? 1e3 * 1e6 / ns_per_instr : 0; // or: 1e9 / ns_per_instr
+
+        printf("\n==== VM (%s) Metrics ====" "\n", image_name);
+        printf("Instructions: %llu\n", (unsigned long long)instr_count);
+        printf("ns/op              : %.2f ns\n", ns_per_instr);
+        printf("Throughput         : %.2f instr/s\n", mips);
+        printf("Messages Sent: %llu, Recv: %llu\n", (unsigned long long)msg_send, (unsigned long long)msg_recv);
+        printf("Words Sent: %llu, Recv: %llu\n", (unsigned long long)words_send, (unsigned long long)words_recv);
+        printf("Recv spin iters: %llu\n", (unsigned long long)recv_spin_total);
+        printf("Msgs/sec: %.2f\n", elapsed_ms ? 1000.0 * msg_recv / elapsed_ms : 0);
+        double avg_spins_per_msg = msg_recv ? static_cast<double>(recv_spin_total) / msg_recv : 0;
+        double us_per_msg = msg_recv ? (elapsed_ms * 1000.0) / msg_recv : 0;
+
+        printf("Avg spins/msg      : %.2f\n", avg_spins_per_msg);
+        printf("Avg us/msg         : %.2f\n", us_per_msg);
+        printf("Elapsed time       : %.2f ms\n", elapsed_ms);
+        if (interrupts || waits) {
+            printf("Interrupts         : %llu\n", (unsigned long long)interrupts);
+            printf("WAITs              : %llu (%.2f ms asleep)\n", (unsigned long long)waits, idle_ms);
+        }
+
+        uint64_t lagged = 0;
+        for (const ChannelCursor& c : cursors) lagged += c.lagged;
+        if (lagged) printf("Broadcast lapped   : %llu\n", (unsigned long long)lagged);
+        printf("=========================\n");
+    }
+
+private:
+    // forwards the channel register block to the VM that owns the channels
+    class ChannelRegs : public Lc3Device {
+    public:
+        explicit ChannelRegs(LC3VM* vm) : vm(vm) {}
+        uint16_t read(uint16_t addr) override { return vm->port_read(addr); }
+        void write(uint16_t addr, uint16_t val) override { vm->port_write(addr, val); }
+    private:
+        LC3VM* vm;
+    };
+
+    // the timer and bus interrupt registers and the PSR (lc3_interrupts.hpp)
+    class IrqRegs : public Lc3Device {
+    public:
+        explicit IrqRegs(LC3VM* vm) : vm(vm) {}
+        uint16_t read(uint16_t addr) override { return vm->irq_read(addr); }
+        void write(uint16_t addr, uint16_t val) override { vm->irq_write(addr, val); }
+    private:
+        LC3VM* vm;
+    };
+
+    // Lc3Core policies: guest memory through the device bus, where a
+    // channel register that would wait stalls the instruction (yield
+    // mode); the traps below; the instruction count, telemetry and the
+    // interrupt sources
+    struct VmMemory {
+        static constexpr bool stalls = true;
+        LC3VM* vm;
+        uint16_t fetch(uint16_t addr) { return vm->memory.read(addr); }
+        uint16_t read(uint16_t addr) { return vm->mem_read(addr); }
+        void write(uint16_t addr, uint16_t val) { vm->mem_write(addr, val); }
+        bool stalled() const { return vm->blocked; }
+    };
+    struct VmTraps {
+        LC3VM* vm;
+        bool trap(uint16_t*, uint8_t vector) {
+            vm->trap(vector);
+            return !vm->blocked;
+        }
+    };
+    struct VmHooks {
+        LC3VM* vm;
+        void retire(uint16_t op) {
+            ++vm->instr_count;
+            vm->cycles += vm->op_cost[op];
+            LC3_COUNT(vm->telemetry, instr, 1);
+            LC3_COUNT(vm->telemetry, op[op], 1);
+        }
+        void trap(uint8_t) { LC3_COUNT(vm->telemetry, traps, 1); }
+
+        static constexpr bool interrupts = true;
+        bool pending() const { return vm->instr_count >= vm->doorbell.check_at.load(std::memory_order_relaxed); }
+        int poll(uint8_t& vector) { return vm->irq_poll(vector); }
+        void enter(uint8_t) { ++vm->interrupts; }
+    };
+    Lc3Core<VmMemory, VmTraps, LazyFlags, VmHooks> core{ reg, VmMemory{ this }, VmTraps{ this }, VmHooks{ this } };
+
+    DeviceBus devices;
+    KeyboardDevice keyboard{ lc3_key_ready };
+    DisplayDevice display;
+    ChannelRegs channel_regs{ this };
+    IrqRegs irq_regs{ this };
+    LC3Port ports[LC3VM_MAX_CHANNELS];
+
+    Doorbell doorbell;
+    uint16_t tmr_status = 0; // IRQ_READY | IRQ_ENABLE
+    uint16_t tmr_us = 0;
+    std::chrono::steady_clock::time_point tmr_deadline;
+    uint64_t tmr_due = 0; // the deadline in cycles, with cycles_per_us
+    uint16_t bus_status = 0; // IRQ_ENABLE only; ready is worked out on demand
+    uint16_t bus_mask = 0;
+
+    bool blocked = false;
+    bool image_loaded = false; // memory holds more than zeros
+    uint32_t bulk_progress = 0; // words of a blocked bulk transfer already moved
+    std::vector<uint16_t> bulk_gather; // an mpmc SEND_BULK, copied out of its pages
+
+    struct UntilCycle {
+        const LC3VM* vm;
+        uint64_t end;
+        explicit operator bool() const { return vm->running && vm->cycles < end; }
+    };
+
+    template <class Running>
+    RunState run_slice(uint64_t quantum, const Running& go) {
+        uint64_t left = instr_count < max_instr ? max_instr - instr_count : 0;
+        core.run(quantum < left ? quantum : left, go);
+        if (blocked) {
+            blocked = false;
+            ++yields;
+            return VM_BLOCKED;
+        }
+        if (running && instr_count < max_instr) return VM_RUNNING;
+        if (running && !flush_at_limit(yield_on_block)) { // retried with nothing left to run
+            ++yields;
+            return VM_BLOCKED;
+        }
+        return VM_HALTED;
+    }
+
+    // yield_on_block: undo the TRAP fetch so it runs again next quantum
+    bool would_block() {
+        if (!yield_on_block) return false;
+        --reg[8];
+        blocked = true;
+        return true;
+    }
+
+    // one attribute lookup per load/store; only device pages go further
+    uint16_t mem_read(uint16_t addr) {
+        if (devices.io_page(addr)) {
+            if (addr == MR_KBSR && (trace_out || trace_in)) return kbsr_traced();
+            if (Lc3Device* dev = devices.at(addr)) return dev->read(addr);
+        }
+        return memory.read(addr);
+    }
+
+    void trace(uint8_t kind, uint16_t value = 0) {
+        if (trace_out) trace_out->event(kind, instr_count, value);
+    }
+
+    // the trace's next input, which must be taken at this instruction
+    bool replay_next(TraceEvent& e) {
+        if (trace_in->next(e) && e.instr == instr_count) return true;
+        return replay_diverged();
+    }
+
+    bool replay_diverged() {
+        diverged = true;
+        running = false;
+        return false;
+    }
+
+    uint16_t kbsr_traced() {
+        if (trace_in) {
+            TraceEvent e;
+            if (!replay_next(e)) return 0;
+            if (e.kind == TRACE_IDLE) return 0;
+            if (e.kind != TRACE_KEY) return replay_diverged();
+            keyboard.latch(e.value);
+            return 1 << 15;
+        }
+        uint16_t status = keyboard.read(MR_KBSR);
+        if (status) trace(TRACE_KEY, keyboard.read(MR_KBDR));
+        else trace(TRACE_IDLE);
+        return status;
+    }
+
+    void mem_write(uint16_t addr, uint16_t val) {
+        if (devices.io_page(addr)) {
+            if (Lc3Device* dev = devices.at(addr)) {
+                dev->write(addr, val);
+                return;
+            }
+        }
+        memory.write(addr, val);
+    }
+
+    // moves a word into the port's receive holding register if it is empty
+    bool port_fill(uint16_t id) {
+        LC3Port& p = ports[id];
+        if (p.rx_full) return true;
+        if (!channels[id] || !channels[id]->try_recv(p.rx, cursors[id])) return false;
+        trace(TRACE_RECV, p.rx);
+        p.rx_full = true;
+        ++msg_recv;
+        LC3_COUNT(telemetry, msg_recv, 1);
+        ++ch_recv[id];
+        return true;
+    }
+
+    // sends a held word; true once nothing is held
+    bool port_flush(uint16_t id) {
+        LC3Port& p = ports[id];
+        if (!p.tx_full) return true;
+        if (!channels[id]->try_send(p.tx)) return false;
+        channels[id]->notify();
+        p.tx_full = false;
+        ++msg_send;
+        LC3_COUNT(telemetry, msg_send, 1);
+        ++ch_sent[id];
+        return true;
+    }
+
+    // false when a held word cannot go out yet and the VM yields; a word
+    // held for a channel the VM no longer has (restored, forked) stays
+    bool flush_ports() {
+        for (uint16_t id = 0; id < LC3VM_MAX_CHANNELS; ++id) {
+            if (!channels[id]) continue;
+            while (!port_flush(id)) {
+                if (would_block()) return false;
+                channels[id]->wait_send();
+            }
+        }
+        return true;
+    }
+
+    // a VM stopped by max_instr sends its held words too, as HALT does,
+    // before its senders are retired; false when one cannot go out yet and
+    // may_yield
+    bool flush_at_limit(bool may_yield) {
+        for (uint16_t id = 0; id < LC3VM_MAX_CHANNELS; ++id) {
+            if (!channels[id]) continue;
+            while (!port_flush(id)) {
+                if (may_yield) return false;
+                channels[id]->wait_send();
+            }
+        }
+        return true;
+    }
+
+    uint16_t port_read(uint16_t addr) {
+        uint16_t id = (uint16_t)(addr - LC3VM_CH_MMIO) >> 1;
+        Channel* ch = channels[id];
+        if (trace_in) return replay_port_read(id, !((addr - LC3VM_CH_MMIO) & 1));
+        if (!((addr - LC3VM_CH_MMIO) & 1)) { // status
+            bool closed = !ch || ch->closed.load(std::memory_order_acquire);
+            bool ready = port_fill(id);
+            bool tx_ready = ch && port_flush(id);
+            uint16_t status = (ready ? CH_RX_READY : 0) | (tx_ready ? CH_TX_READY : 0) | (closed && !ready ? CH_CLOSED : 0);
+            trace(TRACE_STATUS, status);
+            return status;
+        }
+        for (;;) { // data
+            bool closed = !ch || ch->closed.load(std::memory_order_acquire);
+            if (port_fill(id)) break;
+            if (closed) {
+                trace(TRACE_CLOSED);
+                return 0;
+            }
+            if (would_block()) return 0;
+            ++recv_spin_total;
+            LC3_COUNT(telemetry, spins, 1);
+            ch->wait_recv();
+        }
+        ports[id].rx_full = false;
+        return ports[id].rx;
+    }
+
+    // a status read replays the word its port_fill took (logged just before
+    // the status) and then the status itself
+    uint16_t replay_port_read(uint16_t id, bool status) {
+        LC3Port& p = ports[id];
+        TraceEvent e;
+        if (status) {
+            if (!p.rx_full && trace_in->peek(e) && e.kind == TRACE_RECV && e.instr == instr_count) {
+                trace_in->next(e);
+                p.rx = e.value;
+                p.rx_full = true;
+                ++msg_recv;
+                ++ch_recv[id];
+            }
+            if (!replay_next(e)) return 0;
+            return e.kind == TRACE_STATUS ? e.value : replay_diverged();
+        }
+        if (p.rx_full) {
+            p.rx_full = false;
+            return p.rx;
+        }
+        if (!replay_next(e) || e.kind == TRACE_CLOSED) return 0;
+        if (e.kind != TRACE_RECV) return replay_diverged();
+        ++msg_recv;
+        ++ch_recv[id];
+        return e.value;
+    }
+
+    void port_write(uint16_t addr, uint16_t val) {
+        uint16_t id = (uint16_t)(addr - LC3VM_CH_MMIO) >> 1;
+        if (!((addr - LC3VM_CH_MMIO) & 1) || !channels[id]) return; // status is read-only
+        while (!port_flush(id)) {
+            if (would_block()) return;
+            channels[id]->wait_send();
+        }
+        LC3Port& p = ports[id];
+        p.tx = val;
+        p.tx_full = true;
+        port_flush(id);
+    }
+
+    void update_flags(uint16_t r) {
+        if (reg[r] == 0) reg[9] = 0x2;
+        else if (reg[r] >> 15) reg[9] = 0x4;
+        else reg[9] = 0x1;
+    }
+
+    // TRAP x21/x22/x25/x26 and the channel traps; other vectors do nothing.
+    // The core has already set R7 and counted the trap.
+    void trap(uint8_t vector) {
+        switch (vector) {
+            case 0x21: putchar(reg[0]); fflush(stdout); break;
+            case 0x22: putchar('\n'); fflush(stdout); break;
+            case 0x25: // HALT, once held channel words are out
+                if (flush_ports()) running = false;
+                break;
+            case 0x26: // WAIT
+                wait_interrupt();
+                break;
+            case 0x30:  // SEND
+                send_word(0, reg[0]);
+                break;
+            case 0x31: { // RECV
+                uint16_t val;
+                if (!recv_word(0, val)) break;
+                reg[0] = val;
+                update_flags(0);
+                break;
+            }
+            case 0x32: { // SEND_BULK: R1 words of guest memory starting at R0
+                if (!channels[0]) break;
+                uint16_t addr = reg[0] + bulk_progress;
+                uint32_t left = reg[1] - bulk_progress;
+                bool gather = channels[0]->kind == CH_MPMC;
+                uint32_t gathered = 0;
+                while (left) {
+                    // one memcpy run per call, split where a guest page ends;
+                    // mpmc takes up to its size in one piece, so a message
+                    // no longer than that is not split across pages
+                    uint32_t run;
+                    const uint16_t* src;
+                    if (gather) {
+                        run = left < channels[0]->size ? left : (uint32_t)channels[0]->size;
+                        if (gathered != run) {
+                            bulk_gather.resize(run);
+                            for (uint32_t i = 0; i < run; ++i) bulk_gather[i] = memory.read((uint16_t)(addr + i));
+                            gathered = run;
+                        }
+                        src = bulk_gather.data();
+                    } else {
+                        run = page_run(addr, left);
+                        src = memory.page(addr >> CowMemory::PAGE_SHIFT) + page_offset(addr);
+                    }
+                    size_t sent = channels[0]->send_bulk(src, run);
+                    if (sent) {
+                        gathered = 0;
+                        channels[0]->notify();
+                    } else if (would_block()) break;
+                    else channels[0]->wait_send();
+                    addr += (uint16_t)sent;
+                    left -= (uint32_t)sent;
+                }
+                if (blocked) {
+                    bulk_progress = reg[1] - left;
+                    break;
+                }
+                bulk_progress = 0;
+                ++msg_send;
+                LC3_COUNT(telemetry, msg_send, 1);
+                ++ch_sent[0];
+                words_send += reg[1];
+                break;
+            }
+            case 0x33: { // RECV_BULK: R1 words into guest memory starting at R0
+                if (trace_in) {
+                    replay_recv_bulk();
+                    break;
+                }
+                if (!channels[0]) break;
+                uint16_t addr = reg[0] + bulk_progress;
+                uint32_t left = reg[1] - bulk_progress;
+                while (left) {
+                    uint32_t run = page_run(addr, left);
+                    uint16_t* dst = memory.writable(addr >> CowMemory::PAGE_SHIFT) + page_offset(addr);
+                    // closed before the receive: a sender may push its last
+                    // words and close in between, as in recv_word
+                    bool closed = channels[0]->closed.load(std::memory_order_acquire);
+                    size_t got = channels[0]->recv_bulk(dst, run, cursors[0]);
+                    if (got && trace_out) trace_out->bulk(instr_count, dst, got);
+                    if (!got) {
+                        if (closed) {
+                            trace(TRACE_CLOSED);
+                            ++recv_closed;
+                            running = false;
+                            break;
+                        }
+                        if (would_block()) break;
+                        ++recv_spin_total;
+                        LC3_COUNT(telemetry, spins, 1);
+                        channels[0]->wait_recv();
+                    }
+                    addr += (uint16_t)got;
+                    left -= (uint32_t)got;
+                }
+                if (blocked) {
+                    bulk_progress = reg[1] - left;
+                    break;
+                }
+                bulk_progress = 0;
+                if (left) break;
+                ++msg_recv;
+                LC3_COUNT(telemetry, msg_recv, 1);
+                ++ch_recv[0];
+                words_recv += reg[1];
+                break;
+            }
+            case 0x34: // CSEND: R0 on channel R1
+                send_word(reg[1], reg[0]);
+                break;
+            case 0x35: { // CRECV: R0 <- channel R1
+                uint16_t val;
+                if (!recv_word(reg[1], val)) break;
+                reg[0] = val;
+                update_flags(0);
+                break;
+            }
+        }
+    }
+
+    bool irq_armed() const { return (tmr_status & IRQ_ENABLE && tmr_us) || bus_status & IRQ_ENABLE; }
+
+    // VmHooks::poll: the most urgent enabled request and its priority, -1
+    // when there is none. Resetting check_at first means a ring from here on
+    // is seen at the next boundary.
+    int irq_poll(uint8_t& vector) {
+        doorbell.check_at.exchange(irq_armed() ? instr_count + Doorbell::POLL_INSTR : Doorbell::NEVER);
+        if (tmr_us) timer_tick();
+        if ((tmr_status & (IRQ_READY | IRQ_ENABLE)) == (IRQ_READY | IRQ_ENABLE)) {
+            vector = VEC_TIMER;
+            return PL_TIMER;
+        }
+        if (bus_status & IRQ_ENABLE && bus_ready()) {
+            vector = VEC_BUS;
+            return PL_BUS;
+        }
+        return -1;
+    }
+
+    // a full period from now, on the clock the timer counts
+    void timer_start() {
+        tmr_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(tmr_us);
+        tmr_due = cycles + (uint64_t)tmr_us * cycles_per_us;
+    }
+
+    // after restore() or fork(): the timer starts over, the doorbell goes on
+    // the masked channels this VM has, and the next boundary looks for
+    // interrupts
+    void irq_resume() {
+        timer_start();
+        bus_doorbells();
+        doorbell.check_at.store(0, std::memory_order_relaxed);
+    }
+
+    // a late tick is not queued: the next one is a full period away
+    void timer_tick() {
+        if (cycles_per_us) {
+            uint64_t period = (uint64_t)tmr_us * cycles_per_us;
+            if (cycles < tmr_due) return;
+            tmr_status |= IRQ_READY;
+            tmr_due += period;
+            if (tmr_due <= cycles) tmr_due = cycles + period;
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now < tmr_deadline) return;
+        tmr_status |= IRQ_READY;
+        tmr_deadline += std::chrono::microseconds(tmr_us);
+        if (tmr_deadline <= now) tmr_deadline = now + std::chrono::microseconds(tmr_us);
+    }
+
+    // level-triggered: a word taken into a port's holding register stays
+    // there for RECV/CRECV or a data load; a closed, drained channel counts
+    // too, so the handler's RECV halts the VM
+    bool bus_ready() {
+        for (uint16_t id = 0; id < LC3VM_MAX_CHANNELS; ++id) {
+            if (!(bus_mask >> id & 1) || !channels[id]) continue;
+            bool closed = channels[id]->closed.load(std::memory_order_acquire);
+            if (port_fill(id) || closed) return true;
+        }
+        return false;
+    }
+
+    // our doorbell on exactly the unmasked channels while the bus interrupt
+    // is enabled
+    void bus_doorbells() {
+        for (uint16_t id = 0; id < LC3VM_MAX_CHANNELS; ++id) {
+            if (!channels[id]) continue;
+            ChannelDoorbell* ours = &doorbell;
+            if (bus_status & IRQ_ENABLE && bus_mask >> id & 1) {
+                ChannelDoorbell* none = nullptr;
+                channels[id]->doorbell.compare_exchange_strong(none, ours);
+            } else {
+                channels[id]->doorbell.compare_exchange_strong(ours, nullptr);
+            }
+        }
+    }
+
+    uint16_t irq_read(uint16_t addr) {
+        switch (addr) {
+            case MR_TMR: {
+                if (tmr_us) timer_tick();
+                uint16_t v = tmr_status;
+                tmr_status &= ~IRQ_READY;
+                return v;
+            }
+            case MR_TMR_US: return tmr_us;
+            case MR_BUSIR: return bus_status | (bus_ready() ? IRQ_READY : 0);
+            case MR_BUSMASK: return bus_mask;
+            case MR_SSP: return core.sys.saved_ssp;
+            case MR_PSR: return core.sys.psr;
+        }
+        return 0;
+    }
+
+    // any store can make a held-off request takeable: look at the next
+    // boundary
+    void irq_write(uint16_t addr, uint16_t val) {
+        switch (addr) {
+            case MR_TMR: tmr_status = (tmr_status & IRQ_READY) | (val & IRQ_ENABLE); break;
+            case MR_TMR_US:
+                tmr_us = val;
+                timer_start();
+                break;
+            case MR_BUSIR:
+                bus_status = val & IRQ_ENABLE;
+                bus_doorbells();
+                break;
+            case MR_BUSMASK:
+                bus_mask = val;
+                bus_doorbells();
+                break;
+            case MR_SSP: core.sys.saved_ssp = val; break;
+            case MR_PSR: core.sys.psr = (core.sys.psr & ~LC3_PSR_PRIORITY) | (val & LC3_PSR_PRIORITY); break;
+        }
+        doorbell.check_at.store(0, std::memory_order_relaxed);
+    }
+
+    // TRAP x26: returns when an interrupt above the current priority is
+    // pending, to be taken at the TRAP's block boundary, and at once when
+    // no source is enabled. In yield mode the VM yields instead of sleeping.
+    void wait_interrupt() {
+        auto start = std::chrono::steady_clock::now();
+        int level = (core.sys.psr & LC3_PSR_PRIORITY) >> 8;
+        uint8_t vector;
+        while (irq_armed() && irq_poll(vector) <= level) {
+            if (would_block()) return;
+            auto until = std::chrono::steady_clock::now() + Doorbell::IDLE_POLL;
+            if (tmr_status & IRQ_ENABLE && tmr_us && tmr_deadline < until) until = tmr_deadline;
+            doorbell.sleep_until(until);
+        }
+        doorbell.check_at.store(0, std::memory_order_relaxed);
+        ++waits;
+        idle_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // no event at this instruction: the recording had no channel 0 or asked
+    // for zero words, and nothing was received
+    void replay_recv_bulk() {
+        uint16_t addr = reg[0] + bulk_progress;
+        uint32_t left = reg[1] - bulk_progress;
+        TraceEvent e;
+        if (!trace_in->peek(e) || e.instr != instr_count) return;
+        while (left) {
+            if (!replay_next(e)) return;
+            if (e.kind == TRACE_CLOSED) {
+                ++recv_closed;
+                running = false;
+                return;
+            }
+            if (e.kind != TRACE_BULK || e.value > left) {
+                replay_diverged();
+                return;
+            }
+            for (uint16_t i = 0; i < e.value; ++i) memory.write(addr++, trace_in->bulk_word());
+            left -= e.value;
+        }
+        bulk_progress = 0;
+        ++msg_recv;
+        ++ch_recv[0];
+        words_recv += reg[1];
+    }
+
+    void send_word(uint16_t id, uint16_t val) {
+        if (id >= LC3VM_MAX_CHANNELS || !channels[id]) return;
+        while (!port_flush(id) || !channels[id]->try_send(val)) { // broadcast never waits for readers
+            if (would_block()) return;
+            channels[id]->wait_send();
+        }
+        channels[id]->notify();
+        ++msg_send;
+        LC3_COUNT(telemetry, msg_send, 1);
+        ++ch_sent[id];
+    }
+
+    // false when the channel is closed and drained (or missing): the VM
+    // halts; also false when the VM yields instead of waiting
+    bool recv_word(uint16_t id, uint16_t& val) {
+        Channel* ch = id < LC3VM_MAX_CHANNELS ? channels[id] : nullptr;
+        if (id < LC3VM_MAX_CHANNELS && ports[id].rx_full) { // already counted when the status load took it
+            ports[id].rx_full = false;
+            val = ports[id].rx;
+            return true;
+        }
+        if (trace_in) return replay_recv(id, val);
+        for (;;) {
+            bool closed = !ch || ch->closed.load(std::memory_order_acquire);
+            if (ch && ch->try_recv(val, cursors[id])) {
+                trace(TRACE_RECV, val);
+                break;
+            }
+            if (closed) {
+                trace(TRACE_CLOSED);
+                ++recv_closed;
+                running = false;
+                return false;
+            }
+            if (would_block()) return false;
+            ++recv_spin_total;
+            LC3_COUNT(telemetry, spins, 1);
+            ch->wait_recv();
+        }
+        ++msg_recv;
+        LC3_COUNT(telemetry, msg_recv, 1);
+        ++ch_recv[id];
+        return true;
+    }
+
+    bool replay_recv(uint16_t id, uint16_t& val) {
+        TraceEvent e;
+        if (!replay_next(e)) return false;
+        if (e.kind == TRACE_CLOSED) {
+            ++recv_closed;
+            running = false;
+            return false;
+        }
+        if (e.kind != TRACE_RECV) return replay_diverged();
+        val = e.value;
+        ++msg_recv;
+        ++ch_recv[id];
+        return true;
+    }
+
+    static uint16_t page_offset(uint16_t addr) { return addr & (CowMemory::PAGE_WORDS - 1); }
+    static uint32_t page_run(uint16_t addr, uint32_t left) {
+        uint32_t room = CowMemory::PAGE_WORDS - page_offset(addr);
+        return left < room ? left : room;
+    }
+
+};
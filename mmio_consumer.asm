@@ -0,0 +1,14 @@
+; Polls channel 1 with plain loads instead of TRAP x35 and halts once the
+; channel is closed and drained.
+        .ORIG x4000
+        LD R6, CH1          ; channel 1 registers: status, then data
+POLL    LDR R1, R6, #0      ; status
+        BRn READ            ; bit 15: a word is waiting
+        AND R1, R1, #1      ; bit 0: closed and drained
+        BRz POLL
+        TRAP x25
+READ    LDR R0, R6, #1      ; take it
+        ADD R2, R2, #1      ; messages received
+        BRnzp POLL
+CH1     .FILL xFE22
+        .END
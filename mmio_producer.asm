@@ -0,0 +1,10 @@
+; Counts up on channel 1 through its memory-mapped registers instead of
+; TRAP x34: a plain store to the data register sends the word.
+        .ORIG x3000
+        AND R0, R0, #0
+        LD R6, CH1          ; channel 1 registers: status, then data
+LOOP    ADD R0, R0, #1
+        STR R0, R6, #1      ; send (waits only while the ring is full)
+        BRnzp LOOP
+CH1     .FILL xFE22
+        .END
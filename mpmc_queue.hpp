@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Bounded multi-producer/multi-consumer queue (Vyukov). Every cell carries
+// a sequence number that says whose turn it is: pos when free for the
+// producer that claims position pos, pos + 1 once filled for the consumer
+// of pos. Producers and consumers claim positions with a CAS on their own
+// cache-line-separated counter and never touch the other side's counter.
+template<typename T, size_t Size>
+class MpmcQueue {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Cell cells[Size];
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+public:
+    MpmcQueue() {
+        for (size_t i = 0; i < Size; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T& item) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* c;
+        for (;;) {
+            c = &cells[pos & (Size - 1)];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = item;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Claims n consecutive positions with one CAS once all n cells are
+    // free, so the items come out back to back even with other producers
+    // pushing. Returns n, or 0 with nothing pushed; n is at most Size.
+    size_t push_bulk(const T* items, size_t n) {
+        if (n == 0 || n > Size) return 0;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t i = 0;
+            intptr_t dif = 0;
+            for (; i < n; ++i) {
+                size_t seq = cells[(pos + i) & (Size - 1)].seq.load(std::memory_order_acquire);
+                dif = (intptr_t)seq - (intptr_t)(pos + i);
+                if (dif != 0) break;
+            }
+            if (i == n) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return 0; // fewer than n free
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            Cell& c = cells[(pos + i) & (Size - 1)];
+            c.data = items[i];
+            c.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    bool pop(T& item) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* c;
+        for (;;) {
+            c = &cells[pos & (Size - 1)];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item = c->data;
+        c->seq.store(pos + Size, std::memory_order_release);
+        return true;
+    }
+};
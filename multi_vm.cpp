@@ -1,12 +1,558 @@
+// multi_vm.cpp — declarative multi-VM topology runner
+//
+// g++ -std=c++17 -O2 multi_vm.cpp -o multi-vm -pthread
+// ./multi-vm pair.topo
+// ./multi-vm --telemetry /dev/shm/lc3.stats pair.topo   (built with -DLC3_TELEMETRY=1)
+// ./multi-vm --sim pair.topo                             (virtual time, one thread)
+//
+// Topology file, one directive per line ('#' starts a comment):
+//
+//   placement siblings|spread          how core=auto VMs are placed (default: lowest free core)
+//   vm NAME image=FILE [core=N|auto] [limit=N]
+//   channel NAME type=spsc|mpmc|broadcast [size=N] from=VM[,VM..] to=VM[,VM..]
+//           [latency=N] [send=N] [recv=N] [word=N]
+//   nic VM source=pktgen|FILE.pcap [rate=PPS] [size=BYTES] [count=N] [flows=N] [speed=X] [out=FILE.pcap]
+//   sim [quantum=N] [mhz=N] [OP=N]...
+//
+// Channels get IDs in declaration order: TRAP x34/x35 take the ID in R1,
+// TRAP x30-x33 use channel 0. "siblings" puts the two ends of each channel
+// on SMT siblings of one physical core (or neighbouring cores when there
+// is no SMT), "spread" puts them as far apart as the core numbering goes.
+// A channel closes once all its senders have stopped; receivers then drain
+// it and halt. limit caps a VM's instruction count (default: unlimited).
+// A nic line gives a VM the virtual NIC of lc3_nic.hpp at xFE40, fed by a
+// pktgen stream (size bytes, default 64; count packets, default 100000;
+// flows UDP source ports) or a pcap file; rate paces it in packets per
+// second (0, the default for pktgen: as fast as the guest takes them), and
+// a pcap without rate keeps its own timing divided by speed. out writes
+// what the guest transmits.
+//
+// --sim runs the topology as a deterministic discrete-event simulation on
+// one thread (vm_sim.hpp) instead of a thread per VM. Costs are in cycles:
+// OP=N on the sim line sets an opcode's cost by mnemonic (BR, ADD, LD, ST,
+// JSR, AND, LDR, STR, RTI, NOT, LDI, STI, JMP, RES, LEA, TRAP; default 1
+// each), and a channel's latency/send/recv/word keys its SimLink (default
+// 100/10/10/0). quantum defaults to half the smallest channel latency; mhz
+// (default 1000) converts cycles to time for the timer and the report.
+// Threaded runs ignore all of these, and nic lines cannot be simulated.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory>
+#include "lc3_vm.hpp"
+#include "lc3_nic.hpp"
+#include "vm_sim.hpp"
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct VmSpec {
+    std::string name, image;
+    int core = -1;          // -1: auto
+    uint64_t limit = UINT64_MAX;
+};
+
+struct ChannelSpec {
+    std::string name;
+    ChannelKind kind = CH_SPSC;
+    size_t size = 1024;
+    std::vector<int> from, to; // VM indices
+    SimLink link;
+};
+
+struct NicSpec {
+    int vm = -1;
+    std::string source, out; // "pktgen" or a pcap path
+    double rate = 0, speed = 1;
+    uint32_t size = 64, flows = 1;
+    uint64_t count = 100000;
+};
+
+struct Topology {
+    enum { PLACE_PACKED, PLACE_SIBLINGS, PLACE_SPREAD } placement = PLACE_PACKED;
+    std::vector<VmSpec> vms;
+    std::vector<ChannelSpec> channels;
+    std::vector<NicSpec> nics;
+    uint64_t sim_quantum = 0; // 0: half the smallest latency
+    uint32_t mhz = 1000;
+    uint16_t op_cost[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+};
+
+static const char* op_names[16] = {
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR", "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+static void topo_error(const char* path, int line, const char* msg, const std::string& arg) {
+    printf("%s:%d: %s%s\n", path, line, msg, arg.c_str());
+    exit(1);
+}
+
+static int find_vm(const Topology& t, const std::string& name) {
+    for (size_t i = 0; i < t.vms.size(); ++i) {
+        if (t.vms[i].name == name) return (int)i;
+    }
+    return -1;
+}
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (size_t i = 0; i <= s.size(); ++i) {
+        if (i == s.size() || s[i] == sep) {
+            if (i > start) out.push_back(s.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    return out;
+}
+
+static Topology load_topology(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("failed to open topology: %s\n", path);
+        exit(1);
+    }
+    Topology t;
+    char buf[1024];
+    int line = 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        ++line;
+        std::string text(buf);
+        text = text.substr(0, text.find('#'));
+        for (char& c : text) if (c == '\t' || c == '\r' || c == '\n') c = ' ';
+        std::vector<std::string> tok = split(text, ' ');
+        if (tok.empty()) continue;
+
+        if (tok[0] == "placement" && tok.size() == 2) {
+            if (tok[1] == "siblings") t.placement = Topology::PLACE_SIBLINGS;
+            else if (tok[1] == "spread") t.placement = Topology::PLACE_SPREAD;
+            else topo_error(path, line, "unknown placement: ", tok[1]);
+            continue;
+        }
+        if (tok[0] == "sim") {
+            for (size_t i = 1; i < tok.size(); ++i) {
+                std::vector<std::string> kv = split(tok[i], '=');
+                if (kv.size() != 2) topo_error(path, line, "expected key=value: ", tok[i]);
+                if (kv[0] == "quantum") {
+                    t.sim_quantum = strtoull(kv[1].c_str(), nullptr, 10);
+                    continue;
+                }
+                if (kv[0] == "mhz") {
+                    t.mhz = (uint32_t)atoi(kv[1].c_str());
+                    if (!t.mhz) topo_error(path, line, "mhz must be positive: ", kv[1]);
+                    continue;
+                }
+                int op = 0;
+                while (op < 16 && kv[0] != op_names[op]) ++op;
+                if (op == 16) topo_error(path, line, "unknown sim key: ", kv[0]);
+                t.op_cost[op] = (uint16_t)atoi(kv[1].c_str());
+            }
+            continue;
+        }
+        if ((tok[0] != "vm" && tok[0] != "channel" && tok[0] != "nic") || tok.size() < 2) {
+            topo_error(path, line, "unknown directive: ", tok[0]);
+        }
+
+        if (tok[0] == "vm") {
+            VmSpec v;
+            v.name = tok[1];
+            if (find_vm(t, v.name) >= 0) topo_error(path, line, "duplicate vm: ", v.name);
+            for (size_t i = 2; i < tok.size(); ++i) {
+                std::vector<std::string> kv = split(tok[i], '=');
+                if (kv.size() != 2) topo_error(path, line, "expected key=value: ", tok[i]);
+                if (kv[0] == "image") v.image = kv[1];
+                else if (kv[0] == "core") v.core = kv[1] == "auto" ? -1 : atoi(kv[1].c_str());
+                else if (kv[0] == "limit") v.limit = strtoull(kv[1].c_str(), nullptr, 10);
+                else topo_error(path, line, "unknown vm key: ", kv[0]);
+            }
+            if (v.image.empty()) topo_error(path, line, "vm without image: ", v.name);
+            t.vms.push_back(v);
+            continue;
+        }
+
+        if (tok[0] == "nic") {
+            NicSpec n;
+            n.vm = find_vm(t, tok[1]);
+            if (n.vm < 0) topo_error(path, line, "unknown vm: ", tok[1]);
+            for (const NicSpec& other : t.nics) {
+                if (other.vm == n.vm) topo_error(path, line, "second nic on vm: ", tok[1]);
+            }
+            for (size_t i = 2; i < tok.size(); ++i) {
+                std::vector<std::string> kv = split(tok[i], '=');
+                if (kv.size() != 2) topo_error(path, line, "expected key=value: ", tok[i]);
+                if (kv[0] == "source") n.source = kv[1];
+                else if (kv[0] == "out") n.out = kv[1];
+                else if (kv[0] == "rate") n.rate = atof(kv[1].c_str());
+                else if (kv[0] == "speed") n.speed = atof(kv[1].c_str());
+                else if (kv[0] == "size") n.size = (uint32_t)atoi(kv[1].c_str());
+                else if (kv[0] == "flows") n.flows = (uint32_t)atoi(kv[1].c_str());
+                else if (kv[0] == "count") n.count = strtoull(kv[1].c_str(), nullptr, 10);
+                else topo_error(path, line, "unknown nic key: ", kv[0]);
+            }
+            if (n.source.empty()) topo_error(path, line, "nic without source: ", tok[1]);
+            t.nics.push_back(n);
+            continue;
+        }
+
+        ChannelSpec c;
+        c.name = tok[1];
+        for (size_t i = 2; i < tok.size(); ++i) {
+            std::vector<std::string> kv = split(tok[i], '=');
+            if (kv.size() != 2) topo_error(path, line, "expected key=value: ", tok[i]);
+            if (kv[0] == "type") {
+                if (kv[1] == "spsc") c.kind = CH_SPSC;
+                else if (kv[1] == "mpmc") c.kind = CH_MPMC;
+                else if (kv[1] == "broadcast") c.kind = CH_BROADCAST;
+                else topo_error(path, line, "unknown channel type: ", kv[1]);
+            } else if (kv[0] == "size") {
+                c.size = strtoull(kv[1].c_str(), nullptr, 10);
+            } else if (kv[0] == "latency") {
+                c.link.latency = strtoull(kv[1].c_str(), nullptr, 10);
+            } else if (kv[0] == "send") {
+                c.link.send = strtoull(kv[1].c_str(), nullptr, 10);
+            } else if (kv[0] == "recv") {
+                c.link.recv = strtoull(kv[1].c_str(), nullptr, 10);
+            } else if (kv[0] == "word") {
+                c.link.word = strtoull(kv[1].c_str(), nullptr, 10);
+            } else if (kv[0] == "from" || kv[0] == "to") {
+                for (const std::string& name : split(kv[1], ',')) {
+                    int vm = find_vm(t, name);
+                    if (vm < 0) topo_error(path, line, "unknown vm: ", name);
+                    (kv[0] == "from" ? c.from : c.to).push_back(vm);
+                }
+            } else {
+                topo_error(path, line, "unknown channel key: ", kv[0]);
+            }
+        }
+        if (c.from.empty() || c.to.empty()) topo_error(path, line, "channel needs from= and to=: ", c.name);
+        if (c.kind == CH_SPSC && (c.from.size() != 1 || c.to.size() != 1)) {
+            topo_error(path, line, "spsc channel needs exactly one sender and one receiver: ", c.name);
+        }
+        if (c.kind == CH_BROADCAST && c.from.size() != 1) {
+            topo_error(path, line, "broadcast channel needs exactly one sender: ", c.name);
+        }
+        if (t.channels.size() == LC3VM_MAX_CHANNELS) topo_error(path, line, "too many channels: ", c.name);
+        t.channels.push_back(c);
+    }
+    fclose(f);
+    return t;
+}
+
+/* ---------- core placement ---------- */
+
+// SMT sibling of cpu, or -1 when there is none (or it cannot be read)
+static int smt_sibling(int cpu) {
+#if defined(_WIN32)
+    (void)cpu;
+    return -1;
+#else
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char buf[64] = {};
+    fgets(buf, sizeof(buf), f);
+    fclose(f);
+    // "0,8" or "0-1"
+    int a = -1, b = -1;
+    if (sscanf(buf, "%d%*[,-]%d", &a, &b) != 2) return -1;
+    return a == cpu ? b : a;
+#endif
+}
+
+static void place(Topology& t) {
+    int ncpu = (int)std::thread::hardware_concurrency();
+    if (ncpu <= 0) ncpu = 1;
+    std::vector<bool> used(ncpu, false);
+    for (const VmSpec& v : t.vms) {
+        if (v.core >= 0 && v.core < ncpu) used[v.core] = true;
+    }
+    auto take_low = [&]() {
+        for (int c = 0; c < ncpu; ++c) if (!used[c]) { used[c] = true; return c; }
+        return -1;
+    };
+    auto take_high = [&]() {
+        for (int c = ncpu - 1; c >= 0; --c) if (!used[c]) { used[c] = true; return c; }
+        return -1;
+    };
+
+    if (t.placement != Topology::PLACE_PACKED) {
+        for (const ChannelSpec& c : t.channels) {
+            VmSpec& a = t.vms[c.from[0]];
+            VmSpec& b = t.vms[c.to[0]];
+            if (a.core < 0) a.core = take_low();
+            if (b.core >= 0 || a.core < 0) continue;
+            if (t.placement == Topology::PLACE_SPREAD) {
+                b.core = take_high();
+                continue;
+            }
+            int sib = smt_sibling(a.core);
+            if (sib >= 0 && sib < ncpu && !used[sib]) {
+                used[sib] = true;
+                b.core = sib;
+            } else if (a.core + 1 < ncpu && !used[a.core + 1]) {
+                used[a.core + 1] = true;
+                b.core = a.core + 1;
+            } else {
+                b.core = take_low();
+            }
+        }
+    }
+    for (VmSpec& v : t.vms) {
+        if (v.core < 0) v.core = take_low(); // more VMs than cores: left unpinned
+    }
+}
+
+static bool pin_self(int core) {
+    if (core < 0) return false;
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+static void usage() {
+    printf("multi-vm [--sim] [--telemetry snapshot-file] [--telemetry-ms N] topology-file\n");
+    exit(2);
+}
+
+static const char* kind_names[] = { "spsc", "mpmc", "broadcast" };
+
+static std::string route_of(const Topology& t, const ChannelSpec& c) {
+    std::string route;
+    for (size_t k = 0; k < c.from.size(); ++k) route += (k ? "," : "") + t.vms[c.from[k]].name;
+    route += " -> ";
+    for (size_t k = 0; k < c.to.size(); ++k) route += (k ? "," : "") + t.vms[c.to[k]].name;
+    return route;
+}
+
+// --sim: the whole topology on this thread, in virtual time
+static int simulate(const Topology& t) {
+    if (!t.nics.empty()) {
+        printf("--sim: nic lines cannot be simulated (packets arrive in wall-clock time)\n");
+        return 2;
+    }
+    uint64_t quantum = t.sim_quantum;
+    if (!quantum) {
+        uint64_t lowest = UINT64_MAX;
+        for (const ChannelSpec& c : t.channels) lowest = c.link.latency < lowest ? c.link.latency : lowest;
+        quantum = lowest == UINT64_MAX ? 10000 : lowest / 2 ? lowest / 2 : 1;
+    }
+    VmSimulator sim(quantum);
+
+    std::vector<std::unique_ptr<SimChannel>> channels;
+    for (const ChannelSpec& c : t.channels) {
+        channels.emplace_back(new SimChannel(&sim, c.kind, c.size, c.link));
+        channels.back()->senders = (int)c.from.size();
+    }
+    std::vector<std::unique_ptr<LC3VM>> vms;
+    for (size_t i = 0; i < t.vms.size(); ++i) {
+        vms.emplace_back(new LC3VM());
+        LC3VM& vm = *vms.back();
+        vm.max_instr = t.vms[i].limit;
+        vm.load_image(t.vms[i].image.c_str());
+        memcpy(vm.op_cost, t.op_cost, sizeof(t.op_cost));
+        vm.cycles_per_us = t.mhz;
+        sim.add(&vm);
+        for (size_t id = 0; id < t.channels.size(); ++id) {
+            const ChannelSpec& c = t.channels[id];
+            bool sends = false, end = false;
+            for (int v : c.from) sends |= v == (int)i;
+            for (int v : c.to) end |= v == (int)i;
+            if (!sends && !end) continue;
+            vm.attach((int)id, channels[id].get());
+            sim.connect((int)i, channels[id].get(), sends);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sim.run();
+    double host_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double virtual_ms = sim.end_time() / (t.mhz * 1e3);
+
+    printf("\n==== Simulation ====\n");
+    printf("Virtual time: %llu cycles (%.3f ms at %u MHz), quantum %llu cycles\n",
+           (unsigned long long)sim.end_time(), virtual_ms, t.mhz, (unsigned long long)quantum);
+    printf("Host time   : %.2f ms (%.2fx real time)\n", host_ms, host_ms ? virtual_ms / host_ms : 0.0);
+    printf("%-8s %12s %14s %6s %14s %8s %8s %10s %10s  %-7s %s\n", "vm", "instructions", "cycles", "busy",
+           "idle cycles", "slices", "blocked", "sent", "received", "state", "hash");
+    for (size_t i = 0; i < vms.size(); ++i) {
+        const LC3VM& vm = *vms[i];
+        const VmSimulator::VmStats& st = sim.stats((int)i);
+        printf("%-8s %12llu %14llu %5.1f%% %14llu %8llu %8llu %10llu %10llu  %-7s %016llx\n", t.vms[i].name.c_str(),
+               (unsigned long long)vm.instr_count, (unsigned long long)vm.cycles,
+               vm.cycles ? 100.0 * (vm.cycles - st.idle) / vm.cycles : 0.0, (unsigned long long)st.idle,
+               (unsigned long long)st.slices, (unsigned long long)st.blocked, (unsigned long long)vm.msg_send,
+               (unsigned long long)vm.msg_recv, sim.halted((int)i) ? "halted" : "stuck",
+               (unsigned long long)vm.state_hash());
+    }
+
+    printf("\n==== Channels ====\n");
+    printf("%-3s %-12s %-10s %6s %12s %12s %10s %10s %10s %10s  %s\n", "id", "name", "type", "size", "sent",
+           "received", "lapped", "lat p50", "lat p99", "lat max", "route");
+    for (size_t id = 0; id < t.channels.size(); ++id) {
+        const ChannelSpec& c = t.channels[id];
+        const SimChannel& ch = *channels[id];
+        uint64_t sent = 0, recv = 0, lagged = 0;
+        for (const auto& vm : vms) {
+            sent += vm->ch_sent[id];
+            recv += vm->ch_recv[id];
+            lagged += vm->cursors[id].lagged;
+        }
+        printf("%-3zu %-12s %-10s %6zu %12llu %12llu %10llu %10llu %10llu %10llu  %s\n", id, c.name.c_str(),
+               kind_names[c.kind], c.size, (unsigned long long)sent, (unsigned long long)recv,
+               (unsigned long long)lagged, (unsigned long long)ch.latency.percentile(50),
+               (unsigned long long)ch.latency.percentile(99), (unsigned long long)ch.latency.max(),
+               route_of(t, c).c_str());
+    }
+    printf("(latency in cycles, send to receive)\n");
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* topo_path = nullptr;
+    const char* telemetry_path = nullptr;
+    unsigned telemetry_ms = 100;
+    bool simulated = false;
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--sim")) simulated = true;
+        else if (!strcmp(argv[i], "--telemetry") && has_arg) telemetry_path = argv[++i];
+        else if (!strcmp(argv[i], "--telemetry-ms") && has_arg) telemetry_ms = (unsigned)atoi(argv[++i]);
+        else if (argv[i][0] == '-' || topo_path) usage();
+        else topo_path = argv[i];
+    }
+    if (!topo_path) usage();
+    if (telemetry_path && !LC3_TELEMETRY) {
+        printf("--telemetry: built without LC3_TELEMETRY\n");
+        exit(2);
+    }
+    Topology t = load_topology(topo_path);
+    if (simulated) return simulate(t);
+    place(t);
+
+    std::vector<std::unique_ptr<Channel>> channels;
+    for (const ChannelSpec& c : t.channels) {
+        Channel* ch = make_channel(c.kind, c.size);
+        if (!ch) {
+            printf("channel %s: unsupported size %zu (64, 256, 1024, 4096, 16384 or 65536)\n",
+                   c.name.c_str(), c.size);
+            exit(1);
+        }
+        ch->senders = (int)c.from.size();
+        channels.emplace_back(ch);
+    }
+
+    std::vector<std::unique_ptr<LC3VM>> vms;
+    for (size_t i = 0; i < t.vms.size(); ++i) {
+        vms.emplace_back(new LC3VM());
+        LC3VM& vm = *vms.back();
+        vm.max_instr = t.vms[i].limit;
+        vm.load_image(t.vms[i].image.c_str());
+        for (size_t id = 0; id < t.channels.size(); ++id) {
+            const ChannelSpec& c = t.channels[id];
+            bool end = false;
+            for (int v : c.from) end |= v == (int)i;
+            for (int v : c.to) end |= v == (int)i;
+            if (end) vm.attach((int)id, channels[id].get());
+        }
+    }
+
+    std::vector<std::unique_ptr<PacketSource>> sources;
+    std::vector<std::unique_ptr<NicDevice>> nics;
+    for (const NicSpec& n : t.nics) {
+        if (n.source == "pktgen") {
+            sources.emplace_back(new PktgenSource(n.size, n.count, n.rate, n.flows));
+        } else {
+            PcapSource* pcap = new PcapSource();
+            sources.emplace_back(pcap);
+            if (!pcap->open(n.source.c_str(), n.rate, n.speed)) {
+                printf("failed to read pcap: %s\n", n.source.c_str());
+                exit(1);
+            }
+        }
+        FILE* out = nullptr;
+        if (!n.out.empty() && !(out = fopen(n.out.c_str(), "wb"))) {
+            printf("failed to open nic output: %s\n", n.out.c_str());
+            exit(1);
+        }
+        nics.emplace_back(new NicDevice(vms[n.vm]->memory, sources.back().get(), out));
+        if (!vms[n.vm]->map_device(MR_NIC, NIC_REGS, nics.back().get())) {
+            printf("vm %s: no room on the device bus for a nic\n", t.vms[n.vm].name.c_str());
+            exit(1);
+        }
+    }
+
+    Telemetry telemetry;
+#if LC3_TELEMETRY
+    for (size_t i = 0; i < vms.size(); ++i) telemetry.add(t.vms[i].name.c_str(), &vms[i]->telemetry);
+#endif
+    if (telemetry_path && !telemetry.start(telemetry_path, telemetry_ms)) {
+        printf("failed to open telemetry snapshot: %s\n", telemetry_path);
+        exit(1);
+    }
+
+    // every thread pins itself, then all start together
+    std::atomic<int> ready{0};
+    std::vector<int> pinned(t.vms.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < t.vms.size(); ++i) {
+        threads.emplace_back([&, i] {
+            pinned[i] = pin_self(t.vms[i].core);
+            ready.fetch_add(1);
+            while (ready.load() < (int)t.vms.size()) {}
+            vms[i]->run();
+            for (size_t id = 0; id < t.channels.size(); ++id) {
+                for (int v : t.channels[id].from) {
+                    if (v == (int)i) channels[id]->sender_done();
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    telemetry.stop();
 
-// Declare the run_vm function from lc3-alt-win.cpp
-extern void run_vm(const char*);
+    for (size_t i = 0; i < t.vms.size(); ++i) {
+        printf("\n[%s] core %d%s", t.vms[i].name.c_str(), t.vms[i].core, pinned[i] ? "" : " (not pinned)");
+        vms[i]->report();
+    }
 
-int main() {
-    std::thread vm1(run_vm, "producer.obj");
-    std::thread vm2(run_vm, "consumer.obj");
+    printf("\n==== Channels ====\n");
+    printf("%-3s %-12s %-10s %6s %12s %12s %10s %12s  %s\n",
+           "id", "name", "type", "size", "sent", "received", "lapped", "msgs/s", "route");
+    for (size_t id = 0; id < t.channels.size(); ++id) {
+        const ChannelSpec& c = t.channels[id];
+        uint64_t sent = 0, recv = 0, lagged = 0;
+        double ms = 0;
+        for (const auto& vm : vms) {
+            sent += vm->ch_sent[id];
+            recv += vm->ch_recv[id];
+            lagged += vm->cursors[id].lagged;
+        }
+        for (int v : c.to) {
+            if (vms[v]->elapsed_ms > ms) ms = vms[v]->elapsed_ms;
+        }
+        printf("%-3zu %-12s %-10s %6zu %12llu %12llu %10llu %12.0f  %s\n",
+               id, c.name.c_str(), kind_names[c.kind], c.size,
+               (unsigned long long)sent, (unsigned long long)recv, (unsigned long long)lagged,
+               ms ? 1000.0 * recv / ms : 0.0, route_of(t, c).c_str());
+    }
 
-    vm1.join();
-    vm2.join();
+    if (nics.empty()) return 0;
+    printf("\n==== NICs ====\n");
+    for (size_t i = 0; i < nics.size(); ++i) nics[i]->report(t.vms[t.nics[i].vm].name.c_str());
+    return 0;
 }
@@ -0,0 +1,94 @@
+; Packet forwarder for the virtual NIC (lc3_nic.hpp, nic.topo): takes each
+; received frame, swaps its Ethernet addresses, decrements the IPv4 TTL
+; (patching the header checksum) and transmits it from the same buffer.
+; Halts once the packet source is exhausted and every frame is handled.
+        .ORIG x3000
+        LD R6, NIC          ; NIC registers
+        LEA R2, RXRING      ; RX descriptors: buffer address, capacity
+        LD R3, BUF0
+        LD R4, BUFSZ
+        AND R1, R1, #0
+        ADD R1, R1, #8
+INIT    STR R3, R2, #0
+        STR R4, R2, #1
+        ADD R3, R3, R4
+        ADD R2, R2, #4
+        ADD R1, R1, #-1
+        BRp INIT
+        LEA R0, RXRING
+        STR R0, R6, #1      ; RX_BASE
+        LEA R0, TXRING
+        STR R0, R6, #5      ; TX_BASE
+        AND R0, R0, #0
+        ADD R0, R0, #8
+        STR R0, R6, #2      ; RX_SIZE
+        STR R0, R6, #6      ; TX_SIZE
+        AND R0, R0, #0
+        ADD R0, R0, #1
+        STR R0, R6, #0      ; CTRL: start
+        AND R5, R5, #0      ; frames handled = RX_TAIL = TX_TAIL
+
+LOOP    LDR R4, R6, #0      ; CTRL, before RX_HEAD: done then means no more
+        LDR R0, R6, #3      ; RX_HEAD
+        NOT R1, R5
+        ADD R1, R1, #1
+        ADD R1, R0, R1      ; filled - handled
+        BRnp PKT
+        LD R1, DONE
+        AND R4, R4, R1
+        BRz LOOP
+        TRAP x25
+
+PKT     AND R7, R5, #7      ; descriptor offset: (R5 & 7) * 4
+        ADD R7, R7, R7
+        ADD R7, R7, R7
+        LEA R2, RXRING
+        ADD R2, R2, R7
+        LDR R3, R2, #0      ; frame
+        LDR R0, R3, #0      ; swap destination and source MAC
+        LDR R1, R3, #3
+        STR R1, R3, #0
+        STR R0, R3, #3
+        LDR R0, R3, #1
+        LDR R1, R3, #4
+        STR R1, R3, #1
+        STR R0, R3, #4
+        LDR R0, R3, #2
+        LDR R1, R3, #5
+        STR R1, R3, #2
+        STR R0, R3, #5
+        LDR R0, R3, #11     ; TTL is the high byte of word 11
+        LD R1, TTL1
+        NOT R1, R1
+        ADD R1, R1, #1
+        ADD R0, R0, R1
+        STR R0, R3, #11
+        LDR R0, R3, #12     ; checksum + x0100, end-around carry
+        LD R1, HIBYTE
+        AND R4, R0, R1
+        NOT R4, R4
+        AND R4, R4, R1
+        BRnp NOCARRY        ; high byte was not xFF
+        ADD R0, R0, #1
+NOCARRY LD R1, TTL1
+        ADD R0, R0, R1
+        STR R0, R3, #12
+        LEA R4, TXRING      ; send it from the same buffer
+        ADD R4, R4, R7
+        STR R3, R4, #0
+        LDR R0, R2, #2
+        STR R0, R4, #2
+        ADD R5, R5, #1
+        STR R5, R6, #8      ; TX_TAIL: transmitted now
+        STR R5, R6, #4      ; RX_TAIL: the buffer goes back to the NIC
+        BRnzp LOOP
+
+NIC     .FILL xFE40
+BUF0    .FILL x5000
+BUFSZ   .FILL x0400         ; words per buffer: a full 1514-byte frame
+DONE    .FILL x4000
+TTL1    .FILL x0100
+HIBYTE  .FILL xFF00
+RXRING  .BLKW #32
+TXRING  .BLKW #32
+        .END
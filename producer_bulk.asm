@@ -0,0 +1,25 @@
+.ORIG x3000
+LEA R0, MSG         ; R0 = message address
+AND R1, R1, #0
+ADD R1, R1, #15
+ADD R1, R1, #1      ; R1 = 16 words per message
+LOOP: TRAP x32      ; send the whole block in one trap
+      ADD R2, R2, #1
+      BRnzp LOOP
+MSG: .FILL x0001
+.FILL x0002
+.FILL x0003
+.FILL x0004
+.FILL x0005
+.FILL x0006
+.FILL x0007
+.FILL x0008
+.FILL x0009
+.FILL x000A
+.FILL x000B
+.FILL x000C
+.FILL x000D
+.FILL x000E
+.FILL x000F
+.FILL x0010
+.END
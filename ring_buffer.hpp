@@ -2,11 +2,14 @@
 #include <atomic>
 #include <cstdint>
 #include <cassert>
+#include <cstring>
+#include <type_traits>
 #include <new> // Required for strict alignment if using std::hardware_... (optional)
 
 template<typename T, size_t Size>
 class RingBuffer {
     static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "bulk transfers memcpy T");
 
     // The Layout Struct
     // We group them to enforce alignment relative to each other.
@@ -46,4 +49,165 @@ public:
         indices.tail.store((t + 1) & (Size - 1), std::memory_order_release);
         return true;
     }
+
+    // Bulk transfers: copy up to n items in at most two contiguous runs
+    // (the second one only when the batch wraps past the end of the
+    // buffer) and publish the whole batch with a single release store.
+    // Both return how many items were moved, 0 when full / empty.
+    size_t push_bulk(const T* items, size_t n) {
+        size_t h = indices.head.load(std::memory_order_relaxed);
+        size_t t = indices.tail.load(std::memory_order_acquire);
+
+        size_t space = (t - h - 1) & (Size - 1);
+        if (n > space) n = space;
+        if (n == 0) return 0;
+
+        size_t first = Size - h < n ? Size - h : n;
+        std::memcpy(buffer + h, items, first * sizeof(T));
+        std::memcpy(buffer, items + first, (n - first) * sizeof(T));
+
+        indices.head.store((h + n) & (Size - 1), std::memory_order_release);
+        return n;
+    }
+
+    size_t pop_bulk(T* items, size_t n) {
+        size_t t = indices.tail.load(std::memory_order_relaxed);
+        size_t h = indices.head.load(std::memory_order_acquire);
+
+        size_t avail = (h - t) & (Size - 1);
+        if (n > avail) n = avail;
+        if (n == 0) return 0;
+
+        size_t first = Size - t < n ? Size - t : n;
+        std::memcpy(items, buffer + t, first * sizeof(T));
+        std::memcpy(items + first, buffer, (n - first) * sizeof(T));
+
+        indices.tail.store((t + n) & (Size - 1), std::memory_order_release);
+        return n;
+    }
+};
+
+// SPSC ring with cached remote indices (Lamport / FastForward style).
+// Each side keeps a private copy of the other side's index on its own
+// cache line and only re-reads the shared index when the cached view says
+// full (producer) or empty (consumer), so the lines stop bouncing while the
+// queue is neither. write_reserve/write_commit and read_reserve/read_commit
+// let a caller fill or drain N slots in place and publish them with one
+// release store.
+template<typename T, size_t Size>
+class CachedRingBuffer {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "bulk transfers memcpy T");
+
+    struct alignas(64) ProducerSide {
+        std::atomic<size_t> head{0}; // published by the producer
+        size_t cached_tail{0};       // producer's last view of tail
+    };
+    struct alignas(64) ConsumerSide {
+        std::atomic<size_t> tail{0}; // published by the consumer
+        size_t cached_head{0};       // consumer's last view of head
+    };
+
+    T buffer[Size];
+    ProducerSide prod;
+    ConsumerSide cons;
+
+    // refresh the cached index only when it cannot satisfy the request
+    size_t free_slots(size_t h, size_t want) {
+        size_t space = (prod.cached_tail - h - 1) & (Size - 1);
+        if (space < want) {
+            prod.cached_tail = cons.tail.load(std::memory_order_acquire);
+            space = (prod.cached_tail - h - 1) & (Size - 1);
+        }
+        return space;
+    }
+
+    size_t used_slots(size_t t, size_t want) {
+        size_t avail = (cons.cached_head - t) & (Size - 1);
+        if (avail < want) {
+            cons.cached_head = prod.head.load(std::memory_order_acquire);
+            avail = (cons.cached_head - t) & (Size - 1);
+        }
+        return avail;
+    }
+
+public:
+    bool push(const T& item) {
+        size_t h = prod.head.load(std::memory_order_relaxed);
+        if (free_slots(h, 1) == 0) return false; // full
+
+        buffer[h] = item;
+        prod.head.store((h + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t t = cons.tail.load(std::memory_order_relaxed);
+        if (used_slots(t, 1) == 0) return false; // empty
+
+        item = buffer[t];
+        cons.tail.store((t + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    // Up to n free slots, contiguous from *slots (a batch never wraps, so it
+    // may come back shorter than the free space). Nothing is visible to the
+    // consumer until write_commit.
+    size_t write_reserve(T** slots, size_t n) {
+        size_t h = prod.head.load(std::memory_order_relaxed);
+        size_t space = free_slots(h, n);
+        if (n > space) n = space;
+        if (n > Size - h) n = Size - h;
+        *slots = buffer + h;
+        return n;
+    }
+
+    void write_commit(size_t n) {
+        size_t h = prod.head.load(std::memory_order_relaxed);
+        prod.head.store((h + n) & (Size - 1), std::memory_order_release);
+    }
+
+    // Up to n filled slots, contiguous from *slots; they stay owned by the
+    // consumer until read_commit hands them back to the producer.
+    size_t read_reserve(const T** slots, size_t n) {
+        size_t t = cons.tail.load(std::memory_order_relaxed);
+        size_t avail = used_slots(t, n);
+        if (n > avail) n = avail;
+        if (n > Size - t) n = Size - t;
+        *slots = buffer + t;
+        return n;
+    }
+
+    void read_commit(size_t n) {
+        size_t t = cons.tail.load(std::memory_order_relaxed);
+        cons.tail.store((t + n) & (Size - 1), std::memory_order_release);
+    }
+
+    size_t push_bulk(const T* items, size_t n) {
+        size_t h = prod.head.load(std::memory_order_relaxed);
+        size_t space = free_slots(h, n);
+        if (n > space) n = space;
+        if (n == 0) return 0;
+
+        size_t first = Size - h < n ? Size - h : n;
+        std::memcpy(buffer + h, items, first * sizeof(T));
+        std::memcpy(buffer, items + first, (n - first) * sizeof(T));
+
+        prod.head.store((h + n) & (Size - 1), std::memory_order_release);
+        return n;
+    }
+
+    size_t pop_bulk(T* items, size_t n) {
+        size_t t = cons.tail.load(std::memory_order_relaxed);
+        size_t avail = used_slots(t, n);
+        if (n > avail) n = avail;
+        if (n == 0) return 0;
+
+        size_t first = Size - t < n ? Size - t : n;
+        std::memcpy(items, buffer + t, first * sizeof(T));
+        std::memcpy(items + first, buffer, (n - first) * sizeof(T));
+
+        cons.tail.store((t + n) & (Size - 1), std::memory_order_release);
+        return n;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "shm_bus.hpp"
+#include "ring_buffer.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+
+// g++ -std=c++17 -O2 shm_benchmark.cpp -o shm_benchmark -pthread -lrt
+// ./shm_benchmark > shm.csv
+// ./shm_benchmark --msgs 200000 --rtts 20000
+//
+// The cross-process bus (shm_bus.hpp) against the in-process one (the
+// RingBuffer behind SpscChannel), both 1024 words:
+//   stream    msgs words one way, one per push/pop or 64 per push_bulk/
+//             pop_bulk; timed by the consumer from its first word to its
+//             last
+//   pingpong  one word out on one ring and back on another, rtts times;
+//             p50/p99/max round trip
+// transport "thread" runs both sides as threads of this process;
+// "process" forks, and the child opens the buses by name. wait "spin"
+// retries with a pause and yields every SPIN_LIMIT tries; "park" (process
+// only) is ShmRing::wait(), which sleeps on a futex after SPIN_LIMIT. One
+// CSV row per case on stdout; parks and wakes are the measuring side's.
+
+enum Transport { TR_THREAD, TR_PROCESS };
+enum Wait { WAIT_SPIN, WAIT_PARK };
+
+static const char* transport_names[] = { "thread", "process" };
+static const char* wait_names[] = { "spin", "park" };
+
+enum { RING = 1024, BATCH = 64 };
+
+// what a case reports back from its consumer (or its pinging side)
+struct Result {
+    double secs = 0;
+    uint64_t sum = 0;
+    uint64_t parks = 0, wakes = 0;
+    uint64_t p50_ns = 0, p99_ns = 0, max_ns = 0;
+};
+
+static void spin_once(unsigned& spins) {
+    if (++spins < ShmRing::SPIN_LIMIT) {
+        shm_relax();
+        return;
+    }
+    spins = 0;
+    std::this_thread::yield();
+}
+
+// the in-process ring behind the same calls as a ShmRing
+struct LocalEnd {
+    RingBuffer<uint16_t, RING>* q;
+    unsigned spins = 0;
+    bool push(uint16_t v) { return q->push(v); }
+    bool pop(uint16_t& v) { return q->pop(v); }
+    size_t push_bulk(const uint16_t* v, size_t n) { return q->push_bulk(v, n); }
+    size_t pop_bulk(uint16_t* v, size_t n) { return q->pop_bulk(v, n); }
+    void wait() { spin_once(spins); }
+};
+
+struct ShmEnd {
+    ShmRing* ring;
+    Wait how;
+    unsigned spins = 0;
+    bool push(uint16_t v) { return ring->push(v); }
+    bool pop(uint16_t& v) { return ring->pop(v); }
+    size_t push_bulk(const uint16_t* v, size_t n) { return ring->push_bulk(v, n); }
+    size_t pop_bulk(uint16_t* v, size_t n) { return ring->pop_bulk(v, n); }
+    void wait() {
+        if (how == WAIT_PARK) ring->wait();
+        else spin_once(spins);
+    }
+};
+
+template<typename End>
+static void produce(End& out, uint32_t msgs, size_t batch) {
+    uint16_t buf[BATCH];
+    for (uint32_t sent = 0; sent < msgs; ) {
+        if (batch == 1) {
+            if (out.push((uint16_t)(sent + 1))) ++sent;
+            else out.wait();
+            continue;
+        }
+        size_t k = msgs - sent < batch ? msgs - sent : batch;
+        for (size_t i = 0; i < k; ++i) buf[i] = (uint16_t)(sent + 1 + i);
+        for (size_t done = 0; done < k; ) {
+            size_t n = out.push_bulk(buf + done, k - done);
+            if (!n) out.wait();
+            done += n;
+        }
+        sent += (uint32_t)k;
+    }
+}
+
+template<typename End>
+static void consume(End& in, uint32_t msgs, size_t batch, Result& r) {
+    uint16_t buf[BATCH];
+    std::chrono::steady_clock::time_point t0;
+    for (uint32_t got = 0; got < msgs; ) {
+        size_t n = batch == 1 ? in.pop(buf[0]) : in.pop_bulk(buf, batch);
+        if (!n) {
+            in.wait();
+            continue;
+        }
+        if (!got) t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) r.sum += buf[i];
+        got += (uint32_t)n;
+    }
+    r.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template<typename End>
+static void ping(End& to, End& back, uint32_t rtts, Result& r) {
+    std::vector<uint64_t> ns(rtts);
+    uint16_t v;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rtts; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        while (!to.push((uint16_t)i)) to.wait();
+        while (!back.pop(v)) back.wait();
+        r.sum += v;
+        ns[i] = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+    r.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::sort(ns.begin(), ns.end());
+    r.p50_ns = ns[ns.size() / 2];
+    r.p99_ns = ns[ns.size() * 99 / 100];
+    r.max_ns = ns.back();
+}
+
+template<typename End>
+static void echo(End& to, End& back, uint32_t rtts) {
+    uint16_t v;
+    for (uint32_t i = 0; i < rtts; ++i) {
+        while (!to.pop(v)) to.wait();
+        while (!back.push(v)) back.wait();
+    }
+}
+
+static Result run_threads(bool pingpong, uint32_t n, size_t batch) {
+    std::unique_ptr<RingBuffer<uint16_t, RING>> a(new RingBuffer<uint16_t, RING>());
+    std::unique_ptr<RingBuffer<uint16_t, RING>> b(new RingBuffer<uint16_t, RING>());
+    LocalEnd to_a{ a.get() }, to_b{ b.get() }, from_a{ a.get() }, from_b{ b.get() };
+    Result r;
+    std::thread peer([&] {
+        if (pingpong) echo(from_a, to_b, n);
+        else produce(to_a, n, batch);
+    });
+    if (pingpong) ping(to_a, from_b, n, r);
+    else consume(from_a, n, batch, r);
+    peer.join();
+    return r;
+}
+
+// the child opens both buses by name as the other side and does the
+// producing or echoing; the parent measures
+static Result run_processes(bool pingpong, uint32_t n, size_t batch, Wait how) {
+    char a_name[64], b_name[64];
+    snprintf(a_name, sizeof(a_name), "/lc3bench.%d.a", (int)getpid());
+    snprintf(b_name, sizeof(b_name), "/lc3bench.%d.b", (int)getpid());
+    Result r;
+    ShmRing a, b;
+    if (!a.open(a_name, SHM_CONSUMER, RING) || !b.open(b_name, SHM_PRODUCER, RING)) {
+        fprintf(stderr, "%s%s\n", a.error(), b.error());
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        ShmRing ca, cb;
+        if (!ca.open(a_name, SHM_PRODUCER, RING) || !cb.open(b_name, SHM_CONSUMER, RING)) _exit(1);
+        ShmEnd to_a{ &ca, how }, from_b{ &cb, how };
+        if (pingpong) echo(from_b, to_a, n); // the parent pings on b, the echo comes back on a
+        else produce(to_a, n, batch);
+        _exit(0);
+    }
+    ShmEnd from_a{ &a, how }, to_b{ &b, how };
+    if (pingpong) ping(to_b, from_a, n, r);
+    else consume(from_a, n, batch, r);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "child failed\n");
+        exit(1);
+    }
+    r.parks = a.parks + b.parks;
+    r.wakes = a.wakes + b.wakes;
+    ShmRing::unlink(a_name);
+    ShmRing::unlink(b_name);
+    return r;
+}
+
+static void usage() {
+    fprintf(stderr, "shm_benchmark [--msgs N] [--rtts N]\n");
+    exit(2);
+}
+
+int main(int argc, const char* argv[]) {
+    uint32_t msgs = 2000000, rtts = 100000;
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--msgs") && has_arg) msgs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rtts") && has_arg) rtts = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else usage();
+    }
+    if (!msgs || !rtts) usage();
+    fprintf(stderr, "%u cpus, %u words per stream, %u round trips\n", std::thread::hardware_concurrency(), msgs, rtts);
+    printf("test,batch,transport,wait,n,secs,mwords_per_s,p50_ns,p99_ns,max_ns,parks,wakes\n");
+
+    struct Case { bool pingpong; size_t batch; Transport tr; Wait how; };
+    const Case cases[] = {
+        { false, 1, TR_THREAD, WAIT_SPIN },     { false, 1, TR_PROCESS, WAIT_SPIN },     { false, 1, TR_PROCESS, WAIT_PARK },
+        { false, BATCH, TR_THREAD, WAIT_SPIN }, { false, BATCH, TR_PROCESS, WAIT_SPIN }, { false, BATCH, TR_PROCESS, WAIT_PARK },
+        { true, 1, TR_THREAD, WAIT_SPIN },      { true, 1, TR_PROCESS, WAIT_SPIN },      { true, 1, TR_PROCESS, WAIT_PARK },
+    };
+    for (const Case& c : cases) {
+        uint32_t n = c.pingpong ? rtts : msgs;
+        Result r = c.tr == TR_THREAD ? run_threads(c.pingpong, n, c.batch) : run_processes(c.pingpong, n, c.batch, c.how);
+        uint64_t want = 0;
+        for (uint32_t i = 0; i < n; ++i) want += c.pingpong ? (uint16_t)i : (uint16_t)(i + 1);
+        if (r.sum != want) {
+            fprintf(stderr, "%s %s: sum %llu, expected %llu\n", c.pingpong ? "pingpong" : "stream",
+                    transport_names[c.tr], (unsigned long long)r.sum, (unsigned long long)want);
+            return 1;
+        }
+        printf("%s,%zu,%s,%s,%u,%.4f,%.2f,%llu,%llu,%llu,%llu,%llu\n", c.pingpong ? "pingpong" : "stream", c.batch,
+               transport_names[c.tr], wait_names[c.how], n, r.secs, r.secs > 0 ? n / r.secs / 1e6 : 0.0,
+               (unsigned long long)r.p50_ns, (unsigned long long)r.p99_ns, (unsigned long long)r.max_ns,
+               (unsigned long long)r.parks, (unsigned long long)r.wakes);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,417 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "vm_channel.hpp"
+
+// Cross-process VM bus (POSIX): the SPSC word ring of ring_buffer.hpp laid
+// out in a shm_open segment, so a producer VM and a consumer VM can run as
+// separate processes. Words are written into the mapping and read out of
+// it in place, and pushes and pops are plain loads and stores on the shared
+// indices, as in process; like CachedRingBuffer, each side keeps a private
+// copy of the other's index and only re-reads it when the ring looks full
+// or empty. A side that cannot make progress spins for SPIN_LIMIT tries and
+// then parks on a futex on the other side's index. Publishing an index is
+// a sequentially consistent store followed by a look at the peer's parked
+// flag; the wake syscall is made only when that flag is set.
+//
+// Segment layout, version 1 (fixed-width fields: 32- and 64-bit processes
+// agree on it):
+//   0    header: "LC3B", version, capacity in words (a power of two),
+//        word size, ready, closed, producer pid, consumer pid
+//   64   parked flags: [SHM_PRODUCER] waits for room, [SHM_CONSUMER] for words
+//   128  head, published by the producer
+//   192  tail, published by the consumer
+//   256  capacity words
+// Whoever opens the name first creates it and sets ready last; anyone else
+// waits for ready and refuses a segment whose magic, version, word size or
+// capacity it does not expect. Head and tail stay in the segment, so a
+// side that exits (or crashes) can be restarted and carries on where it
+// left off.
+
+enum ShmSide { SHM_PRODUCER, SHM_CONSUMER };
+
+enum : uint32_t { SHM_BUS_MAGIC = 0x42334C43 /* "LC3B" */, SHM_BUS_VERSION = 1 };
+
+struct ShmBusLayout {
+    alignas(64) uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t word_bytes;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> closed;
+    std::atomic<int32_t> pid[2];      // attached producer / consumer, 0 when none
+    alignas(64) std::atomic<uint32_t> parked[2];
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) uint16_t buffer[1];   // capacity words
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be plain 32-bit words");
+
+static inline void shm_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+class ShmRing {
+public:
+    enum { HEADER_BYTES = 256, SPIN_LIMIT = 256, PARK_TIMEOUT_US = 100000, OPEN_TIMEOUT_MS = 2000 };
+
+    ShmRing() {}
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+    ~ShmRing() { detach(); }
+
+    // Creates the bus when the name is new, else attaches to it. capacity 0
+    // takes an existing bus's size (a new one gets 1024). False, with
+    // error() saying why, on a bad segment or a side that is already
+    // attached in a live process.
+    bool open(const char* name, ShmSide side, uint32_t capacity) {
+        detach();
+        my_side = side;
+        bool created = true;
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            created = false;
+            fd = shm_open(name, O_RDWR, 0);
+        }
+        if (fd < 0) return fail("shm_open", name);
+
+        size_t bytes;
+        if (created) {
+            if (!capacity) capacity = 1024;
+            if (capacity < 2 || (capacity & (capacity - 1))) {
+                ::close(fd);
+                shm_unlink(name);
+                errno = 0;
+                return fail("capacity is not a power of two", name);
+            }
+            bytes = HEADER_BYTES + (size_t)capacity * sizeof(uint16_t);
+            if (ftruncate(fd, (off_t)bytes) != 0) {
+                ::close(fd);
+                shm_unlink(name);
+                return fail("ftruncate", name);
+            }
+        } else {
+            bytes = settled_size(fd);
+            if (bytes < HEADER_BYTES) {
+                ::close(fd);
+                errno = 0;
+                return fail("segment is too small", name);
+            }
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return fail("mmap", name);
+        bus = (ShmBusLayout*)p;
+        mapped = bytes;
+
+        if (created) {
+            bus->magic = SHM_BUS_MAGIC;
+            bus->version = SHM_BUS_VERSION;
+            bus->capacity = capacity;
+            bus->word_bytes = sizeof(uint16_t);
+            bus->ready.store(1, std::memory_order_release);
+        } else if (!settled_ready()) {
+            return fail_detach("not initialized by its creator", name);
+        } else if (bus->magic != SHM_BUS_MAGIC || bus->version != SHM_BUS_VERSION || bus->word_bytes != sizeof(uint16_t)) {
+            return fail_detach("not a version 1 bus", name);
+        } else if (mapped != HEADER_BYTES + (size_t)bus->capacity * sizeof(uint16_t)
+                   || (capacity && capacity != bus->capacity)) {
+            return fail_detach("capacity does not match", name);
+        }
+
+        int32_t me = (int32_t)getpid();
+        int32_t other = bus->pid[side].load(std::memory_order_acquire);
+        if (other && other != me && kill(other, 0) == 0) return fail_detach("side is attached in a live process", name);
+        bus->pid[side].store(me, std::memory_order_release);
+
+        mask = bus->capacity - 1;
+        cached_tail = bus->tail.load(std::memory_order_acquire);
+        cached_head = bus->head.load(std::memory_order_acquire);
+        spins = 0;
+        return true;
+    }
+
+    void detach() {
+        if (!bus) return;
+        int32_t me = (int32_t)getpid();
+        bus->pid[my_side].compare_exchange_strong(me, 0);
+        munmap(bus, mapped);
+        bus = nullptr;
+    }
+
+    static bool unlink(const char* name) { return shm_unlink(name) == 0; }
+
+    const char* error() const { return why; }
+    uint32_t capacity() const { return bus ? bus->capacity : 0; }
+
+    bool push(uint16_t v) {
+        uint32_t h = bus->head.load(std::memory_order_relaxed);
+        if (free_slots(h, 1) == 0) return false;
+        bus->buffer[h] = v;
+        publish_head((h + 1) & mask);
+        return true;
+    }
+
+    bool pop(uint16_t& v) {
+        uint32_t t = bus->tail.load(std::memory_order_relaxed);
+        if (used_slots(t, 1) == 0) return false;
+        v = bus->buffer[t];
+        publish_tail((t + 1) & mask);
+        return true;
+    }
+
+    size_t push_bulk(const uint16_t* v, size_t n) {
+        uint32_t h = bus->head.load(std::memory_order_relaxed);
+        size_t space = free_slots(h, n);
+        if (n > space) n = space;
+        if (n == 0) return 0;
+        size_t first = mask + 1 - h < n ? mask + 1 - h : n;
+        memcpy(bus->buffer + h, v, first * sizeof(uint16_t));
+        memcpy(bus->buffer, v + first, (n - first) * sizeof(uint16_t));
+        publish_head((uint32_t)(h + n) & mask);
+        return n;
+    }
+
+    size_t pop_bulk(uint16_t* v, size_t n) {
+        uint32_t t = bus->tail.load(std::memory_order_relaxed);
+        size_t avail = used_slots(t, n);
+        if (n > avail) n = avail;
+        if (n == 0) return 0;
+        size_t first = mask + 1 - t < n ? mask + 1 - t : n;
+        memcpy(v, bus->buffer + t, first * sizeof(uint16_t));
+        memcpy(v + first, bus->buffer, (n - first) * sizeof(uint16_t));
+        publish_tail((uint32_t)(t + n) & mask);
+        return n;
+    }
+
+    // in place, as CachedRingBuffer: up to n contiguous slots of the mapping
+    size_t write_reserve(uint16_t** slots, size_t n) {
+        uint32_t h = bus->head.load(std::memory_order_relaxed);
+        size_t space = free_slots(h, n);
+        if (n > space) n = space;
+        if (n > mask + 1 - h) n = mask + 1 - h;
+        *slots = bus->buffer + h;
+        return n;
+    }
+
+    void write_commit(size_t n) {
+        uint32_t h = bus->head.load(std::memory_order_relaxed);
+        publish_head((uint32_t)(h + n) & mask);
+    }
+
+    size_t read_reserve(const uint16_t** slots, size_t n) {
+        uint32_t t = bus->tail.load(std::memory_order_relaxed);
+        size_t avail = used_slots(t, n);
+        if (n > avail) n = avail;
+        if (n > mask + 1 - t) n = mask + 1 - t;
+        *slots = bus->buffer + t;
+        return n;
+    }
+
+    void read_commit(size_t n) {
+        uint32_t t = bus->tail.load(std::memory_order_relaxed);
+        publish_tail((uint32_t)(t + n) & mask);
+    }
+
+    // After a push (pop) that found the ring full (empty): spins, and every
+    // SPIN_LIMIT calls parks until the peer moves its index, the bus is
+    // closed, or PARK_TIMEOUT_US passes (a peer that died cannot wake us).
+    void wait() {
+        if (++spins < SPIN_LIMIT) {
+            shm_relax();
+            return;
+        }
+        spins = 0;
+        park();
+    }
+
+    // producer: no more words; wakes a parked consumer
+    void close() {
+        bus->closed.store(1, std::memory_order_seq_cst);
+        futex_wake(&bus->head);
+    }
+
+    bool closed() const { return bus->closed.load(std::memory_order_acquire) != 0; }
+
+    uint64_t parks = 0; // futex waits this side made
+    uint64_t wakes = 0; // futex wakes this side made
+
+private:
+    ShmBusLayout* bus = nullptr;
+    size_t mapped = 0;
+    ShmSide my_side = SHM_PRODUCER;
+    uint32_t mask = 0;
+    uint32_t cached_tail = 0; // producer's last view of tail
+    uint32_t cached_head = 0; // consumer's last view of head
+    unsigned spins = 0;
+    char why[160] = "";
+
+    size_t free_slots(uint32_t h, size_t want) {
+        size_t space = (cached_tail - h - 1) & mask;
+        if (space < want) {
+            cached_tail = bus->tail.load(std::memory_order_acquire);
+            space = (cached_tail - h - 1) & mask;
+        }
+        return space;
+    }
+
+    size_t used_slots(uint32_t t, size_t want) {
+        size_t avail = (cached_head - t) & mask;
+        if (avail < want) {
+            cached_head = bus->head.load(std::memory_order_acquire);
+            avail = (cached_head - t) & mask;
+        }
+        return avail;
+    }
+
+    // seq_cst store, then the peer's flag: either the peer sees the new
+    // index before it sleeps or we see it parked (it sets the flag, then
+    // re-reads the index)
+    void publish_head(uint32_t h) {
+        bus->head.store(h, std::memory_order_seq_cst);
+        spins = 0;
+        if (bus->parked[SHM_CONSUMER].load(std::memory_order_seq_cst) && bus->parked[SHM_CONSUMER].exchange(0)) {
+            futex_wake(&bus->head);
+            ++wakes;
+        }
+    }
+
+    void publish_tail(uint32_t t) {
+        bus->tail.store(t, std::memory_order_seq_cst);
+        spins = 0;
+        if (bus->parked[SHM_PRODUCER].load(std::memory_order_seq_cst) && bus->parked[SHM_PRODUCER].exchange(0)) {
+            futex_wake(&bus->tail);
+            ++wakes;
+        }
+    }
+
+    // the index the peer moves, and whether its current value lets us go on
+    bool blocked_on(std::atomic<uint32_t>*& index, uint32_t& seen) {
+        if (my_side == SHM_CONSUMER) {
+            index = &bus->head;
+            seen = index->load(std::memory_order_seq_cst);
+            return seen == bus->tail.load(std::memory_order_relaxed) && !bus->closed.load(std::memory_order_seq_cst);
+        }
+        index = &bus->tail;
+        seen = index->load(std::memory_order_seq_cst);
+        return ((bus->head.load(std::memory_order_relaxed) + 1) & mask) == seen;
+    }
+
+    void park() {
+        std::atomic<uint32_t>& flag = bus->parked[my_side];
+        std::atomic<uint32_t>* index;
+        uint32_t seen;
+        flag.store(1, std::memory_order_seq_cst);
+        if (blocked_on(index, seen)) {
+            ++parks;
+            futex_wait(index, seen);
+        }
+        flag.store(0, std::memory_order_relaxed);
+    }
+
+    // returns when *word != seen, on a wake, or after PARK_TIMEOUT_US
+    static void futex_wait(std::atomic<uint32_t>* word, uint32_t seen) {
+#if defined(__linux__)
+        timespec ts = { 0, PARK_TIMEOUT_US * 1000L };
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, seen, &ts, nullptr, 0);
+#else
+        (void)word;
+        (void)seen;
+        std::this_thread::sleep_for(std::chrono::microseconds(50)); // no shared futex: poll
+#endif
+    }
+
+    static void futex_wake(std::atomic<uint32_t>* word) {
+#if defined(__linux__)
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+        (void)word;
+#endif
+    }
+
+    // an opener can get in between the creator's shm_open and ftruncate
+    static size_t settled_size(int fd) {
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(OPEN_TIMEOUT_MS);
+        struct stat st;
+        while (fstat(fd, &st) == 0) {
+            if (st.st_size > 0 || std::chrono::steady_clock::now() > give_up) return (size_t)st.st_size;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 0;
+    }
+
+    bool settled_ready() {
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(OPEN_TIMEOUT_MS);
+        while (!bus->ready.load(std::memory_order_acquire)) {
+            if (std::chrono::steady_clock::now() > give_up) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    bool fail(const char* what, const char* name) {
+        snprintf(why, sizeof(why), "bus %s: %s%s%s", name, what, errno ? ": " : "", errno ? strerror(errno) : "");
+        return false;
+    }
+
+    bool fail_detach(const char* what, const char* name) {
+        munmap(bus, mapped);
+        bus = nullptr;
+        errno = 0;
+        return fail(what, name);
+    }
+};
+
+// A ShmRing as an LC3VM channel. One process holds the SHM_PRODUCER end
+// and sends on it, another holds SHM_CONSUMER and receives; the producer
+// calls ring.close() when its VM stops, and the consumer's Channel::closed
+// follows the bus's once a receive finds the ring empty.
+class ShmChannel : public Channel {
+public:
+    ShmRing ring;
+
+    bool open(const char* name, ShmSide side, uint32_t capacity) {
+        if (!ring.open(name, side, capacity)) return false;
+        kind = CH_SPSC;
+        size = ring.capacity();
+        senders = side == SHM_PRODUCER;
+        return true;
+    }
+
+    bool try_send(uint16_t v) override { return ring.push(v); }
+    bool try_recv(uint16_t& v, ChannelCursor&) override { return ring.pop(v) || drained(); }
+    size_t send_bulk(const uint16_t* v, size_t n) override { return ring.push_bulk(v, n); }
+    size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor&) override {
+        size_t got = ring.pop_bulk(v, n);
+        if (!got) drained();
+        return got;
+    }
+    void wait_send() override { ring.wait(); }
+    void wait_recv() override { ring.wait(); }
+
+private:
+    bool drained() {
+        if (ring.closed()) closed.store(true, std::memory_order_release);
+        return false;
+    }
+};
@@ -0,0 +1,104 @@
+// shm_vm.cpp — one LC3VM per process, talking to VMs in other processes
+// over shared-memory buses (shm_bus.hpp). Linux / POSIX only.
+//
+// g++ -std=c++17 -O2 shm_vm.cpp -o shm-vm -pthread -lrt
+// ./shm-vm --tx 0=lc3pair --limit 50000 corpus/pair_producer.obj &
+// ./shm-vm --rx 0=lc3pair corpus/pair_consumer.obj
+//
+//   --tx ID=NAME   send on bus NAME as channel ID (the producer end)
+//   --rx ID=NAME   receive from bus NAME as channel ID (the consumer end)
+//   --size N       words in a bus this process creates (default 1024)
+//   --limit N      instruction cap (default: run until HALT)
+//
+// Either end may start first; the first one creates the bus. A producer
+// closes its buses when its VM stops, and a consumer that drained a closed
+// bus removes its name. A consumer stopped by --limit leaves the bus in
+// place, so another one can attach later and continue from the same word.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include "lc3_vm.hpp"
+#include "shm_bus.hpp"
+
+struct BusSpec {
+    int id;
+    std::string name;
+    ShmSide side;
+};
+
+static void usage() {
+    printf("usage: shm-vm [--size N] [--limit N] [--tx ID=NAME]... [--rx ID=NAME]... image.obj\n");
+    exit(2);
+}
+
+// "ID=NAME"; shm_open wants the name to start with '/'
+static BusSpec parse_bus(const char* arg, ShmSide side) {
+    const char* eq = strchr(arg, '=');
+    char* end;
+    long id = strtol(arg, &end, 10);
+    if (!eq || end != eq || id < 0 || id >= LC3VM_MAX_CHANNELS || !eq[1]) usage();
+    BusSpec b;
+    b.id = (int)id;
+    b.name = eq[1] == '/' ? std::string(eq + 1) : "/" + std::string(eq + 1);
+    b.side = side;
+    return b;
+}
+
+int main(int argc, const char* argv[]) {
+    std::vector<BusSpec> specs;
+    uint32_t size = 0;
+    uint64_t limit = UINT64_MAX;
+    const char* image = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--tx") && has_arg) specs.push_back(parse_bus(argv[++i], SHM_PRODUCER));
+        else if (!strcmp(argv[i], "--rx") && has_arg) specs.push_back(parse_bus(argv[++i], SHM_CONSUMER));
+        else if (!strcmp(argv[i], "--size") && has_arg) size = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--limit") && has_arg) limit = strtoull(argv[++i], nullptr, 10);
+        else if (argv[i][0] == '-' || image) usage();
+        else image = argv[i];
+    }
+    if (!image) usage();
+
+    std::vector<std::unique_ptr<ShmChannel>> buses; // outlive the VM
+    LC3VM vm;
+    vm.max_instr = limit;
+    vm.load_image(image);
+
+    for (const BusSpec& b : specs) {
+        if (vm.channels[b.id]) {
+            printf("channel %d is attached twice\n", b.id);
+            return 2;
+        }
+        buses.emplace_back(new ShmChannel());
+        if (!buses.back()->open(b.name.c_str(), b.side, size)) {
+            printf("%s\n", buses.back()->ring.error());
+            return 1;
+        }
+        vm.attach(b.id, buses.back().get());
+    }
+
+    vm.run();
+    for (size_t i = 0; i < specs.size(); ++i) {
+        if (specs[i].side == SHM_PRODUCER) buses[i]->ring.close();
+    }
+    vm.report();
+
+    printf("\n==== Buses ====\n");
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const BusSpec& b = specs[i];
+        ShmChannel& ch = *buses[i];
+        bool drained = b.side == SHM_CONSUMER && ch.closed.load(std::memory_order_acquire);
+        printf("%-16s ch %-2d %s  %5u words  sent %llu  recv %llu  parks %llu  wakes %llu%s\n", b.name.c_str(), b.id,
+               b.side == SHM_PRODUCER ? "tx" : "rx", ch.ring.capacity(), (unsigned long long)vm.ch_sent[b.id],
+               (unsigned long long)vm.ch_recv[b.id], (unsigned long long)ch.ring.parks,
+               (unsigned long long)ch.ring.wakes, drained ? "  (closed, removed)" : "");
+        if (drained) ShmRing::unlink(b.name.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+#include "lc3_vm.hpp"
+
+// g++ -std=c++17 -O2 snapshot_test.cpp -o snapshot_test -pthread
+// State that has to survive LC3VM::fork(), restore() and a snapshot
+// save/load round trip. Each case stops a small guest partway, carries it
+// over and lets the copy finish. The last case stops a guest at its
+// instruction limit instead. Exits 1 if any case fails.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%-56s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+static void load_words(LC3VM& vm, const uint16_t* words, size_t n) {
+    for (size_t i = 0; i < n; ++i) vm.memory.write((uint16_t)(0x3000 + i), words[i]);
+    vm.reg[8] = 0x3000;
+}
+
+// the copy of vm, three ways
+static std::unique_ptr<LC3VM> carry(const LC3VM& vm, int how) {
+    if (how == 0) return vm.fork();
+    std::unique_ptr<LC3VM> copy(new LC3VM());
+    LC3Snapshot s = vm.snapshot();
+    if (how == 2) {
+        const char* path = "snapshot_test.snap";
+        bool ok = s.save(path) && s.load(path);
+        remove(path);
+        if (!ok) return nullptr;
+    }
+    copy->restore(s);
+    return copy;
+}
+
+static const char* how_names[] = { "fork", "restore", "save/load" };
+
+// a status load takes the word into the receive holding register; the
+// data load after the copy must still find it
+static void status_then_data(int how) {
+    static const uint16_t prog[] = {
+        0xA002, // LDI R0, x3003   status
+        0xA202, // LDI R1, x3004   data
+        0xF025, // HALT
+        0xFE20, 0xFE21,
+    };
+    std::unique_ptr<Channel> ch(make_channel(CH_SPSC, 64));
+    ch->try_send(0x1234);
+    LC3VM vm;
+    vm.attach(0, ch.get());
+    load_words(vm, prog, sizeof(prog) / sizeof(prog[0]));
+    vm.run_quantum(1);
+
+    std::unique_ptr<LC3VM> copy = carry(vm, how);
+    bool ok = copy != nullptr;
+    if (ok) {
+        copy->run_quantum(2);
+        ok = (copy->reg[0] & CH_RX_READY) && copy->reg[1] == 0x1234 && !copy->running;
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s between a status and a data load", how_names[how]);
+    check(ok, what);
+}
+
+// a store to a full channel is held; the copy sends it when it halts
+static void held_store(int how) {
+    static const uint16_t prog[] = {
+        0xB401, // STI R2, x3002   data, channel full
+        0xF025, // HALT
+        0xFE21,
+    };
+    std::unique_ptr<Channel> full(make_channel(CH_SPSC, 64));
+    std::unique_ptr<Channel> empty(make_channel(CH_SPSC, 64));
+    while (full->try_send(0)) {}
+    LC3VM vm;
+    vm.attach(0, full.get());
+    load_words(vm, prog, sizeof(prog) / sizeof(prog[0]));
+    vm.reg[2] = 0x5678;
+    vm.run_quantum(1);
+
+    std::unique_ptr<LC3VM> copy = carry(vm, how);
+    bool ok = copy != nullptr;
+    if (ok) {
+        copy->attach(0, empty.get());
+        copy->run_quantum(1);
+        ChannelCursor c;
+        uint16_t v = 0;
+        ok = !copy->running && empty->try_recv(v, c) && v == 0x5678;
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s with a store held for a full channel", how_names[how]);
+    check(ok, what);
+}
+
+// a guest asleep in WAIT on its 1 ms timer; the copy's timer starts a new
+// period and wakes it into the handler
+static void wait_on_timer(int how) {
+    static const uint16_t prog[] = {
+        0xE007, // LEA R0, TMRISR
+        0xB00B, // STI R0, VTMR
+        0x2008, // LD R0, PERIOD
+        0xB00B, // STI R0, TMRUS
+        0x2007, // LD R0, IE
+        0xB008, // STI R0, TMR
+        0xF026, // WAIT
+        0xF025, // HALT
+        0xA005, // TMRISR: LDI R0, TMR
+        0x16E1, // ADD R3, R3, #1
+        0x8000, // RTI
+        1000, 0x4000, 0x0181, 0xFE50, 0xFE51,
+    };
+    LC3VM vm;
+    load_words(vm, prog, sizeof(prog) / sizeof(prog[0]));
+    vm.yield_on_block = true; // WAIT yields instead of sleeping
+    bool ok = vm.run_quantum(100) == VM_BLOCKED && vm.reg[8] == 0x3006;
+
+    std::unique_ptr<LC3VM> copy = carry(vm, how);
+    ok = ok && copy != nullptr;
+    if (ok) {
+        copy->yield_on_block = false;
+        copy->run();
+        ok = copy->reg[3] == 1 && !copy->running;
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s while waiting on the timer", how_names[how]);
+    check(ok, what);
+}
+
+// max_instr ends the guest right after a store to a full channel: the
+// held word still goes out before the VM counts as halted
+static void limit_on_held_store() {
+    static const uint16_t prog[] = {
+        0xB401, // STI R2, x3002   data, channel full
+        0xF025, // HALT, never reached
+        0xFE21,
+    };
+    std::unique_ptr<Channel> ch(make_channel(CH_SPSC, 64));
+    while (ch->try_send(0)) {}
+    LC3VM vm;
+    vm.attach(0, ch.get());
+    load_words(vm, prog, sizeof(prog) / sizeof(prog[0]));
+    vm.reg[2] = 0x5678;
+    vm.max_instr = 1;
+    vm.yield_on_block = true;
+    bool ok = vm.run_quantum(10) == VM_BLOCKED; // nowhere to put it yet
+
+    ChannelCursor c;
+    uint16_t v = 0;
+    for (int i = 0; i < 64; ++i) ch->try_recv(v, c);
+    ok = ok && vm.run_quantum(10) == VM_HALTED && ch->try_recv(v, c) && v == 0x5678;
+    check(ok, "instruction limit right after a held store");
+}
+
+int main() {
+    for (int how = 0; how < 3; ++how) {
+        status_then_data(how);
+        held_store(how);
+        wait_on_timer(how);
+    }
+    limit_on_held_store();
+    return failures ? 1 : 0;
+}
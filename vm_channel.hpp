@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "ring_buffer.hpp"
+#include "mpmc_queue.hpp"
+#include "broadcast_ring.hpp"
+
+// A VM bus channel as the SEND/RECV traps see it. The queue types are
+// templated on their size, so every channel type is instantiated for a
+// fixed set of power-of-two sizes and picked at runtime by make_channel.
+// Messages only cross a virtual call inside a trap, never per instruction.
+
+enum ChannelKind { CH_SPSC, CH_MPMC, CH_BROADCAST };
+
+// Per-VM receive state; only broadcast channels use it.
+struct ChannelCursor {
+    size_t   pos = 0;
+    uint64_t lagged = 0;
+};
+
+// Set on a channel by a receiver that takes an interrupt when words
+// arrive (lc3_interrupts.hpp); senders ring it after each send.
+class ChannelDoorbell {
+public:
+    virtual ~ChannelDoorbell() {}
+    virtual void ring() = 0;
+};
+
+class Channel {
+public:
+    virtual ~Channel() {}
+    virtual bool   try_send(uint16_t v) = 0;
+    virtual bool   try_recv(uint16_t& v, ChannelCursor& c) = 0;
+    virtual size_t send_bulk(const uint16_t* v, size_t n) = 0;
+    virtual size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor& c) = 0;
+    virtual ChannelCursor subscribe() { return ChannelCursor(); }
+    // a VM found the channel full (empty) and is about to try again; the
+    // in-process channels let it spin, shm_bus.hpp parks after a while
+    virtual void wait_send() {}
+    virtual void wait_recv() {}
+
+    ChannelKind kind;
+    size_t size;
+    std::atomic<int>  senders{0};     // sending VMs still running
+    std::atomic<bool> closed{false};  // set when the last sender finished
+    std::atomic<ChannelDoorbell*> doorbell{nullptr}; // one receiver's; most channels have none
+
+    // after a send: one load when nobody listens
+    void notify() {
+        if (ChannelDoorbell* d = doorbell.load(std::memory_order_acquire)) d->ring();
+    }
+
+    // called by every sending VM when it stops
+    void sender_done() {
+        if (senders.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            closed.store(true, std::memory_order_release);
+            notify();
+        }
+    }
+};
+
+template<size_t Size>
+class SpscChannel : public Channel {
+    RingBuffer<uint16_t, Size> q;
+public:
+    bool   try_send(uint16_t v) override { return q.push(v); }
+    bool   try_recv(uint16_t& v, ChannelCursor&) override { return q.pop(v); }
+    size_t send_bulk(const uint16_t* v, size_t n) override { return q.push_bulk(v, n); }
+    size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor&) override { return q.pop_bulk(v, n); }
+};
+
+// A bulk send of up to Size words goes in whole or not at all, in one
+// run that other producers' words cannot split; longer ones go Size words
+// at a time.
+template<size_t Size>
+class MpmcChannel : public Channel {
+    MpmcQueue<uint16_t, Size> q;
+public:
+    bool try_send(uint16_t v) override { return q.push(v); }
+    bool try_recv(uint16_t& v, ChannelCursor&) override { return q.pop(v); }
+    size_t send_bulk(const uint16_t* v, size_t n) override { return q.push_bulk(v, n < Size ? n : Size); }
+    size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor&) override {
+        size_t i = 0;
+        while (i < n && q.pop(v[i])) ++i;
+        return i;
+    }
+};
+
+template<size_t Size>
+class BroadcastChannel : public Channel {
+    BroadcastRing<uint16_t, Size> q;
+    typedef typename BroadcastRing<uint16_t, Size>::Reader Reader;
+
+    static Reader to_reader(const ChannelCursor& c) {
+        Reader r;
+        r.pos = c.pos;
+        r.lagged = c.lagged;
+        return r;
+    }
+public:
+    // the writer never waits for readers
+    bool try_send(uint16_t v) override { q.publish(v); return true; }
+    bool try_recv(uint16_t& v, ChannelCursor& c) override {
+        Reader r = to_reader(c);
+        bool got = q.read(r, v);
+        c.pos = r.pos;
+        c.lagged = r.lagged;
+        return got;
+    }
+    size_t send_bulk(const uint16_t* v, size_t n) override {
+        for (size_t i = 0; i < n; ++i) q.publish(v[i]);
+        return n;
+    }
+    size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor& c) override {
+        size_t i = 0;
+        while (i < n && try_recv(v[i], c)) ++i;
+        return i;
+    }
+    ChannelCursor subscribe() override {
+        ChannelCursor c;
+        c.pos = q.subscribe().pos;
+        return c;
+    }
+};
+
+template<template<size_t> class Impl>
+Channel* make_sized(size_t size) {
+    switch (size) {
+        case 64:    return new Impl<64>();
+        case 256:   return new Impl<256>();
+        case 1024:  return new Impl<1024>();
+        case 4096:  return new Impl<4096>();
+        case 16384: return new Impl<16384>();
+        case 65536: return new Impl<65536>();
+        default:    return nullptr;
+    }
+}
+
+// nullptr for sizes outside 64/256/1024/4096/16384/65536
+inline Channel* make_channel(ChannelKind kind, size_t size) {
+    Channel* c = nullptr;
+    switch (kind) {
+        case CH_SPSC:      c = make_sized<SpscChannel>(size); break;
+        case CH_MPMC:      c = make_sized<MpmcChannel>(size); break;
+        case CH_BROADCAST: c = make_sized<BroadcastChannel>(size); break;
+    }
+    if (c) {
+        c->kind = kind;
+        c->size = size;
+    }
+    return c;
+}
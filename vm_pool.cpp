@@ -0,0 +1,170 @@
+// vm_pool.cpp — many LC-3 VMs on a fixed pool of worker threads
+//
+// g++ -std=c++17 -O2 vm_pool.cpp -o vm-pool -pthread
+// ./vm-pool --workers 16 --pairs 5000 fanin_producer.obj fanin_consumer.obj
+// --telemetry FILE writes counter snapshots (built with -DLC3_TELEMETRY=1)
+//
+// Builds P producer/consumer pairs joined by their own SPSC channel
+// (attached as channel 1, which the fan-in guests use) and runs all 2P VMs
+// under VmScheduler: each VM gets a quantum of instructions at a time and
+// yields instead of spinning when its channel is full or empty. Producers
+// stop after --limit instructions; consumers halt once their channel is
+// closed and drained.
+//
+// Each image is loaded once and every VM is forked from it, sharing its
+// memory copy-on-write, so a VM only costs the pages it writes. An image
+// ending in .snap is read as a saved snapshot instead; --save-snapshots
+// writes <image>.snap for both templates before the run.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <string>
+#include "vm_scheduler.hpp"
+
+static void usage() {
+    printf("vm-pool [--workers N] [--pairs P] [--quantum Q] [--limit L] [--size S] [--save-snapshots]\n"
+           "        [--telemetry snapshot-file] [--telemetry-ms N] producer.obj|.snap consumer.obj|.snap\n");
+    exit(2);
+}
+
+static void load_template(LC3VM& vm, const char* path) {
+    size_t len = strlen(path);
+    if (len > 5 && !strcmp(path + len - 5, ".snap")) {
+        LC3Snapshot snap;
+        if (!snap.load(path)) {
+            printf("failed to load snapshot: %s\n", path);
+            exit(1);
+        }
+        vm.restore(snap);
+        vm.image_name = path;
+    } else {
+        vm.load_image(path);
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    int workers = (int)std::thread::hardware_concurrency();
+    int pairs = 1000;
+    uint64_t quantum = 1000;
+    uint64_t limit = 100000;
+    size_t size = 64;
+    bool save_snapshots = false;
+    const char* images[2] = {};
+    int n_images = 0;
+    const char* telemetry_path = nullptr;
+    unsigned telemetry_ms = 100;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--workers") && has_arg) workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pairs") && has_arg) pairs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--quantum") && has_arg) quantum = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--limit") && has_arg) limit = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--size") && has_arg) size = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--save-snapshots")) save_snapshots = true;
+        else if (!strcmp(argv[i], "--telemetry") && has_arg) telemetry_path = argv[++i];
+        else if (!strcmp(argv[i], "--telemetry-ms") && has_arg) telemetry_ms = (unsigned)atoi(argv[++i]);
+        else if (argv[i][0] == '-' || n_images == 2) usage();
+        else images[n_images++] = argv[i];
+    }
+    if (n_images != 2 || workers < 1 || pairs < 1 || quantum < 1) usage();
+    if (telemetry_path && !LC3_TELEMETRY) {
+        printf("--telemetry: built without LC3_TELEMETRY\n");
+        exit(2);
+    }
+
+    LC3VM templates[2];
+    for (int t = 0; t < 2; ++t) {
+        load_template(templates[t], images[t]);
+        templates[t].yield_on_block = true;
+        if (save_snapshots) {
+            std::string out = std::string(images[t]) + ".snap";
+            if (!templates[t].snapshot().save(out.c_str())) {
+                printf("failed to write snapshot: %s\n", out.c_str());
+                exit(1);
+            }
+        }
+    }
+    templates[0].max_instr = limit;
+    templates[1].max_instr = UINT64_MAX;
+
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::vector<std::unique_ptr<LC3VM>> vms;
+    VmScheduler sched(workers, quantum);
+    auto spawn_start = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < pairs; ++p) {
+        Channel* ch = make_channel(CH_SPSC, size);
+        if (!ch) {
+            printf("unsupported channel size %zu (64, 256, 1024, 4096, 16384 or 65536)\n", size);
+            exit(1);
+        }
+        ch->senders = 1;
+        channels.emplace_back(ch);
+
+        vms.push_back(templates[0].fork());
+        vms.push_back(templates[1].fork());
+        LC3VM* prod = vms[vms.size() - 2].get();
+        LC3VM* cons = vms.back().get();
+        prod->attach(1, ch);
+        cons->attach(1, ch);
+
+        sched.add(VmScheduler::Task{ prod, { ch } });
+        sched.add(VmScheduler::Task{ cons, {} });
+    }
+
+    Telemetry telemetry;
+#if LC3_TELEMETRY
+    for (size_t i = 0; i < vms.size(); ++i) {
+        telemetry.add(((i & 1 ? "cons" : "prod") + std::to_string(i / 2)).c_str(), &vms[i]->telemetry);
+    }
+#endif
+    if (telemetry_path && !telemetry.start(telemetry_path, telemetry_ms)) {
+        printf("failed to open telemetry snapshot: %s\n", telemetry_path);
+        exit(1);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    double spawn_ms = std::chrono::duration<double, std::milli>(start - spawn_start).count();
+    sched.run();
+    telemetry.stop();
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    uint64_t instructions = 0, quanta = 0, blocked = 0, steals = 0;
+    printf("\n==== Workers ====\n");
+    printf("%-6s %14s %10s %10s %8s\n", "worker", "instructions", "quanta", "yields", "steals");
+    for (size_t w = 0; w < sched.stats().size(); ++w) {
+        const VmScheduler::WorkerStats& s = sched.stats()[w];
+        printf("%-6zu %14llu %10llu %10llu %8llu\n", w, (unsigned long long)s.instructions, (unsigned long long)s.quanta,
+               (unsigned long long)s.blocked, (unsigned long long)s.steals);
+        instructions += s.instructions;
+        quanta += s.quanta;
+        blocked += s.blocked;
+        steals += s.steals;
+    }
+
+    uint64_t sent = 0, recv = 0, private_pages = 0;
+    for (auto& vm : vms) {
+        sent += vm->msg_send;
+        recv += vm->msg_recv;
+        private_pages += vm->memory.private_pages();
+    }
+    printf("\n==== Pool ====\n");
+    printf("VMs                : %zu on %d workers, quantum %llu\n", vms.size(), workers, (unsigned long long)quantum);
+    printf("Spawn time         : %.2f ms (forked from %s, %s)\n", spawn_ms, images[0], images[1]);
+    printf("Private pages      : %llu (%.1f KB, %.2f per VM)\n", (unsigned long long)private_pages,
+           private_pages * CowMemory::PAGE_WORDS * 2 / 1024.0, (double)private_pages / vms.size());
+    printf("Instructions       : %llu\n", (unsigned long long)instructions);
+    printf("Elapsed time       : %.2f ms\n", elapsed_ms);
+    printf("Throughput         : %.2f MIPS\n", elapsed_ms ? instructions / (elapsed_ms * 1e3) : 0);
+    printf("Messages Sent: %llu, Recv: %llu\n", (unsigned long long)sent, (unsigned long long)recv);
+    printf("Quanta             : %llu (%llu ended by a blocked SEND/RECV)\n", (unsigned long long)quanta, (unsigned long long)blocked);
+    printf("Steals             : %llu\n", (unsigned long long)steals);
+    printf("=========================\n");
+}
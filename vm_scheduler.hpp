@@ -0,0 +1,166 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "lc3_vm.hpp"
+
+// Chase-Lev work-stealing deque of pointers (Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models"). The owning worker
+// pushes and pops at the bottom; other workers steal from the top with a
+// CAS. Capacity is fixed; the scheduler sizes it for every task it owns.
+template<typename T>
+class WorkStealingDeque {
+    std::atomic<T*>* slots;
+    size_t mask;
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+
+public:
+    explicit WorkStealingDeque(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots = new std::atomic<T*>[size];
+        mask = size - 1;
+    }
+    ~WorkStealingDeque() { delete[] slots; }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void push(T* item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        slots[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only
+    T* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) { // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = slots[b & mask].load(std::memory_order_relaxed);
+        if (t == b) { // last item: race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread
+    T* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        T* item = slots[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr; // lost the race
+        }
+        return item;
+    }
+};
+
+// Multiplexes many LC3VMs onto a fixed pool of worker threads. A VM runs
+// for one quantum at a time and is then parked on its worker until that
+// worker runs dry, so every VM gets one quantum per round: a VM that would
+// block on SEND/RECV yields instead of holding a core, and one that never
+// blocks (say, a guest polling channel registers) cannot starve the rest.
+// Idle workers steal runnable VMs from the others.
+class VmScheduler {
+public:
+    struct Task {
+        LC3VM* vm;
+        std::vector<Channel*> sends; // closed (sender_done) when the VM halts
+    };
+
+    // one cache line per worker; each writes its own after every quantum
+    struct alignas(64) WorkerStats {
+        uint64_t quanta = 0, blocked = 0, steals = 0, instructions = 0;
+    };
+
+    VmScheduler(int workers, uint64_t quantum) : quantum_(quantum), stats_(workers) {
+        for (int i = 0; i < workers; ++i) workers_.emplace_back(new Worker());
+    }
+
+    // before run(): tasks are dealt round-robin to the workers
+    void add(const Task& task) { tasks_.push_back(task); }
+
+    void run() {
+        size_t n = workers_.size();
+        for (auto& w : workers_) w->deque.reset(new WorkStealingDeque<Task>(tasks_.size() + 1));
+        for (size_t i = 0; i < tasks_.size(); ++i) workers_[i % n]->deque->push(&tasks_[i]);
+        live_.store((int64_t)tasks_.size());
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n; ++i) threads.emplace_back([this, i] { work((int)i); });
+        for (auto& t : threads) t.join();
+    }
+
+    const std::vector<WorkerStats>& stats() const { return stats_; }
+
+private:
+    struct Worker {
+        std::unique_ptr<WorkStealingDeque<Task>> deque;
+        std::vector<Task*> parked; // ran this round (or yielded), owner only
+    };
+
+    uint64_t quantum_;
+    std::vector<Task> tasks_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<WorkerStats> stats_;
+    alignas(64) std::atomic<int64_t> live_{0};
+
+    Task* find_work(int self) {
+        Worker& me = *workers_[self];
+        if (Task* t = me.deque->pop()) return t;
+
+        size_t n = workers_.size();
+        for (size_t k = 1; k < n; ++k) {
+            if (Task* t = workers_[(self + k) % n]->deque->steal()) {
+                ++stats_[self].steals;
+                return t;
+            }
+        }
+        // nothing runnable anywhere we looked: retry our parked VMs
+        if (!me.parked.empty()) {
+            for (Task* t : me.parked) me.deque->push(t);
+            me.parked.clear();
+            return me.deque->pop();
+        }
+        return nullptr;
+    }
+
+    void work(int self) {
+        Worker& me = *workers_[self];
+        WorkerStats& st = stats_[self];
+        while (live_.load(std::memory_order_acquire) > 0) {
+            Task* t = find_work(self);
+            if (!t) {
+                std::this_thread::yield();
+                continue;
+            }
+            uint64_t before = t->vm->instr_count;
+            RunState s = t->vm->run_quantum(quantum_);
+            st.instructions += t->vm->instr_count - before;
+            ++st.quanta;
+            if (s == VM_BLOCKED) ++st.blocked;
+            if (s != VM_HALTED) {
+                me.parked.push_back(t);
+            } else {
+                for (Channel* ch : t->sends) ch->sender_done();
+                live_.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+    }
+};
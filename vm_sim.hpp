@@ -0,0 +1,300 @@
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "lc3_vm.hpp"
+
+// Deterministic virtual-time co-simulation: every VM of a system in one
+// host thread, as a discrete-event simulation.
+//
+// Each LC3VM keeps its own clock in cycles, advanced by its per-opcode
+// costs (LC3VM::op_cost). VmSimulator always runs the VM whose clock is
+// furthest behind, for a quantum of cycles, ties going to the VM added
+// first; the same system gives the same run, instruction for instruction.
+// Channels are SimChannels: a word sent at cycle t reaches the receivers at
+// t + latency, so a ring operation is an event on the shared clock rather
+// than a memory race. A VM that would block (SEND to a full channel, RECV
+// from an empty one, WAIT) is not retried; it sleeps until an event on one
+// of its channels or its virtual timer, and its clock jumps ahead to it,
+// so blocked and idle VMs cost no host time.
+//
+// With a quantum no longer than the smallest latency, no VM runs past the
+// arrival of a word that another VM has yet to send; the default is half
+// of it. Longer quanta run faster but can see words late (never early).
+
+// one channel's costs, in cycles
+struct SimLink {
+    uint64_t latency = 100; // send to visible at the receiver, and a freed slot back to the sender
+    uint64_t send = 10;     // charged to the sender per SEND (per call for SEND_BULK)
+    uint64_t recv = 10;     // charged to the receiver per RECV (per call for RECV_BULK)
+    uint64_t word = 0;      // link occupancy per word: at most one word leaves every `word` cycles
+};
+
+class SimChannel;
+
+class VmSimulator {
+public:
+    enum : uint64_t { NEVER = UINT64_MAX };
+
+    struct VmStats {
+        uint64_t idle = 0;    // cycles skipped while blocked
+        uint64_t slices = 0;  // quanta run
+        uint64_t blocked = 0; // quanta that ended blocked
+    };
+
+    explicit VmSimulator(uint64_t quantum) : quantum_(quantum ? quantum : 1) {}
+
+    // before run(); the VM yields instead of waiting from here on
+    int add(LC3VM* vm) {
+        vm->yield_on_block = true;
+        slots_.push_back(Slot(vm));
+        return (int)slots_.size() - 1;
+    }
+    inline void connect(int vm, SimChannel* ch, bool sends);
+
+    // until every VM has halted, or the ones left wait for nothing
+    void run() {
+        for (size_t i = 0; i < slots_.size(); ++i) schedule((int)i, slots_[i].vm->cycles);
+        while (!ready_.empty()) {
+            Wake w = ready_.top();
+            ready_.pop();
+            Slot& s = slots_[w.vm];
+            if (w.gen != s.gen || s.halted) continue; // superseded
+            slice(s, w.at);
+        }
+        current_ = nullptr;
+    }
+
+    // what the running VM's channel operations see and pay
+    uint64_t now() const { return current_->cycles; }
+    void charge(uint64_t c) { current_->cycles += c; }
+    // the running VM found a word (or a slot) that is only due at t
+    void retry_at(uint64_t t) {
+        if (t < hint_) hint_ = t;
+    }
+    // something happened on ch at t: its blocked VMs look again then
+    inline void event(const SimChannel& ch, uint64_t t);
+
+    const VmStats& stats(int vm) const { return slots_[vm].stats; }
+    // halted VMs, and ones stuck waiting when the run ended
+    bool halted(int vm) const { return slots_[vm].halted; }
+    uint64_t end_time() const {
+        uint64_t t = 0;
+        for (const Slot& s : slots_) t = s.vm->cycles > t ? s.vm->cycles : t;
+        return t;
+    }
+
+private:
+    struct Slot {
+        LC3VM* vm;
+        std::vector<SimChannel*> sends; // finish() when the VM halts
+        bool waiting = false, halted = false;
+        uint64_t wake = NEVER;
+        unsigned gen = 0;
+        VmStats stats;
+
+        explicit Slot(LC3VM* vm) : vm(vm) {}
+    };
+    struct Wake {
+        uint64_t at;
+        int vm;
+        unsigned gen;
+        bool operator>(const Wake& o) const { return at != o.at ? at > o.at : vm > o.vm; }
+    };
+
+    uint64_t quantum_;
+    std::vector<Slot> slots_;
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> ready_;
+    LC3VM* current_ = nullptr;
+    uint64_t hint_ = NEVER;
+
+    void schedule(int vm, uint64_t at) {
+        Slot& s = slots_[vm];
+        s.wake = at;
+        ready_.push(Wake{ at, vm, ++s.gen });
+    }
+
+    inline void slice(Slot& s, uint64_t at);
+};
+
+// A channel on the virtual clock. Words carry the cycle they were sent and
+// the cycle they arrive; a receiver only takes one that has arrived by its
+// own clock. The sender sees a slot free again latency cycles after the
+// receiver took the word in it. Broadcast keeps the last size words and
+// laps a slow reader as BroadcastChannel does; spsc and mpmc are one FIFO.
+// The channel closes latency cycles after its last sender halts, once its
+// last word is in.
+class SimChannel : public Channel {
+public:
+    SimLink link;
+    HdrHistogram latency; // cycles from send to receive, per word
+    std::vector<int> ends; // VMs at either end, in VmSimulator order
+
+    SimChannel(VmSimulator* sim, ChannelKind k, size_t n, const SimLink& l) : link(l), sim(sim) {
+        kind = k;
+        size = n;
+    }
+
+    bool try_send(uint16_t v) override {
+        if (!room()) return false;
+        push(v);
+        sim->charge(link.send);
+        return true;
+    }
+
+    bool try_recv(uint16_t& v, ChannelCursor& c) override {
+        if (!take(v, c)) return false;
+        sim->charge(link.recv);
+        return true;
+    }
+
+    size_t send_bulk(const uint16_t* v, size_t n) override {
+        size_t i = 0;
+        if (kind == CH_MPMC) { // whole or nothing, as MpmcChannel
+            if (n > size) n = size;
+            if (!room(n)) return 0;
+        }
+        while (i < n && room()) push(v[i++]);
+        if (i) sim->charge(link.send);
+        return i;
+    }
+
+    size_t recv_bulk(uint16_t* v, size_t n, ChannelCursor& c) override {
+        size_t i = 0;
+        while (i < n && take(v[i], c)) ++i;
+        if (i) sim->charge(link.recv);
+        return i;
+    }
+
+    ChannelCursor subscribe() override {
+        ChannelCursor c;
+        c.pos = (size_t)(base + q.size());
+        return c;
+    }
+
+    // a sending VM halted at t; the last one closes the channel
+    void finish(uint64_t t) {
+        if (senders.fetch_sub(1, std::memory_order_relaxed) != 1) return;
+        close_at = t + link.latency > last_arrival ? t + link.latency : last_arrival;
+        sim->event(*this, close_at);
+    }
+
+private:
+    struct Word {
+        uint16_t v;
+        uint64_t sent, arrives;
+    };
+
+    VmSimulator* sim;
+    std::deque<Word> q;
+    uint64_t base = 0;           // sequence number of q.front(), for broadcast cursors
+    std::deque<uint64_t> freed;  // when slots taken by a receiver are free at the sender
+    uint64_t link_free = 0;      // the link can take the next word
+    uint64_t last_arrival = 0;
+    uint64_t close_at = VmSimulator::NEVER;
+
+    // n free slots at the sender
+    bool room(size_t n = 1) {
+        if (kind == CH_BROADCAST) return true; // the writer never waits for readers
+        uint64_t now = sim->now();
+        while (!freed.empty() && freed.front() <= now) freed.pop_front();
+        size_t used = q.size() + freed.size();
+        if (used + n <= size) return true;
+        size_t short_by = used + n - size;
+        if (short_by <= freed.size()) sim->retry_at(freed[short_by - 1]);
+        return false;
+    }
+
+    void push(uint16_t v) {
+        uint64_t now = sim->now();
+        uint64_t leaves = now > link_free ? now : link_free;
+        link_free = leaves + link.word;
+        Word w = { v, now, leaves + link.latency };
+        last_arrival = w.arrives;
+        q.push_back(w);
+        if (kind == CH_BROADCAST && q.size() > size) {
+            q.pop_front();
+            ++base;
+        }
+        sim->event(*this, w.arrives);
+        notify();
+    }
+
+    bool take(uint16_t& v, ChannelCursor& c) {
+        uint64_t now = sim->now();
+        size_t at = 0;
+        if (kind == CH_BROADCAST) {
+            if (c.pos < base) { // lapped
+                c.lagged += base - c.pos;
+                c.pos = (size_t)base;
+            }
+            at = (size_t)(c.pos - base);
+        }
+        if (at >= q.size()) {
+            if (now >= close_at) closed.store(true, std::memory_order_relaxed);
+            sim->retry_at(now >= close_at ? now : close_at);
+            return false;
+        }
+        const Word& w = q[at];
+        if (w.arrives > now) {
+            sim->retry_at(w.arrives);
+            return false;
+        }
+        v = w.v;
+        latency.record(now - w.sent);
+        if (kind == CH_BROADCAST) {
+            ++c.pos;
+            return true;
+        }
+        q.pop_front();
+        freed.push_back(now + link.latency);
+        sim->event(*this, now + link.latency);
+        return true;
+    }
+};
+
+void VmSimulator::connect(int vm, SimChannel* ch, bool sends) {
+    ch->ends.push_back(vm);
+    if (sends) slots_[vm].sends.push_back(ch);
+}
+
+void VmSimulator::event(const SimChannel& ch, uint64_t t) {
+    for (int vm : ch.ends) {
+        Slot& s = slots_[vm];
+        if (s.waiting && !s.halted && t < s.wake) schedule(vm, t);
+    }
+}
+
+void VmSimulator::slice(Slot& s, uint64_t at) {
+    LC3VM& vm = *s.vm;
+    if (vm.cycles < at) {
+        s.stats.idle += at - vm.cycles;
+        vm.cycles = at;
+    }
+    s.waiting = false;
+    current_ = &vm;
+    hint_ = NEVER;
+    RunState state = vm.run_cycles(vm.cycles + quantum_);
+    ++s.stats.slices;
+
+    if (state == VM_HALTED) {
+        s.halted = true;
+        for (SimChannel* ch : s.sends) ch->finish(vm.cycles);
+        return;
+    }
+    if (state == VM_RUNNING) {
+        schedule((int)(&s - slots_.data()), vm.cycles);
+        return;
+    }
+    ++s.stats.blocked;
+    s.waiting = true;
+    uint64_t due = vm.timer_due();
+    uint64_t wake = hint_ < due ? hint_ : due;
+    if (wake != NEVER) schedule((int)(&s - slots_.data()), wake);
+    else {
+        s.wake = NEVER;
+        ++s.gen;
+    }
+}
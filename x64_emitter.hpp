@@ -0,0 +1,139 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Minimal x86-64 machine-code emitter for the LC-3 JIT.
+// Only the instruction forms the translator needs are provided; every
+// 32-bit register write zero-extends into the full 64-bit register.
+
+enum X64Reg : uint8_t {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum X64Cond : uint8_t {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+    CC_S = 0x8, CC_NS = 0x9, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+// [base + index*scale + disp]; index < 0 means no index register.
+struct X64Mem {
+    X64Reg base;
+    int    index;
+    int    scale; // 1, 2, 4 or 8
+    int32_t disp;
+};
+
+inline X64Mem mem_at(X64Reg base, int32_t disp = 0) { return { base, -1, 1, disp }; }
+inline X64Mem mem_at(X64Reg base, X64Reg index, int scale, int32_t disp = 0) { return { base, index, scale, disp }; }
+
+class X64Emitter {
+public:
+    X64Emitter(uint8_t* buf, size_t cap) : buf_(buf), cap_(cap), len_(0) {}
+
+    uint8_t* here() const { return buf_ + len_; }
+    size_t   size() const { return len_; }
+    // False once an emit ran past the end of the buffer; the caller discards the code.
+    bool     ok() const { return len_ <= cap_; }
+
+    // ---- moves ----
+    void mov(X64Reg dst, X64Reg src)          { rr(0x89, src, dst); }
+    void mov(X64Reg dst, uint32_t imm) {
+        rex(false, 0, 0, dst);
+        byte(0xB8 + (dst & 7));
+        u32(imm);
+    }
+    void mov64(X64Reg dst, uint64_t imm) {
+        rex(true, 0, 0, dst);
+        byte(0xB8 + (dst & 7));
+        u64(imm);
+    }
+    void movzx16(X64Reg dst, X64Reg src)      { rex(false, dst, 0, src); byte(0x0F); byte(0xB7); modrm(3, dst, src); }
+    void movzx16(X64Reg dst, const X64Mem& m) { mem_op(false, false, dst, m, { 0x0F, 0xB7 }); }
+    void movzx8(X64Reg dst, const X64Mem& m)  { mem_op(false, false, dst, m, { 0x0F, 0xB6 }); }
+    void store16(const X64Mem& m, X64Reg src) { mem_op(false, true, src, m, { 0x89 }); }
+    void load64(X64Reg dst, const X64Mem& m)  { mem_op(true, false, dst, m, { 0x8B }); }
+    void store64(const X64Mem& m, X64Reg src) { mem_op(true, false, src, m, { 0x89 }); }
+
+    // ---- 32-bit ALU ----
+    void add(X64Reg dst, X64Reg src)          { rr(0x01, src, dst); }
+    void and_(X64Reg dst, X64Reg src)         { rr(0x21, src, dst); }
+    void test(X64Reg a, X64Reg b)             { rr(0x85, b, a); }
+    void add(X64Reg dst, int32_t imm)         { alu_imm(false, 0, dst, imm); }
+    void and_(X64Reg dst, int32_t imm)        { alu_imm(false, 4, dst, imm); }
+    void cmp(X64Reg dst, int32_t imm)         { alu_imm(false, 7, dst, imm); }
+    void test(X64Reg r, uint32_t imm)         { rex(false, 0, 0, r); byte(0xF7); modrm(3, 0, r); u32(imm); }
+    void not_(X64Reg r)                       { rex(false, 0, 0, r); byte(0xF7); modrm(3, 2, r); }
+    void shr(X64Reg r, uint8_t n)             { rex(false, 0, 0, r); byte(0xC1); modrm(3, 5, r); byte(n); }
+    void cmov(X64Cond cc, X64Reg dst, X64Reg src) {
+        rex(false, dst, 0, src); byte(0x0F); byte(0x40 + cc); modrm(3, dst, src);
+    }
+    // CF = bit `bit` of the bit string starting at m.
+    void bt(const X64Mem& m, X64Reg bit)      { mem_op(false, false, bit, m, { 0x0F, 0xA3 }); }
+
+    // ---- 64-bit ----
+    void add64(X64Reg dst, int32_t imm)       { alu_imm(true, 0, dst, imm); }
+    void sub64(X64Reg dst, int32_t imm)       { alu_imm(true, 5, dst, imm); }
+    void test64(X64Reg a, X64Reg b)           { rex(true, b, 0, a); byte(0x85); modrm(3, b, a); }
+    void push(X64Reg r)                       { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+    void pop(X64Reg r)                        { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+    void ret()                                { byte(0xC3); }
+
+    // ---- control flow; jumps return the rel32 slot for later patching ----
+    void     jmp(X64Reg r)                    { rex(false, 0, 0, r); byte(0xFF); modrm(3, 4, r); }
+    uint8_t* jmp(const uint8_t* target = nullptr) { byte(0xE9); return rel32(target); }
+    uint8_t* jcc(X64Cond cc, const uint8_t* target = nullptr) { byte(0x0F); byte(0x80 + cc); return rel32(target); }
+    static void patch(uint8_t* slot, const uint8_t* target) {
+        int32_t rel = (int32_t)(target - (slot + 4));
+        std::memcpy(slot, &rel, 4);
+    }
+
+private:
+    struct Opcode { uint8_t b0, b1; int n; Opcode(uint8_t a) : b0(a), b1(0), n(1) {} Opcode(uint8_t a, uint8_t b) : b0(a), b1(b), n(2) {} };
+
+    void byte(uint8_t b) { if (len_ < cap_) buf_[len_] = b; ++len_; }
+    void u32(uint32_t v) { for (int i = 0; i < 4; ++i) byte((uint8_t)(v >> (8 * i))); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; ++i) byte((uint8_t)(v >> (8 * i))); }
+    void modrm(int mod, int reg, int rm) { byte((uint8_t)((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
+
+    void rex(bool w, int reg, int index, int base) {
+        uint8_t r = (uint8_t)(0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+        if (r != 0x40) byte(r);
+    }
+    void rr(uint8_t op, X64Reg reg, X64Reg rm) { rex(false, reg, 0, rm); byte(op); modrm(3, reg, rm); }
+
+    void alu_imm(bool w, int ext, X64Reg dst, int32_t imm) {
+        rex(w, 0, 0, dst);
+        if (imm >= -128 && imm <= 127) { byte(0x83); modrm(3, ext, dst); byte((uint8_t)imm); }
+        else                           { byte(0x81); modrm(3, ext, dst); u32((uint32_t)imm); }
+    }
+
+    // Always uses a disp32 form, which sidesteps the rbp/r13 no-displacement special case.
+    void mem_op(bool w, bool op16, int reg, const X64Mem& m, Opcode op) {
+        if (op16) byte(0x66);
+        rex(w, reg, m.index < 0 ? 0 : m.index, m.base);
+        byte(op.b0);
+        if (op.n == 2) byte(op.b1);
+        if (m.index < 0 && (m.base & 7) != RSP) {
+            modrm(2, reg, m.base);
+        } else {
+            int ss = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+            int ix = m.index < 0 ? RSP : m.index; // index 100b = none
+            modrm(2, reg, RSP);
+            byte((uint8_t)((ss << 6) | ((ix & 7) << 3) | (m.base & 7)));
+        }
+        u32((uint32_t)m.disp);
+    }
+
+    uint8_t* rel32(const uint8_t* target) {
+        uint8_t* slot = here();
+        u32(0);
+        if (target && ok()) patch(slot, target);
+        return slot;
+    }
+
+    uint8_t* buf_;
+    size_t   cap_;
+    size_t   len_;
+};